@@ -1,29 +1,229 @@
 #ifndef ACTIVATION_H_
 #define ACTIVATION_H_
 
+#include "kernels.h"
 #include <cmath>
+#include <limits>
 
+/*
+ * Activation functions can be evaluated one value at a time or over whole arrays.
+ * The network only uses the array forms, which the built-in functions implement with
+ * the vectorized kernels from kernels.h; the defaults fall back to the scalar methods
+ * so custom activation functions only need to provide those. The array forms come in
+ * double and single precision, for networks of either scalar type.
+ */
 class ActivationFunction {
 public:
+  // Identifies the built-in functions in saved models; custom functions cannot be saved.
+  enum Type { CUSTOM = 0, SIGMOID = 1, TANH = 2, LEAKY_RELU = 3, SOFTMAX = 4, LINEAR = 5 };
+
   virtual double activation(const double input) = 0;
   virtual double gradient(const double input) = 0;
 
+  // Apply the activation in place to a rows x cols row-major block (one sample per row).
+  virtual void activation(double *values, const int rows, const int cols) {
+    for (int i = 0; i < rows*cols; ++i) {
+      values[i] = activation(values[i]);
+    }
+  }
+
+  // Multiply delta by the Jacobian of the activation, where output = activation(input),
+  // over a rows x cols row-major block laid out like the activation's.
+  virtual void gradient(const double *input, const double *output, double *delta, const int rows, const int cols) {
+    for (int i = 0; i < rows*cols; ++i) {
+      delta[i] *= gradient(input[i]);
+    }
+  }
+
+  virtual void activation(float *values, const int rows, const int cols) {
+    for (int i = 0; i < rows*cols; ++i) {
+      values[i] = activation(values[i]);
+    }
+  }
+
+  virtual void gradient(const float *input, const float *output, float *delta, const int rows, const int cols) {
+    for (int i = 0; i < rows*cols; ++i) {
+      delta[i] *= gradient(input[i]);
+    }
+  }
+
+  virtual Type type() const {
+    return CUSTOM;
+  }
+
+  // The parameter of a parametrized function (the slope of leaky ReLU), saved with its type
+  virtual double parameter() const {
+    return 0.0;
+  }
+
   virtual ~ActivationFunction() {};
 };
 
 class SigmoidFunction: public ActivationFunction {
 public:
+  using ActivationFunction::activation;
+  using ActivationFunction::gradient;
+
+  Type type() const {
+    return SIGMOID;
+  }
+
   double activation(const double input) {
     return (1.0)/(1.0 + exp(-input));
   }
 
   double gradient(const double input) {
-    return activation(input)*(1.0-activation(input));
+    const double output = activation(input);
+    return output*(1.0-output);
+  }
+
+  void activation(double *values, const int rows, const int cols) {
+    vectorSigmoid(values, rows*cols);
+  }
+
+  void gradient(const double *input, const double *output, double *delta, const int rows, const int cols) {
+    vectorSigmoidGradient(output, delta, rows*cols);
+  }
+
+  void activation(float *values, const int rows, const int cols) {
+    vectorSigmoid(values, rows*cols);
+  }
+
+  void gradient(const float *input, const float *output, float *delta, const int rows, const int cols) {
+    vectorSigmoidGradient(output, delta, rows*cols);
+  }
+};
+
+class TanhFunction: public ActivationFunction {
+public:
+  using ActivationFunction::activation;
+  using ActivationFunction::gradient;
+
+  Type type() const {
+    return TANH;
+  }
+
+  double activation(const double input) {
+    return tanh(input);
+  }
+
+  double gradient(const double input) {
+    const double output = tanh(input);
+    return 1.0 - output*output;
+  }
+
+  void activation(double *values, const int rows, const int cols) {
+    vectorTanh(values, rows*cols);
+  }
+
+  void gradient(const double *input, const double *output, double *delta, const int rows, const int cols) {
+    vectorTanhGradient(output, delta, rows*cols);
+  }
+
+  void activation(float *values, const int rows, const int cols) {
+    vectorTanh(values, rows*cols);
+  }
+
+  void gradient(const float *input, const float *output, float *delta, const int rows, const int cols) {
+    vectorTanhGradient(output, delta, rows*cols);
+  }
+};
+
+class LeakyReLUFunction: public ActivationFunction {
+private:
+  double alpha; // Slope for negative inputs
+
+public:
+  using ActivationFunction::activation;
+  using ActivationFunction::gradient;
+
+  LeakyReLUFunction(const double _alpha = 0.01): alpha(_alpha) {}
+
+  Type type() const {
+    return LEAKY_RELU;
+  }
+
+  double parameter() const {
+    return alpha;
+  }
+
+  double activation(const double input) {
+    return input > 0.0 ? input : alpha*input;
+  }
+
+  double gradient(const double input) {
+    return input > 0.0 ? 1.0 : alpha;
+  }
+
+  void activation(double *values, const int rows, const int cols) {
+    vectorLeakyRelu(values, rows*cols, alpha);
+  }
+
+  void gradient(const double *input, const double *output, double *delta, const int rows, const int cols) {
+    vectorLeakyReluGradient(input, delta, rows*cols, alpha);
+  }
+
+  void activation(float *values, const int rows, const int cols) {
+    vectorLeakyRelu(values, rows*cols, static_cast<float>(alpha));
+  }
+
+  void gradient(const float *input, const float *output, float *delta, const int rows, const int cols) {
+    vectorLeakyReluGradient(input, delta, rows*cols, static_cast<float>(alpha));
+  }
+};
+
+class ReLUFunction: public LeakyReLUFunction {
+public:
+  ReLUFunction(): LeakyReLUFunction(0.0) {}
+};
+
+/*
+ * Softmax normalizes every row (sample) of a block, so it only exists in the array
+ * forms. Its gradient is the product with the Jacobian of each row, s*(d - sum(d*s)).
+ * A single value has no row to normalize over, so the scalar forms are private and
+ * give NaN should they be reached through the base class.
+ */
+class SoftmaxFunction: public ActivationFunction {
+private:
+  double activation(const double input) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+
+  double gradient(const double input) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+
+public:
+  Type type() const {
+    return SOFTMAX;
+  }
+
+  void activation(double *values, const int rows, const int cols) {
+    vectorSoftmax(values, rows, cols);
+  }
+
+  void gradient(const double *input, const double *output, double *delta, const int rows, const int cols) {
+    vectorSoftmaxGradient(output, delta, rows, cols);
+  }
+
+  void activation(float *values, const int rows, const int cols) {
+    vectorSoftmax(values, rows, cols);
+  }
+
+  void gradient(const float *input, const float *output, float *delta, const int rows, const int cols) {
+    vectorSoftmaxGradient(output, delta, rows, cols);
   }
 };
 
 class LinearFunction: public ActivationFunction {
 public:
+  using ActivationFunction::activation;
+  using ActivationFunction::gradient;
+
+  Type type() const {
+    return LINEAR;
+  }
+
   double activation(const double input) {
     return input;
   }
@@ -31,5 +231,26 @@ public:
   double gradient(const double input) {
     return 1.0;
   }
+
+  void activation(double *values, const int rows, const int cols) {}
+
+  void gradient(const double *input, const double *output, double *delta, const int rows, const int cols) {}
+
+  void activation(float *values, const int rows, const int cols) {}
+
+  void gradient(const float *input, const float *output, float *delta, const int rows, const int cols) {}
 };
+
+// Create a built-in activation function from its type and parameter (nullptr for unknown types).
+inline ActivationFunction* createActivation(const int type, const double parameter) {
+  switch (type) {
+    case ActivationFunction::SIGMOID: return new SigmoidFunction();
+    case ActivationFunction::TANH: return new TanhFunction();
+    case ActivationFunction::LEAKY_RELU: return new LeakyReLUFunction(parameter);
+    case ActivationFunction::SOFTMAX: return new SoftmaxFunction();
+    case ActivationFunction::LINEAR: return new LinearFunction();
+    default: return nullptr;
+  }
+}
+
 #endif
@@ -0,0 +1,69 @@
+/*
+ * Checkpoint benchmark: trains the same FEP population on random data without
+ * checkpoints and with a checkpoint after every generation, and reports the time per
+ * generation, so the cost of copying the population for the background writer can be
+ * compared with the time spent evaluating it.
+ *
+ * Usage: ./checkpoint [population] [hidden units]
+ */
+
+#include "../network.h"
+#include "../evolution.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+template <typename Function>
+double milliseconds(const Function &function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  const int populationSize = argc > 1 ? atoi(argv[1]) : 200;
+  const int hidden = argc > 2 ? atoi(argv[2]) : 64;
+  const int numberInput = 32;
+  const int numberOutput = 1;
+  const int samples = 64;
+  const int generations = 20;
+  const std::string path = "checkpoint.ckpt";
+
+  std::default_random_engine generator(1);
+  std::uniform_real_distribution<double> distribution(0.0, 1.0);
+  std::vector<boost::numeric::ublas::vector<double> > input(samples, boost::numeric::ublas::vector<double>(numberInput));
+  std::vector<boost::numeric::ublas::vector<double> > expected(samples, boost::numeric::ublas::vector<double>(numberOutput));
+  for (int i = 0; i < samples; ++i) {
+    for (auto &x : input[i]) {
+      x = distribution(generator);
+    }
+    expected[i][0] = distribution(generator) < 0.5 ? 0.0 : 1.0;
+  }
+
+  std::vector<int> size;
+  size.push_back(hidden);
+
+  NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+  network.initializeRandomWeights();
+
+  // Offspring double the population, so each generation evaluates twice its size
+  const int evaluations = 2 * populationSize * generations;
+  const double populationMiB = 2.0 * populationSize * network.getParameterSize() * sizeof(double) / (1 << 20);
+
+  std::cout << populationSize << " individuals of " << network.getParameterSize() << " weights (" << populationMiB << " MiB with step sizes)" << std::endl;
+  std::cout << std::setw(16) << "checkpoints" << std::setw(16) << "ms/generation" << std::endl;
+
+  for (const int interval : {0, 1}) {
+    EvolutionaryProgramming FEP(&network, -20.0, 20.0, populationSize);
+    FEP.setSeed(1);
+    FEP.setCheckpoint(path, interval);
+    const double time = milliseconds([&] {
+      FEP.train(input, expected, evaluations);
+    });
+    std::cout << std::setw(16) << (interval ? "every generation" : "none") << std::setw(16) << time / generations << std::endl;
+  }
+
+  std::remove(path.c_str());
+}
@@ -0,0 +1,86 @@
+/*
+ * Load generator for the inference server: a number of client threads each send
+ * single-sample requests in a closed loop (waiting for every answer before sending the
+ * next). Reports throughput and the p50/p99 request latency, first with every client
+ * calling feedForwardVector directly and then through the micro-batching server.
+ *
+ * Usage: ./inference_server [clients] [requests per client] [max batch] [max wait us] [workers]
+ */
+
+#include "../network.h"
+#include "../inference.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+template <typename Request>
+void measure(const char *name, const int clients, const int requests, const Request &request) {
+  std::vector<std::vector<double> > latencies(clients, std::vector<double>(requests));
+  std::vector<std::thread> threads;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int c = 0; c < clients; ++c) {
+    threads.push_back(std::thread([&, c] {
+      for (int i = 0; i < requests; ++i) {
+        auto sent = std::chrono::steady_clock::now();
+        request(c * requests + i);
+        latencies[c][i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count();
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::vector<double> all;
+  for (const auto &client : latencies) {
+    all.insert(all.end(), client.begin(), client.end());
+  }
+  std::sort(all.begin(), all.end());
+
+  std::cout << std::setw(10) << name << std::setw(16) << all.size() / seconds
+            << std::setw(12) << all[all.size() / 2] << std::setw(12) << all[all.size() * 99 / 100] << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  const int clients = argc > 1 ? atoi(argv[1]) : 16;
+  const int requests = argc > 2 ? atoi(argv[2]) : 2000;
+  const int maxBatch = argc > 3 ? atoi(argv[3]) : 16;
+  const int maxWait = argc > 4 ? atoi(argv[4]) : 100;
+  const int workers = argc > 5 ? atoi(argv[5]) : 1;
+
+  const int numberInput = 64;
+  const int numberOutput = 10;
+
+  std::vector<int> size;
+  size.push_back(256);
+  size.push_back(256);
+
+  NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+  network.initializeRandomWeights(0.1);
+
+  // A fixed pool of random inputs with a fixed seed
+  std::mt19937 generator(42);
+  std::normal_distribution<double> features(0.0, 1.0);
+  std::vector<boost::numeric::ublas::vector<double> > inputs(256, boost::numeric::ublas::vector<double>(numberInput));
+  for (auto &input : inputs) {
+    for (auto &x : input) x = features(generator);
+  }
+
+  std::cout << "clients=" << clients << " requests=" << requests << " batch=" << maxBatch
+            << " wait=" << maxWait << "us workers=" << workers << std::endl;
+  std::cout << std::setw(10) << "mode" << std::setw(16) << "requests/s" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::endl;
+
+  measure("direct", clients, requests, [&] (const int i) {
+    network.feedForwardVector(inputs[i % inputs.size()]);
+  });
+
+  InferenceServer server(network, maxBatch, maxWait, workers);
+  measure("batched", clients, requests, [&] (const int i) {
+    server.submit(inputs[i % inputs.size()]).get();
+  });
+
+  std::cout << "mean batch size=" << (double)server.getServed() / server.getBatches() << std::endl;
+}
@@ -0,0 +1,80 @@
+/*
+ * Island model benchmark: spends the same total number of fitness evaluations on one
+ * FEP population and on islands of worker processes (one population per island, the
+ * same total size) along each migration topology, and reports the wall time and the
+ * cost reached.
+ *
+ * Usage: ./islands [islands] [population per island] [evaluations per island]
+ */
+
+#include "../network.h"
+#include "../evolution.h"
+#include "../island.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+template <typename Function>
+double milliseconds(const Function &function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  const int islands = argc > 1 ? atoi(argv[1]) : 4;
+  const int populationSize = argc > 2 ? atoi(argv[2]) : 25;
+  const int evaluations = argc > 3 ? atoi(argv[3]) : 20000;
+  const int numberInput = 8;
+  const int numberOutput = 1;
+  const int samples = 128;
+
+  // Label points by the sign of a random linear function of their squares
+  std::default_random_engine generator(1);
+  std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+  std::vector<double> coefficients(numberInput);
+  for (double &c : coefficients) {
+    c = distribution(generator);
+  }
+  std::vector<boost::numeric::ublas::vector<double> > input(samples, boost::numeric::ublas::vector<double>(numberInput));
+  std::vector<boost::numeric::ublas::vector<double> > expected(samples, boost::numeric::ublas::vector<double>(numberOutput));
+  for (int i = 0; i < samples; ++i) {
+    double sum = 0.0;
+    for (int j = 0; j < numberInput; ++j) {
+      input[i](j) = distribution(generator);
+      sum += coefficients[j] * input[i](j) * input[i](j);
+    }
+    expected[i](0) = sum > 0.0 ? 1.0 : 0.0;
+  }
+
+  std::vector<int> size;
+  size.push_back(8);
+  NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+
+  std::cout << "islands=" << islands << " population=" << populationSize << " evaluations=" << evaluations << " per island" << std::endl;
+  std::cout << std::setw(18) << "run" << std::setw(12) << "ms" << std::setw(12) << "cost" << std::endl;
+
+  EvolutionaryProgramming single(&network, -5.0, 5.0, islands * populationSize);
+  single.setSeed(1);
+  const double singleTime = milliseconds([&] { single.train(input, expected, islands * evaluations); });
+  std::cout << std::setw(18) << "one population" << std::setw(12) << singleTime << std::setw(12) << network.cost(input, expected) << std::endl;
+
+  const MigrationTopology topologies[] = {RING, FULLY_CONNECTED, RANDOM};
+  const char *names[] = {"ring", "fully connected", "random"};
+  for (int t = 0; t < 3; ++t) {
+    IslandEvolution model(&network, -5.0, 5.0, populationSize, islands);
+    model.setSeed(1);
+    model.setMigration(topologies[t], 10, 2);
+    const double time = milliseconds([&] { model.train(input, expected, evaluations); });
+    std::cout << std::setw(18) << names[t] << std::setw(12) << time << std::setw(12) << network.cost(input, expected) << std::endl;
+  }
+
+  IslandEvolution isolated(&network, -5.0, 5.0, populationSize, islands);
+  isolated.setSeed(1);
+  isolated.setMigration(RING, 0, 0);
+  const double isolatedTime = milliseconds([&] { isolated.train(input, expected, evaluations); });
+  std::cout << std::setw(18) << "no migration" << std::setw(12) << isolatedTime << std::setw(12) << network.cost(input, expected) << std::endl;
+
+  return 0;
+}
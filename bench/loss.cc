@@ -0,0 +1,66 @@
+/*
+ * Loss benchmark: times the cost of a large random dataset for each loss, scored on one
+ * thread and on a pool of threads, and shows that the cost of a saturated network stays
+ * finite.
+ *
+ * Usage: ./loss [dataset size] [threads]
+ */
+
+#include "../network.h"
+#include "../threadpool.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+template <typename Function>
+double milliseconds(const Function &function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  const int samples = argc > 1 ? atoi(argv[1]) : 200000;
+  const int threads = argc > 2 ? atoi(argv[2]) : std::max<int>(std::thread::hardware_concurrency(), 1);
+  const int numberInput = 32;
+  const int numberOutput = 8;
+
+  std::default_random_engine generator(1);
+  std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+  boost::numeric::ublas::matrix<double> input(samples, numberInput);
+  boost::numeric::ublas::matrix<double> expected(samples, numberOutput, 0.0);
+  for (auto &x : input.data()) x = distribution(generator);
+  for (int i = 0; i < samples; ++i) {
+    expected(i, generator() % numberOutput) = 1.0;
+  }
+  const DatasetView data(input, expected);
+
+  std::vector<int> size;
+  size.push_back(64);
+  ThreadPool pool(threads);
+
+  std::cout << "dataset=" << samples << " threads=" << threads << std::endl;
+  std::cout << std::setw(24) << "loss" << std::setw(12) << "1 thread" << std::setw(12) << "pool" << std::setw(14) << "cost"
+            << std::setw(14) << "saturated" << std::endl;
+
+  const char *names[] = {"sigmoid cross entropy", "softmax cross entropy", "squared error"};
+  for (int l = 0; l < 3; ++l) {
+    NeuralNetwork network(size, numberInput, numberOutput, l == 1 ? static_cast<ActivationFunction*>(new SoftmaxFunction()) : new SigmoidFunction());
+    network.setLoss(l == 2 ? MEAN_SQUARED_ERROR : CROSS_ENTROPY);
+    network.initializeRandomWeights(0.05);
+
+    double cost = 0.0;
+    const double serial = milliseconds([&] { cost = network.cost(data); });
+    const double parallel = milliseconds([&] { network.cost(data, &pool); });
+
+    // Weights large enough to saturate every output
+    for (auto &w : network.getParameters()) {
+      w *= 2000.0;
+    }
+    std::cout << std::setw(24) << names[l] << std::setw(12) << serial << std::setw(12) << parallel << std::setw(14) << cost
+              << std::setw(14) << network.cost(data) << std::endl;
+  }
+
+  return 0;
+}
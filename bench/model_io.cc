@@ -0,0 +1,96 @@
+/*
+ * Model serialization benchmark: saves and reloads the same network as ublas text
+ * (the stream IO from io.hpp) and as a binary model file, then measures how long a
+ * serving process takes to start from the binary file, by copying it into a network or
+ * by memory-mapping it with and without checksum verification, up to its first output.
+ *
+ * Usage: ./model_io [hidden units]
+ */
+
+#include "../network.h"
+#include "../model.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+template <typename Function>
+double milliseconds(const Function &function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const char *name, const double time) {
+  std::cout << std::setw(28) << name << std::setw(12) << time << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  const int hidden = argc > 1 ? atoi(argv[1]) : 2048;
+  const int numberInput = 1024;
+  const int numberOutput = 10;
+  const std::string textPath = "model_io.txt";
+  const std::string modelPath = "model_io.bin";
+
+  std::vector<int> size;
+  size.push_back(hidden);
+  size.push_back(hidden);
+
+  NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+  network.initializeRandomWeights();
+
+  boost::numeric::ublas::vector<double> input(numberInput, 0.5);
+
+  std::cout << network.getParameterSize() << " parameters (" << network.getParameterSize() * sizeof(double) / (1 << 20) << " MiB)" << std::endl;
+  std::cout << std::setw(28) << "operation" << std::setw(12) << "ms" << std::endl;
+
+  // Round trips
+  report("text save", milliseconds([&] {
+    std::ofstream text(textPath.c_str());
+    text << std::setprecision(17);
+    for (const auto &w : network.getWeights()) {
+      text << w << "\n";
+    }
+  }));
+
+  report("text load", milliseconds([&] {
+    std::ifstream text(textPath.c_str());
+    std::vector<boost::numeric::ublas::matrix<double> > weights(network.getLayerCount());
+    for (auto &w : weights) {
+      text >> w;
+    }
+    NeuralNetwork copy(size, numberInput, numberOutput, new SigmoidFunction());
+    copy.setWeights(weights);
+  }));
+
+  report("binary save", milliseconds([&] {
+    saveModel(network, modelPath);
+  }));
+
+  // Startup: load the model and produce the first output
+  report("binary load + first output", milliseconds([&] {
+    auto loaded = loadModel<double>(modelPath);
+    loaded->feedForwardVector(input);
+  }));
+
+  report("mmap verified + first", milliseconds([&] {
+    MappedModel mapped;
+    mapped.open(modelPath);
+    mapped.feedForwardVector(input);
+  }));
+
+  report("mmap unverified + first", milliseconds([&] {
+    MappedModel mapped;
+    mapped.open(modelPath, false);
+    mapped.feedForwardVector(input);
+  }));
+
+  report("mmap unverified open", milliseconds([&] {
+    MappedModel mapped;
+    mapped.open(modelPath, false);
+  }));
+
+  std::remove(textPath.c_str());
+  std::remove(modelPath.c_str());
+}
@@ -0,0 +1,109 @@
+/*
+ * Optimizer benchmark: trains the same network on a random classification task with
+ * each update rule and reports the itterations and time taken to reach a target cost,
+ * then times the fused update loop on its own as memory bandwidth over the weights,
+ * gradient and optimizer state.
+ *
+ * Usage: ./optimizers [hidden units] [target cost]
+ */
+
+#include "../network.h"
+#include "../gradient.h"
+#include "../optimizer.h"
+#include "../kernels.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+template <typename Function>
+double milliseconds(const Function &function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Rule {
+  const char *name;
+  OptimizerSettings settings;
+  double rate;
+};
+
+int main(int argc, char *argv[]) {
+  const int hidden = argc > 1 ? atoi(argv[1]) : 32;
+  const double target = argc > 2 ? atof(argv[2]) : 0.05;
+  const int numberInput = 8;
+  const int numberOutput = 1;
+  const int samples = 512;
+  const int maxItterations = 20000;
+
+  // Label points by which side of a random sphere they fall on
+  std::default_random_engine generator(1);
+  std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+  std::vector<boost::numeric::ublas::vector<double> > input(samples, boost::numeric::ublas::vector<double>(numberInput));
+  std::vector<boost::numeric::ublas::vector<double> > expected(samples, boost::numeric::ublas::vector<double>(numberOutput));
+  for (int i = 0; i < samples; ++i) {
+    double radius = 0.0;
+    for (auto &x : input[i]) {
+      x = distribution(generator);
+      radius += x * x;
+    }
+    expected[i](0) = radius < numberInput / 3.0 ? 1.0 : 0.0;
+  }
+
+  std::vector<int> size;
+  size.push_back(hidden);
+  NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+  network.initializeRandomWeights();
+  const AlignedVector<double> initial(network.getParameters().begin(), network.getParameters().end());
+
+  const Rule rules[] = {{"sgd", OptimizerSettings::sgd(0.0), 0.5},
+                        {"momentum", OptimizerSettings::sgd(0.9), 0.05},
+                        {"nesterov", OptimizerSettings::nesterov(0.9), 0.05},
+                        {"adagrad", OptimizerSettings::adagrad(), 0.2},
+                        {"rmsprop", OptimizerSettings::rmsprop(0.9), 0.005},
+                        {"adam", OptimizerSettings::adam(), 0.02}};
+
+  std::cout << "instruction set=" << kernelInstructionSet() << " hidden=" << hidden << " target=" << target << std::endl;
+  std::cout << std::setw(10) << "rule" << std::setw(14) << "itterations" << std::setw(12) << "ms" << std::setw(12) << "cost" << std::endl;
+
+  for (const Rule &rule : rules) {
+    network.setParameters(initial);
+    StochasticGradientDescent sgd(&network, rule.rate, maxItterations);
+    sgd.setOptimizer(rule.settings);
+    sgd.setSeed(3);
+    sgd.setCheckInterval(10);
+
+    int itterations = 0;
+    sgd.setProgress([&itterations](const SGDProgress &progress) { itterations = progress.itteration; });
+    const double time = milliseconds([&] { sgd.train(input, expected, target, 32); });
+
+    std::cout << std::setw(10) << rule.name << std::setw(14) << itterations << std::setw(12) << time
+              << std::setw(12) << network.cost(input, expected) << std::endl;
+  }
+
+  // Bandwidth of the update alone over a parameter vector well outside the caches
+  const int n = 1 << 22;
+  const int repeats = 20;
+  AlignedVector<float> weights(n, 0.5f);
+  std::vector<float> gradient(n, 0.01f);
+
+  std::cout << std::endl << std::setw(10) << "rule" << std::setw(14) << "GB/s" << std::endl;
+  for (const Rule &rule : rules) {
+    std::unique_ptr<BasicOptimizer<float> > optimizer = createOptimizer<float>(rule.settings);
+    optimizer->update(weights.data(), gradient.data(), n, 1e-6, 1.0);
+
+    const double time = milliseconds([&] {
+      for (int k = 0; k < repeats; ++k) {
+        optimizer->update(weights.data(), gradient.data(), n, 1e-6, 1.0);
+      }
+    });
+
+    // Read the weights and gradient and write the weights, plus read and write each state array
+    const int states = rule.settings.type == ADAM ? 2 : rule.settings.type == MOMENTUM && rule.settings.momentum == 0.0 ? 0 : 1;
+    const double bytes = static_cast<double>(n) * sizeof(float) * (3 + 2 * states) * repeats;
+    std::cout << std::setw(10) << rule.name << std::setw(14) << bytes / (time * 1e6) << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * Precision benchmark: trains the same network on the same synthetic dataset in double,
+ * single and mixed precision (single precision network with double master weights) and
+ * reports throughput and the final cost of each, so the speed gained by single precision
+ * can be weighed against any loss in accuracy.
+ *
+ * Usage: ./precision [batch size] [itterations] [threads]
+ */
+
+#include "../network.h"
+#include "../gradient.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+template <typename Scalar>
+void run(const char *name, const std::vector<int> &size, const std::vector<boost::numeric::ublas::matrix<double> > &initialWeights,
+         const DatasetView &data, const int batchSize, const int itterations, const int threads, const bool mixed) {
+  BasicNeuralNetwork<Scalar> network(size, data.getInputSize(), data.getOutputSize(), new SigmoidFunction());
+  network.setWeights(initialWeights);
+
+  BasicStochasticGradientDescent<Scalar> SGD(&network, 0.01, itterations);
+  SGD.setSeed(1);
+  SGD.setThreads(threads, true);
+  SGD.setLossSmoothing(0.05);
+  SGD.setMixedPrecision(mixed);
+
+  auto start = std::chrono::steady_clock::now();
+  SGD.train(data, 0.0, batchSize);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << std::setw(10) << name << std::setw(14) << seconds
+            << std::setw(16) << (double)batchSize * itterations / seconds
+            << std::setw(14) << network.cost(data) << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  const int batchSize = argc > 1 ? atoi(argv[1]) : 1024;
+  const int itterations = argc > 2 ? atoi(argv[2]) : 50;
+  const int threads = argc > 3 ? atoi(argv[3]) : 1;
+
+  const int numberInput = 64;
+  const int numberOutput = 10;
+  const int samples = 8192;
+
+  std::vector<int> size;
+  size.push_back(256);
+  size.push_back(256);
+
+  // Synthetic dataset with a fixed seed so every run sees the same data
+  std::mt19937 generator(42);
+  std::normal_distribution<double> features(0.0, 1.0);
+  std::bernoulli_distribution labels(0.5);
+
+  boost::numeric::ublas::matrix<double> input(samples, numberInput);
+  boost::numeric::ublas::matrix<double> expected(samples, numberOutput);
+  for (auto &x : input.data()) x = features(generator);
+  for (auto &y : expected.data()) y = labels(generator) ? 1.0 : 0.0;
+  const DatasetView data(input, expected);
+
+  NeuralNetwork reference(size, numberInput, numberOutput, new SigmoidFunction());
+  reference.initializeRandomWeights();
+  const auto initialWeights = reference.getWeights();
+
+  std::cout << "samples=" << samples << " batch=" << batchSize << " itterations=" << itterations << " threads=" << threads << std::endl;
+  std::cout << std::setw(10) << "precision" << std::setw(14) << "seconds" << std::setw(16) << "samples/s" << std::setw(14) << "final cost" << std::endl;
+
+  run<double>("double", size, initialWeights, data, batchSize, itterations, threads, false);
+  run<float>("float", size, initialWeights, data, batchSize, itterations, threads, false);
+  run<float>("mixed", size, initialWeights, data, batchSize, itterations, threads, true);
+}
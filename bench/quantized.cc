@@ -0,0 +1,62 @@
+/*
+ * Inference benchmark for int8 quantization: runs the forward pass of the same network
+ * in double precision and quantized to int8, and reports throughput, weight memory and
+ * the difference between the outputs.
+ *
+ * Usage: ./quantized [batch size] [batches]
+ */
+
+#include "../network.h"
+#include "../quantized.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+template <typename Network>
+double samplesPerSecond(const Network &network, const boost::numeric::ublas::matrix<double> &batch, const int batches) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < batches; ++i) {
+    network.feedForwardBatch(batch);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return (double)batch.size1() * batches / seconds;
+}
+
+int main(int argc, char *argv[]) {
+  const int batchSize = argc > 1 ? atoi(argv[1]) : 256;
+  const int batches = argc > 2 ? atoi(argv[2]) : 100;
+
+  const int numberInput = 784;
+  const int numberOutput = 10;
+  const int samples = 4096;
+
+  std::vector<int> size;
+  size.push_back(256);
+  size.push_back(256);
+
+  // Synthetic dataset with a fixed seed so every run sees the same data
+  std::mt19937 generator(42);
+  std::normal_distribution<double> features(0.0, 1.0);
+
+  boost::numeric::ublas::matrix<double> input(samples, numberInput);
+  boost::numeric::ublas::matrix<double> expected(samples, numberOutput, 0.0);
+  for (auto &x : input.data()) x = features(generator);
+  const DatasetView data(input, expected);
+
+  NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+  network.initializeRandomWeights(0.05);
+
+  QuantizedNetwork quantized(network, data);
+  const QuantizationError error = quantized.compare(network, data);
+
+  boost::numeric::ublas::matrix<double> batch(batchSize, numberInput);
+  std::copy(input.data().begin(), input.data().begin() + batchSize * numberInput, batch.data().begin());
+
+  std::cout << "batch=" << batchSize << " batches=" << batches << " kernels=" << kernelInstructionSet() << std::endl;
+  std::cout << std::setw(10) << "network" << std::setw(16) << "samples/s" << std::setw(16) << "weight bytes" << std::endl;
+  std::cout << std::setw(10) << "double" << std::setw(16) << samplesPerSecond(network, batch, batches)
+            << std::setw(16) << network.getParameterSize() * sizeof(double) << std::endl;
+  std::cout << std::setw(10) << "int8" << std::setw(16) << samplesPerSecond(quantized, batch, batches)
+            << std::setw(16) << quantized.getWeightBytes() << std::endl;
+  std::cout << "max |error|=" << error.maxAbsolute << " mean |error|=" << error.meanAbsolute << std::endl;
+}
@@ -0,0 +1,69 @@
+/*
+ * Racing benchmark: trains the same FEP population on a large random dataset with every
+ * candidate scored on the whole dataset and with racing, for the same number of fitness
+ * evaluations (candidates scored), and reports the wall time, the final cost and the
+ * share of the sample evaluations of those candidates racing skipped.
+ *
+ * Usage: ./racing [dataset size] [fitness evaluations] [first share of the race]
+ */
+
+#include "../network.h"
+#include "../evolution.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+template <typename Function>
+double milliseconds(const Function &function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  const int samples = argc > 1 ? atoi(argv[1]) : 32768;
+  const int evaluations = argc > 2 ? atoi(argv[2]) : 2000;
+  const double fraction = argc > 3 ? atof(argv[3]) : 1.0/16;
+  const int numberInput = 16;
+  const int numberOutput = 1;
+
+  // Label points by the sign of a random linear function
+  std::default_random_engine generator(1);
+  std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+  std::vector<double> coefficients(numberInput);
+  for (double &c : coefficients) {
+    c = distribution(generator);
+  }
+  std::vector<boost::numeric::ublas::vector<double> > input(samples, boost::numeric::ublas::vector<double>(numberInput));
+  std::vector<boost::numeric::ublas::vector<double> > expected(samples, boost::numeric::ublas::vector<double>(numberOutput));
+  for (int i = 0; i < samples; ++i) {
+    double sum = 0.0;
+    for (int j = 0; j < numberInput; ++j) {
+      input[i](j) = distribution(generator);
+      sum += coefficients[j] * input[i](j);
+    }
+    expected[i](0) = sum > 0.0 ? 1.0 : 0.0;
+  }
+
+  std::vector<int> size;
+  size.push_back(16);
+  NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+
+  std::cout << "dataset=" << samples << " evaluations=" << evaluations << " first share=" << fraction << std::endl;
+  std::cout << std::setw(10) << "scoring" << std::setw(12) << "ms" << std::setw(12) << "cost" << std::setw(12) << "skipped" << std::endl;
+
+  for (int raced = 0; raced < 2; ++raced) {
+    EvolutionaryProgramming FEP(&network, -5.0, 5.0, 50);
+    FEP.setSeed(1);
+    FEP.setRacing(raced, fraction);
+    const double time = milliseconds([&] { FEP.train(input, expected, evaluations); });
+
+    // Share of the sample evaluations of scoring every evaluated candidate on the whole dataset
+    const double skipped = static_cast<double>(FEP.getSamplesSaved()) / (static_cast<double>(evaluations) * samples);
+    std::cout << std::setw(10) << (raced ? "racing" : "full") << std::setw(12) << time << std::setw(12) << network.cost(input, expected)
+              << std::setw(12) << skipped << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Mini-batch sampling benchmark: compares drawing batches by rejection sampling into
+ * a hash set (the approach SGD used before, which slows down as the batch approaches the
+ * dataset size) with the epoch permutation of BatchSampler, then times SGD on the same
+ * data with and without prefetching the next batch.
+ *
+ * Usage: ./sampler [dataset size]
+ */
+
+#include "../network.h"
+#include "../gradient.h"
+#include "../sampler.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <unordered_set>
+
+template <typename Function>
+double milliseconds(const Function &function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  const int samples = argc > 1 ? atoi(argv[1]) : 16384;
+  const int draws = 1 << 22; // Rows drawn per measurement
+
+  std::cout << "dataset=" << samples << std::endl;
+  std::cout << std::setw(8) << "batch" << std::setw(16) << "rejection ns" << std::setw(16) << "epoch ns" << std::endl;
+
+  std::default_random_engine generator(1);
+  std::vector<int> rows;
+
+  for (int batch = 16; batch <= samples; batch *= 4) {
+    const int batches = std::max(draws / batch, 1);
+
+    const double rejection = milliseconds([&] {
+      std::uniform_int_distribution<int> distribution(0, samples - 1);
+      std::unordered_set<int> chosen;
+      for (int k = 0; k < batches; ++k) {
+        chosen.clear();
+        while (chosen.size() != batch) {
+          chosen.insert(distribution(generator));
+        }
+        rows.assign(chosen.begin(), chosen.end());
+      }
+    });
+
+    BatchSampler sampler;
+    sampler.reset(samples);
+    const double epoch = milliseconds([&] {
+      for (int k = 0; k < batches; ++k) {
+        sampler.next(generator, batch, rows);
+      }
+    });
+
+    std::cout << std::setw(8) << batch << std::setw(16) << 1e6 * rejection / (batches * batch)
+              << std::setw(16) << 1e6 * epoch / (batches * batch) << std::endl;
+  }
+
+  // SGD with and without the prefetcher on a wide input, where gathering is significant
+  const int numberInput = 512;
+  const int numberOutput = 10;
+  std::mt19937 dataGenerator(42);
+  std::normal_distribution<double> features(0.0, 1.0);
+  std::bernoulli_distribution labels(0.5);
+
+  std::vector<boost::numeric::ublas::vector<double> > input(samples, boost::numeric::ublas::vector<double>(numberInput));
+  std::vector<boost::numeric::ublas::vector<double> > expected(samples, boost::numeric::ublas::vector<double>(numberOutput));
+  for (int i = 0; i < samples; ++i) {
+    for (auto &x : input[i]) x = features(dataGenerator);
+    for (auto &y : expected[i]) y = labels(dataGenerator) ? 1.0 : 0.0;
+  }
+
+  std::vector<int> size;
+  size.push_back(64);
+
+  std::cout << std::setw(10) << "prefetch" << std::setw(16) << "ms/step" << std::endl;
+  for (const bool prefetch : {false, true}) {
+    NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+    network.initializeRandomWeights();
+
+    StochasticGradientDescent SGD(&network, 0.01, 200);
+    SGD.setSeed(1);
+    SGD.setLossSmoothing(0.05);
+    SGD.setPrefetch(prefetch);
+    const double time = milliseconds([&] {
+      SGD.train(input, expected, 0.0, 256);
+    });
+    std::cout << std::setw(10) << (prefetch ? "on" : "off") << std::setw(16) << time / 200 << std::endl;
+  }
+}
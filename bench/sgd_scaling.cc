@@ -0,0 +1,75 @@
+/*
+ * Scaling benchmark for data-parallel SGD: trains the same network on the same
+ * synthetic dataset with 1 to N threads and reports throughput and speedup.
+ * Convergence is tracked with the moving average of mini-batch costs, so the timings
+ * measure the training steps rather than full-dataset cost evaluations.
+ *
+ * Usage: ./sgd_scaling [max threads] [batch size] [itterations]
+ */
+
+#include "../network.h"
+#include "../gradient.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+int main(int argc, char *argv[]) {
+  const int maxThreads = argc > 1 ? atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+  const int batchSize = argc > 2 ? atoi(argv[2]) : 1024;
+  const int itterations = argc > 3 ? atoi(argv[3]) : 20;
+
+  const int numberInput = 64;
+  const int numberOutput = 10;
+  const int samples = 8192;
+
+  std::vector<int> size;
+  size.push_back(256);
+  size.push_back(256);
+
+  // Synthetic dataset with a fixed seed so every run sees the same data
+  std::mt19937 generator(42);
+  std::normal_distribution<double> features(0.0, 1.0);
+  std::bernoulli_distribution labels(0.5);
+
+  std::vector<boost::numeric::ublas::vector<double> > input(samples, boost::numeric::ublas::vector<double>(numberInput));
+  std::vector<boost::numeric::ublas::vector<double> > expected(samples, boost::numeric::ublas::vector<double>(numberOutput));
+  for (int i = 0; i < samples; ++i) {
+    for (auto &x : input[i]) x = features(generator);
+    for (auto &y : expected[i]) y = labels(generator) ? 1.0 : 0.0;
+  }
+
+  NeuralNetwork reference(size, numberInput, numberOutput, new SigmoidFunction());
+  reference.initializeRandomWeights();
+  const auto initialWeights = reference.getWeights();
+
+  std::cout << "samples=" << samples << " batch=" << batchSize << " itterations=" << itterations << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(14) << "seconds" << std::setw(16) << "samples/s" << std::setw(10) << "speedup" << std::endl;
+
+  double baseline = 0.0;
+
+  for (int threads = 1; threads <= maxThreads; threads *= 2) {
+    NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+    network.setWeights(initialWeights);
+
+    StochasticGradientDescent SGD(&network, 0.1, itterations);
+    SGD.setSeed(1);
+    SGD.setThreads(threads, true);
+    SGD.setLossSmoothing(0.05);
+
+    auto start = std::chrono::steady_clock::now();
+    SGD.train(input, expected, 0.0, batchSize);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (threads == 1) {
+      baseline = seconds;
+    }
+
+    std::cout << std::setw(8) << threads << std::setw(14) << seconds
+              << std::setw(16) << (double)batchSize * itterations / seconds
+              << std::setw(10) << baseline / seconds << std::endl;
+
+    if (threads < maxThreads && threads * 2 > maxThreads) {
+      threads = maxThreads / 2;
+    }
+  }
+}
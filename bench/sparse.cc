@@ -0,0 +1,62 @@
+/*
+ * Sparse inference benchmark: prunes the same network to increasing sparsity and runs
+ * its forward pass dense, with every layer in CSR form, and with each layer stored as
+ * the crossover density chooses, reporting throughput and weight memory. The densest
+ * sparsity at which CSR beats dense is where the crossover belongs.
+ *
+ * Usage: ./sparse [batch size] [batches]
+ */
+
+#include "../network.h"
+#include "../sparse.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+template <typename Network>
+double samplesPerSecond(const Network &network, const boost::numeric::ublas::matrix<double> &batch, const int batches) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < batches; ++i) {
+    network.feedForwardBatch(batch);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return (double)batch.size1() * batches / seconds;
+}
+
+int main(int argc, char *argv[]) {
+  const int batchSize = argc > 1 ? atoi(argv[1]) : 256;
+  const int batches = argc > 2 ? atoi(argv[2]) : 50;
+
+  const int numberInput = 784;
+  const int numberOutput = 10;
+
+  std::vector<int> size;
+  size.push_back(512);
+  size.push_back(512);
+
+  // Synthetic inputs with a fixed seed so every run sees the same data
+  std::mt19937 generator(42);
+  std::normal_distribution<double> features(0.0, 1.0);
+  boost::numeric::ublas::matrix<double> batch(batchSize, numberInput);
+  for (auto &x : batch.data()) x = features(generator);
+
+  NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+  network.initializeRandomWeights(0.05);
+  const ParameterVector weights(network.getParameters().begin(), network.getParameters().end());
+
+  std::cout << "batch=" << batchSize << " batches=" << batches << std::endl;
+  std::cout << std::setw(10) << "sparsity" << std::setw(14) << "dense/s" << std::setw(14) << "csr/s" << std::setw(14) << "auto/s"
+            << std::setw(14) << "dense bytes" << std::setw(14) << "csr bytes" << std::endl;
+
+  const double sparsities[] = {0.0, 0.5, 0.6, 0.7, 0.8, 0.9, 0.95};
+  for (const double sparsity : sparsities) {
+    network.setParameters(ConstParameterSpan(weights));
+    magnitudePrune(network, sparsity);
+
+    SparseNetwork csr(network, 1.0);
+    SparseNetwork automatic(network);
+    std::cout << std::setw(10) << sparsity << std::setw(14) << samplesPerSecond(network, batch, batches)
+              << std::setw(14) << samplesPerSecond(csr, batch, batches) << std::setw(14) << samplesPerSecond(automatic, batch, batches)
+              << std::setw(14) << network.getParameterSize() * sizeof(double) << std::setw(14) << csr.getWeightBytes() << std::endl;
+  }
+}
@@ -0,0 +1,251 @@
+/*
+ * Benchmark suite for the training and inference hot paths: feedForwardVector,
+ * backPropogateVector, cost, SGD steps and FEP generations, over a grid of layer widths,
+ * depths and batch sizes. Each benchmark is repeated until it has run for a minimum time
+ * and reports ns per sample, GFLOP/s and heap allocations per call. The results are
+ * printed as a table and optionally written as JSON, so runs of different versions can be
+ * compared to catch performance regressions.
+ *
+ * FLOPs are counted as 2 per weight and sample for a forward pass and 6 for back
+ * propogation (forward pass, deltas and gradient). An SGD step is a back propogation of
+ * the mini-batch plus the momentum update, and an FEP generation evaluates twice the
+ * population (parents and offspring) on the batch.
+ *
+ * Usage: ./suite [JSON output file] [minimum seconds per benchmark]
+ */
+
+#include "../network.h"
+#include "../gradient.h"
+#include "../evolution.h"
+#include "../kernels.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+
+// Count heap allocations so each benchmark can report them per call: operator new and
+// new[], and posix_memalign, which the aligned buffers (arenas, gradients, populations)
+// are allocated with.
+std::atomic<long> allocations(0);
+
+void* operator new(std::size_t size) {
+  allocations++;
+  void *memory = std::malloc(size ? size : 1);
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+extern "C" int posix_memalign(void **memory, std::size_t alignment, std::size_t size) noexcept {
+  allocations++;
+  *memory = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+  return *memory ? 0 : ENOMEM;
+}
+
+struct Result {
+  std::string name;
+  int width;
+  int depth;
+  int batch;
+  int parameters;
+  long calls;
+  double nsPerCall;
+  double nsPerSample;
+  double gflops;
+  double allocationsPerCall;
+};
+
+// Run function (once to warm up, then in growing rounds) until it has run for minSeconds.
+// samples and flops are per call.
+template <typename Function>
+Result measure(const std::string &name, const int width, const int depth, const int batch, const int parameters,
+               const double samples, const double flops, const double minSeconds, const Function &function) {
+  function();
+
+  long calls = 0;
+  long allocated = 0;
+  double seconds = 0.0;
+  for (long round = 1; seconds < minSeconds; round *= 2) {
+    const long before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < round; ++i) {
+      function();
+    }
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    allocated += allocations - before;
+    calls += round;
+  }
+
+  Result result;
+  result.name = name;
+  result.width = width;
+  result.depth = depth;
+  result.batch = batch;
+  result.parameters = parameters;
+  result.calls = calls;
+  result.nsPerCall = 1e9 * seconds / calls;
+  result.nsPerSample = result.nsPerCall / samples;
+  result.gflops = flops / result.nsPerCall;
+  result.allocationsPerCall = static_cast<double>(allocated) / calls;
+  return result;
+}
+
+void report(const Result &result) {
+  std::cout << std::setw(20) << result.name << std::setw(7) << result.width << std::setw(7) << result.depth << std::setw(7) << result.batch
+            << std::setw(14) << result.nsPerSample << std::setw(10) << result.gflops << std::setw(10) << result.allocationsPerCall << std::endl;
+}
+
+void writeJson(const std::string &path, const std::vector<Result> &results, const double minSeconds) {
+  std::ofstream out(path.c_str());
+  out << std::setprecision(6);
+  out << "{\n";
+  out << "  \"suite\": \"ML hot paths\",\n";
+  out << "  \"timestamp\": " << std::time(nullptr) << ",\n";
+  out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+  out << "  \"kernels\": \"" << kernelInstructionSet() << "\",\n";
+  out << "  \"min_seconds\": " << minSeconds << ",\n";
+  out << "  \"benchmarks\": [\n";
+  for (int i = 0; i < results.size(); ++i) {
+    const Result &r = results[i];
+    out << "    {\"name\": \"" << r.name << "\", \"width\": " << r.width << ", \"depth\": " << r.depth << ", \"batch\": " << r.batch
+        << ", \"parameters\": " << r.parameters << ", \"calls\": " << r.calls << ", \"ns_per_call\": " << r.nsPerCall
+        << ", \"ns_per_sample\": " << r.nsPerSample << ", \"gflops\": " << r.gflops
+        << ", \"allocations_per_call\": " << r.allocationsPerCall << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n";
+  out << "}\n";
+}
+
+int main(int argc, char *argv[]) {
+  const std::string jsonPath = argc > 1 ? argv[1] : "";
+  const double minSeconds = argc > 2 ? atof(argv[2]) : 0.2;
+
+  const int numberInput = 64;
+  const int numberOutput = 10;
+  const int widths[] = {32, 128, 512};
+  const int depths[] = {1, 2, 3};
+  const int batches[] = {1, 16, 128};
+  const int sgdSteps = 16;
+  const int populationSize = 10;
+  const int generations = 2;
+
+  // Synthetic dataset with a fixed seed so every run sees the same data
+  const int samples = 1024;
+  std::mt19937 generator(42);
+  std::normal_distribution<double> features(0.0, 1.0);
+  std::bernoulli_distribution labels(0.5);
+
+  std::vector<boost::numeric::ublas::vector<double> > input(samples, boost::numeric::ublas::vector<double>(numberInput));
+  std::vector<boost::numeric::ublas::vector<double> > expected(samples, boost::numeric::ublas::vector<double>(numberOutput));
+  for (int i = 0; i < samples; ++i) {
+    for (auto &x : input[i]) x = features(generator);
+    for (auto &y : expected[i]) y = labels(generator) ? 1.0 : 0.0;
+  }
+
+  std::vector<Result> results;
+
+  std::cout << "kernels=" << kernelInstructionSet() << " min seconds=" << minSeconds << std::endl;
+  std::cout << std::setw(20) << "benchmark" << std::setw(7) << "width" << std::setw(7) << "depth" << std::setw(7) << "batch"
+            << std::setw(14) << "ns/sample" << std::setw(10) << "GFLOP/s" << std::setw(10) << "allocs" << std::endl;
+
+  for (const int width : widths) {
+    for (const int depth : depths) {
+      std::vector<int> size(depth, width);
+      NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+      network.initializeRandomWeights();
+      const int P = network.getParameterSize();
+      const auto initialWeights = network.getWeights();
+
+      // Single sample paths do not depend on the batch size
+      results.push_back(measure("feedForwardVector", width, depth, 1, P, 1, 2.0 * P, minSeconds, [&] {
+        network.feedForwardVector(input[0]);
+      }));
+      report(results.back());
+
+      ParameterVector gradient(P);
+      TrainingWorkspace workspace;
+      results.push_back(measure("backPropogateVector", width, depth, 1, P, 1, 6.0 * P, minSeconds, [&] {
+        network.backPropogateVector(input[0], expected[0], gradient, workspace);
+      }));
+      report(results.back());
+
+      for (const int batch : batches) {
+        const DatasetView data(input, expected);
+        const std::vector<boost::numeric::ublas::vector<double> > batchInput(input.begin(), input.begin() + batch);
+        const std::vector<boost::numeric::ublas::vector<double> > batchExpected(expected.begin(), expected.begin() + batch);
+        const DatasetView subset(batchInput, batchExpected);
+
+        results.push_back(measure("cost", width, depth, batch, P, batch, 2.0 * P * batch, minSeconds, [&] {
+          network.cost(subset);
+        }));
+        report(results.back());
+
+        // Train for a few steps per call so the initial cost check is amortized
+        network.setWeights(initialWeights);
+        StochasticGradientDescent SGD(&network, 0.01, sgdSteps);
+        SGD.setSeed(1);
+        SGD.setLossSmoothing(0.05);
+        SGD.setCheckSubsample(batch);
+        results.push_back(measure("sgdStep", width, depth, batch, P, batch, (6.0 * P * batch + 4.0 * P), minSeconds, [&] {
+          SGD.train(data, 0.0, batch);
+        }));
+        results.back().calls *= sgdSteps;
+        results.back().nsPerCall /= sgdSteps;
+        results.back().nsPerSample /= sgdSteps;
+        results.back().gflops *= sgdSteps;
+        results.back().allocationsPerCall /= sgdSteps;
+        report(results.back());
+
+        // Each call starts a new population and evolves it for a few generations
+        network.setWeights(initialWeights);
+        EvolutionaryProgramming FEP(&network, -1.0, 1.0, populationSize);
+        FEP.setSeed(1);
+        int maxFitnessEval = 0;
+        const int evaluations = 2 * populationSize * generations;
+        results.push_back(measure("fepGeneration", width, depth, batch, P, 2.0 * populationSize * batch,
+                                  2.0 * P * batch * 2 * populationSize, minSeconds, [&] {
+          maxFitnessEval += evaluations;
+          FEP.train(subset, maxFitnessEval);
+        }));
+        results.back().calls *= generations;
+        results.back().nsPerCall /= generations;
+        results.back().nsPerSample /= generations;
+        results.back().gflops *= generations;
+        results.back().allocationsPerCall /= generations;
+        report(results.back());
+      }
+    }
+  }
+
+  if (!jsonPath.empty()) {
+    writeJson(jsonPath, results, minSeconds);
+    std::cout << "Wrote " << results.size() << " results to " << jsonPath << std::endl;
+  }
+}
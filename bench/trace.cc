@@ -0,0 +1,86 @@
+/*
+ * Telemetry example: trains a network with SGD and then with FEP in a build with
+ * ML_TELEMETRY defined, prints the time spent in each traced phase and writes the trace
+ * as Chrome trace JSON (open it in chrome://tracing or Perfetto) and as CSV.
+ *
+ * Usage: ./trace [SGD itterations] [FEP fitness evaluations]
+ */
+
+#include "../network.h"
+#include "../gradient.h"
+#include "../evolution.h"
+#include "../telemetry.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+void summarize(const char *title) {
+  // Total and count of every span name, then start afresh for the next run
+  std::map<std::string, std::pair<double, long> > totals;
+  for (const TraceEvent &e : TraceBuffer::global().events()) {
+    if (e.kind == TraceEvent::SPAN) {
+      totals[e.name].first += e.duration / 1e6;
+      totals[e.name].second++;
+    }
+  }
+
+  std::cout << title << std::endl;
+  std::cout << std::setw(12) << "phase" << std::setw(12) << "ms" << std::setw(10) << "calls" << std::endl;
+  for (const auto &total : totals) {
+    std::cout << std::setw(12) << total.first << std::setw(12) << total.second.first << std::setw(10) << total.second.second << std::endl;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const int itterations = argc > 1 ? atoi(argv[1]) : 2000;
+  const int evaluations = argc > 2 ? atoi(argv[2]) : 5000;
+
+  if (!telemetryEnabled) {
+    std::cout << "Built without ML_TELEMETRY: no trace is recorded" << std::endl;
+  }
+
+  const int numberInput = 64;
+  const int numberOutput = 10;
+  const int samples = 2048;
+
+  std::mt19937 generator(42);
+  std::normal_distribution<double> features(0.0, 1.0);
+  std::bernoulli_distribution labels(0.5);
+
+  std::vector<boost::numeric::ublas::vector<double> > input(samples, boost::numeric::ublas::vector<double>(numberInput));
+  std::vector<boost::numeric::ublas::vector<double> > expected(samples, boost::numeric::ublas::vector<double>(numberOutput));
+  for (int i = 0; i < samples; ++i) {
+    for (auto &x : input[i]) x = features(generator);
+    for (auto &y : expected[i]) y = labels(generator) ? 1.0 : 0.0;
+  }
+
+  std::vector<int> size;
+  size.push_back(128);
+
+  NeuralNetwork network(size, numberInput, numberOutput, new SigmoidFunction());
+  network.initializeRandomWeights();
+
+  StochasticGradientDescent SGD(&network, 0.01, itterations);
+  SGD.setSeed(1);
+  SGD.setCheckInterval(100);
+  SGD.setCheckSubsample(256);
+  SGD.train(input, expected, 0.0, 32);
+
+  TraceBuffer::global().writeChromeTrace("trace_sgd.json");
+  TraceBuffer::global().writeCsv("trace_sgd.csv");
+  summarize("SGD");
+  TraceBuffer::global().clear();
+
+  // The fitness is evaluated on a smaller sample to keep the generations short
+  const std::vector<boost::numeric::ublas::vector<double> > fitnessInput(input.begin(), input.begin() + 128);
+  const std::vector<boost::numeric::ublas::vector<double> > fitnessExpected(expected.begin(), expected.begin() + 128);
+
+  EvolutionaryProgramming FEP(&network, -1.0, 1.0, 50);
+  FEP.setSeed(1);
+  FEP.train(fitnessInput, fitnessExpected, evaluations);
+
+  TraceBuffer::global().writeChromeTrace("trace_fep.json");
+  TraceBuffer::global().writeCsv("trace_fep.csv");
+  summarize("FEP");
+}
@@ -0,0 +1,138 @@
+#include "checkpoint.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const char checkpointMagic[8] = {'M', 'L', 'C', 'K', 'P', 'T', 0, 0};
+const uint32_t checkpointVersion = 6;
+
+// Flush the directory holding path to disk, so a rename into it survives a power loss
+void syncDirectory(const std::string &path) {
+  const std::size_t slash = path.find_last_of('/');
+  const std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+  const int descriptor = open(directory.c_str(), O_RDONLY);
+  if (descriptor >= 0) {
+    fsync(descriptor);
+    close(descriptor);
+  }
+}
+
+}
+
+SnapshotWriter::SnapshotWriter(std::vector<char> &_buffer, const CheckpointKind kind): buffer(_buffer) {
+  buffer.assign(checkpointMagic, checkpointMagic + sizeof(checkpointMagic));
+  value(checkpointVersion);
+  value(static_cast<uint32_t>(kind));
+}
+
+SnapshotReader::SnapshotReader(const std::vector<char> &buffer, const CheckpointKind kind):
+  position(buffer.data()), end(buffer.data() + buffer.size()), valid(true) {
+  char magic[sizeof(checkpointMagic)];
+  uint32_t version = 0;
+  uint32_t stored = 0;
+
+  valid = end - position >= static_cast<std::ptrdiff_t>(sizeof(magic)) &&
+          std::memcmp(position, checkpointMagic, sizeof(magic)) == 0;
+  if (valid) {
+    position += sizeof(magic);
+  }
+  valid = value(version) && value(stored) && version == checkpointVersion && stored == static_cast<uint32_t>(kind);
+}
+
+bool readCheckpoint(const std::string &path, std::vector<char> &snapshot) {
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+
+  snapshot.clear();
+  char buffer[1 << 16];
+  std::size_t read;
+  while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    snapshot.insert(snapshot.end(), buffer, buffer + read);
+  }
+
+  const bool valid = !std::ferror(file);
+  std::fclose(file);
+  return valid;
+}
+
+CheckpointWriter::CheckpointWriter(): waiting(false), writing(false), stopping(false), succeeded(true) {
+  worker = std::thread(&CheckpointWriter::workerLoop, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  /*
+   * A snapshot still waiting is written before the thread exits.
+   */
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    stopping = true;
+  }
+  changed.notify_all();
+  worker.join();
+}
+
+void CheckpointWriter::submit(const std::string &path, std::vector<char> &snapshot) {
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    pending.swap(snapshot);
+    pendingPath = path;
+    waiting = true;
+  }
+  changed.notify_all();
+}
+
+bool CheckpointWriter::wait() {
+  std::unique_lock<std::mutex> guard(lock);
+  changed.wait(guard, [this] { return !waiting && !writing; });
+  return succeeded;
+}
+
+void CheckpointWriter::workerLoop() {
+  /*
+   * Take the waiting snapshot and write it without holding the lock, so the training
+   * thread can submit the next one meanwhile. The temporary file is on disk before it
+   * is renamed over the last checkpoint, so a crash leaves one or the other whole.
+   */
+  std::vector<char> snapshot;
+  std::string path;
+
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    changed.wait(guard, [this] { return waiting || stopping; });
+    if (!waiting) {
+      return;
+    }
+
+    snapshot.swap(pending);
+    path.swap(pendingPath);
+    waiting = false;
+    writing = true;
+    guard.unlock();
+
+    const std::string temporary = path + ".tmp";
+    std::FILE *file = std::fopen(temporary.c_str(), "wb");
+    bool valid = file != nullptr;
+    if (file) {
+      std::fwrite(snapshot.data(), 1, snapshot.size(), file);
+      valid = std::fflush(file) == 0 && !std::ferror(file);
+      valid = valid && fsync(fileno(file)) == 0;
+      valid = std::fclose(file) == 0 && valid;
+    }
+    valid = valid && std::rename(temporary.c_str(), path.c_str()) == 0;
+    if (valid) {
+      syncDirectory(path);
+    }
+    if (!valid) {
+      std::remove(temporary.c_str());
+    }
+
+    guard.lock();
+    writing = false;
+    succeeded = valid;
+    changed.notify_all();
+  }
+}
@@ -0,0 +1,135 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+/*
+ * Training checkpoints. An optimizer serializes its state into a snapshot buffer, which
+ * is handed to a CheckpointWriter and written to disk by a background thread while
+ * training continues. Only the latest snapshot matters, so one submitted while another is
+ * still being written replaces any snapshot waiting behind it. Files are written under a
+ * temporary name, synced to disk and renamed into place, so neither a crash nor a power
+ * loss leaves a torn checkpoint.
+ *
+ * Checkpoint file layout (native byte order):
+ *   magic "MLCKPT" followed by two zero bytes, uint32 version, uint32 kind
+ *   the optimizer's fields in the order it writes them; arrays are prefixed by their
+ *   uint64 length and strings (random engine states) by their uint64 length in bytes
+ */
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// The optimizer a checkpoint belongs to
+enum CheckpointKind { SGD_CHECKPOINT = 1, FEP_CHECKPOINT = 2 };
+
+// Appends values to a snapshot buffer.
+class SnapshotWriter {
+private:
+  std::vector<char> &buffer;
+
+public:
+  SnapshotWriter(std::vector<char> &_buffer, const CheckpointKind kind);
+
+  template <typename T>
+  void value(const T &x) {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written");
+    const char *bytes = reinterpret_cast<const char*>(&x);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+  }
+
+  template <typename T>
+  void array(const T *data, const uint64_t n) {
+    value(n);
+    const char *bytes = reinterpret_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + n * sizeof(T));
+  }
+
+  void string(const std::string &text) {
+    array(text.data(), text.size());
+  }
+};
+
+// Reads values back from a snapshot, failing (and staying failed) on a short or malformed one.
+class SnapshotReader {
+private:
+  const char *position;
+  const char *end;
+  bool valid;
+
+public:
+  SnapshotReader(const std::vector<char> &buffer, const CheckpointKind kind);
+
+  bool good() const {
+    return valid;
+  }
+
+  template <typename T>
+  bool value(T &x) {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read");
+    valid = valid && end - position >= static_cast<std::ptrdiff_t>(sizeof(T));
+    if (valid) {
+      std::memcpy(&x, position, sizeof(T));
+      position += sizeof(T);
+    }
+    return valid;
+  }
+
+  template <typename T, typename Allocator>
+  bool array(std::vector<T, Allocator> &data) {
+    uint64_t n = 0;
+    valid = value(n) && n <= static_cast<uint64_t>(end - position) / sizeof(T);
+    if (valid) {
+      data.resize(n);
+      std::memcpy(data.data(), position, n * sizeof(T));
+      position += n * sizeof(T);
+    }
+    return valid;
+  }
+
+  bool string(std::string &text) {
+    std::vector<char> bytes;
+    if (array(bytes)) {
+      text.assign(bytes.begin(), bytes.end());
+    }
+    return valid;
+  }
+};
+
+// Read a whole checkpoint file, returning false if it cannot be read.
+bool readCheckpoint(const std::string &path, std::vector<char> &snapshot);
+
+class CheckpointWriter {
+private:
+  std::thread worker;
+  std::mutex lock;
+  std::condition_variable changed; // Signalled when a snapshot is submitted, written or the writer stops
+  std::vector<char> pending; // The snapshot waiting to be written
+  std::string pendingPath;
+  bool waiting; // Whether pending holds a snapshot
+  bool writing;
+  bool stopping;
+  bool succeeded; // Whether the last write succeeded
+
+  void workerLoop();
+
+public:
+  CheckpointWriter();
+  ~CheckpointWriter();
+
+  CheckpointWriter(const CheckpointWriter&) = delete;
+  CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+  // Queue a snapshot to be written to path. The snapshot is swapped with a spare buffer
+  // (so the caller gets back storage it can refill without allocating).
+  void submit(const std::string &path, std::vector<char> &snapshot);
+
+  // Block until every submitted snapshot has been written, returning whether the last write succeeded.
+  bool wait();
+};
+
+#endif
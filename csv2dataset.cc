@@ -0,0 +1,50 @@
+#include "dataset.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+/*
+ * Convert a CSV file into the binary dataset format read by MappedDataset.
+ *
+ * Usage: csv2dataset input.csv output.bin labelColumns [--double] [--header] [--delimiter c]
+ *   labelColumns  number of trailing columns holding the expected output
+ *   --double      store values as float64 instead of float32
+ *   --header      skip the first line of the CSV
+ */
+int main(int argc, char **argv) {
+
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0] << " input.csv output.bin labelColumns [--double] [--header] [--delimiter c]" << std::endl;
+    return 1;
+  }
+
+  const int labelColumns = std::atoi(argv[3]);
+  bool singlePrecision = true;
+  bool skipHeader = false;
+  char delimiter = ',';
+
+  for (int i = 4; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--double") == 0) {
+      singlePrecision = false;
+    } else if (std::strcmp(argv[i], "--header") == 0) {
+      skipHeader = true;
+    } else if (std::strcmp(argv[i], "--delimiter") == 0 && i + 1 < argc) {
+      delimiter = argv[++i][0];
+    } else {
+      std::cerr << "Unknown option " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  if (!convertCSV(argv[1], argv[2], labelColumns, singlePrecision, skipHeader, delimiter)) {
+    std::cerr << "Failed to convert " << argv[1] << std::endl;
+    return 1;
+  }
+
+  MappedDataset data;
+  if (data.open(argv[2])) {
+    std::cout << data.size() << " samples, " << data.getInputSize() << " features, " << data.getOutputSize() << " labels" << std::endl;
+  }
+
+  return 0;
+}
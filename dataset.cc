@@ -0,0 +1,289 @@
+#include "dataset.h"
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char datasetMagic[8] = {'M', 'L', 'D', 'A', 'T', 'A', 0, 0};
+const uint32_t datasetVersion = 1;
+const uint64_t blockAlignment = 64;
+
+uint64_t alignUp(const uint64_t value) {
+  return (value + blockAlignment - 1) / blockAlignment * blockAlignment;
+}
+
+// Whether rows x width values of valueSize bytes starting at offset fit in length bytes.
+// The space left is divided rather than the size multiplied, which could overflow.
+bool fits(const uint64_t offset, const uint64_t rows, const uint64_t width, const uint64_t valueSize, const uint64_t length) {
+  return offset <= length && (width == 0 || rows <= (length - offset) / valueSize / width);
+}
+
+// The size shared by all the vectors, or -1 if they differ
+int commonSize(const std::vector<boost::numeric::ublas::vector<double> > &vectors) {
+  const int size = vectors.empty() ? 0 : vectors[0].size();
+  for (const auto &vector : vectors) {
+    if (static_cast<int>(vector.size()) != size) {
+      return -1;
+    }
+  }
+  return size;
+}
+
+bool parseLine(const std::string &line, const char delimiter, std::vector<double> &values) {
+  /*
+   * Split a CSV line into numbers, returning false if any field is not a number.
+   */
+  values.clear();
+  std::stringstream stream(line);
+  std::string field;
+
+  while (std::getline(stream, field, delimiter)) {
+    char *end;
+    const double value = strtod(field.c_str(), &end);
+
+    // Allow surrounding whitespace (and a carriage return from CRLF files) but nothing else
+    while (*end == ' ' || *end == '\t' || *end == '\r') {
+      end++;
+    }
+    if (end == field.c_str() || *end != '\0') {
+      return false;
+    }
+
+    values.push_back(value);
+  }
+
+  return true;
+}
+
+void writeValues(std::FILE *file, const double *values, const int count, const bool singlePrecision, std::vector<float> &converted) {
+  if (singlePrecision) {
+    converted.assign(values, values + count);
+    std::fwrite(converted.data(), sizeof(float), count, file);
+  } else {
+    std::fwrite(values, sizeof(double), count, file);
+  }
+}
+
+void writePadding(std::FILE *file, const uint64_t position) {
+  static const char zeros[blockAlignment] = {0};
+  std::fwrite(zeros, 1, alignUp(position) - position, file);
+}
+
+template <typename T, typename U>
+void gatherBlock(const void *data, const int width, const int *rows, const int count, boost::numeric::ublas::matrix<U> &batch) {
+  const T *block = static_cast<const T*>(data);
+
+  for (int k = 0; k < count; ++k) {
+    const T *row = block + static_cast<uint64_t>(rows[k]) * width;
+    std::copy(row, row + width, &batch(k, 0));
+  }
+}
+
+}
+
+DatasetView::DatasetView(const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected):
+  samples(input.size()), features(commonSize(input)), labels(commonSize(expected)),
+  inputVectors(&input), expectedVectors(&expected), featureBlock(nullptr), labelBlock(nullptr), singlePrecision(false) {
+  /*
+   * Every row is gathered into a batch as wide as the first, so vectors of other sizes
+   * (or a different number of inputs and labels) make the view empty, with sizes no
+   * network has.
+   */
+  if (features < 0 || labels < 0 || input.size() != expected.size()) {
+    samples = 0;
+    features = -1;
+    labels = -1;
+  }
+}
+
+DatasetView::DatasetView(const boost::numeric::ublas::matrix<double> &input, const boost::numeric::ublas::matrix<double> &expected):
+  samples(input.size1()), features(input.size2()), labels(expected.size2()),
+  inputVectors(nullptr), expectedVectors(nullptr),
+  featureBlock(input.data().begin()), labelBlock(expected.data().begin()), singlePrecision(false) {}
+
+DatasetView::DatasetView(const MappedDataset &data):
+  samples(data.size()), features(data.getInputSize()), labels(data.getOutputSize()),
+  inputVectors(nullptr), expectedVectors(nullptr),
+  featureBlock(data.features()), labelBlock(data.labels()), singlePrecision(data.isSinglePrecision()) {}
+
+void DatasetView::gather(const int *rows, const int count, boost::numeric::ublas::matrix<double> &batchInput, boost::numeric::ublas::matrix<double> &batchExpected) const {
+  gatherInto(rows, count, batchInput, batchExpected);
+}
+
+void DatasetView::gather(const int *rows, const int count, boost::numeric::ublas::matrix<float> &batchInput, boost::numeric::ublas::matrix<float> &batchExpected) const {
+  gatherInto(rows, count, batchInput, batchExpected);
+}
+
+template <typename T>
+void DatasetView::gatherInto(const int *rows, const int count, boost::numeric::ublas::matrix<T> &batchInput, boost::numeric::ublas::matrix<T> &batchExpected) const {
+  if (inputVectors) {
+    for (int k = 0; k < count; ++k) {
+      std::copy((*inputVectors)[rows[k]].begin(), (*inputVectors)[rows[k]].end(), &batchInput(k, 0));
+      std::copy((*expectedVectors)[rows[k]].begin(), (*expectedVectors)[rows[k]].end(), &batchExpected(k, 0));
+    }
+  } else if (singlePrecision) {
+    gatherBlock<float>(featureBlock, features, rows, count, batchInput);
+    gatherBlock<float>(labelBlock, labels, rows, count, batchExpected);
+  } else {
+    gatherBlock<double>(featureBlock, features, rows, count, batchInput);
+    gatherBlock<double>(labelBlock, labels, rows, count, batchExpected);
+  }
+}
+
+bool MappedDataset::open(const std::string &path) {
+  /*
+   * Map the whole file read-only. Pages are only read from disk when a sample on
+   * them is gathered, so the dataset does not have to fit in memory.
+   */
+  close();
+
+  descriptor = ::open(path.c_str(), O_RDONLY);
+  if (descriptor < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(descriptor, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(DatasetHeader)) {
+    close();
+    return false;
+  }
+
+  length = info.st_size;
+  void *memory = mmap(nullptr, length, PROT_READ, MAP_SHARED, descriptor, 0);
+  if (memory == MAP_FAILED) {
+    close();
+    return false;
+  }
+  mapping = memory;
+
+  std::memcpy(&header, mapping, sizeof(header));
+
+  // Validate the header against the size of the file (and the int sizes of the view)
+  const uint64_t valueSize = header.valueType == FLOAT32 ? sizeof(float) : sizeof(double);
+  const bool valid = std::memcmp(header.magic, datasetMagic, sizeof(datasetMagic)) == 0 &&
+                     header.version == datasetVersion &&
+                     (header.valueType == FLOAT32 || header.valueType == FLOAT64) &&
+                     header.rows <= INT_MAX && header.features <= INT_MAX && header.labels <= INT_MAX &&
+                     header.featureOffset >= sizeof(DatasetHeader) && header.labelOffset >= sizeof(DatasetHeader) &&
+                     fits(header.featureOffset, header.rows, header.features, valueSize, length) &&
+                     fits(header.labelOffset, header.rows, header.labels, valueSize, length);
+
+  if (!valid) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void MappedDataset::close() {
+  if (mapping) {
+    munmap(mapping, length);
+    mapping = nullptr;
+  }
+
+  if (descriptor >= 0) {
+    ::close(descriptor);
+    descriptor = -1;
+  }
+
+  length = 0;
+  std::memset(&header, 0, sizeof(header));
+}
+
+bool convertCSV(const std::string &csvPath, const std::string &datasetPath, const int labelColumns,
+                const bool singlePrecision, const bool skipHeader, const char delimiter) {
+  /*
+   * The CSV is streamed in a single pass: features are written straight after the
+   * header while labels go to a temporary file, which is appended once the number of
+   * rows is known. Memory use does not depend on the size of the CSV.
+   */
+  std::ifstream csv(csvPath.c_str());
+  if (!csv || labelColumns < 0) {
+    return false;
+  }
+
+  std::FILE *output = std::fopen(datasetPath.c_str(), "wb");
+  std::FILE *labels = std::tmpfile();
+  if (!output || !labels) {
+    if (output) std::fclose(output);
+    if (labels) std::fclose(labels);
+    return false;
+  }
+
+  DatasetHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, datasetMagic, sizeof(datasetMagic));
+  header.version = datasetVersion;
+  header.valueType = singlePrecision ? MappedDataset::FLOAT32 : MappedDataset::FLOAT64;
+  header.featureOffset = alignUp(sizeof(DatasetHeader));
+
+  // Reserve space for the header, it is rewritten at the end
+  std::fwrite(&header, sizeof(header), 1, output);
+  writePadding(output, sizeof(header));
+
+  std::string line;
+  std::vector<double> values;
+  std::vector<float> converted;
+  int columns = -1;
+  bool valid = true;
+
+  if (skipHeader) {
+    std::getline(csv, line);
+  }
+
+  while (std::getline(csv, line)) {
+    if (line.empty() || line == "\r") {
+      continue;
+    }
+
+    // Every row must hold the same number of columns, more than the number of labels
+    if (!parseLine(line, delimiter, values) || values.size() <= labelColumns || (columns >= 0 && values.size() != columns)) {
+      valid = false;
+      break;
+    }
+    columns = values.size();
+
+    writeValues(output, values.data(), columns - labelColumns, singlePrecision, converted);
+    writeValues(labels, values.data() + columns - labelColumns, labelColumns, singlePrecision, converted);
+    header.rows++;
+  }
+
+  if (valid && columns > 0) {
+    const uint64_t valueSize = singlePrecision ? sizeof(float) : sizeof(double);
+    header.features = columns - labelColumns;
+    header.labels = labelColumns;
+
+    const uint64_t featureEnd = header.featureOffset + header.rows * header.features * valueSize;
+    header.labelOffset = alignUp(featureEnd);
+    writePadding(output, featureEnd);
+
+    // Append the label block
+    std::rewind(labels);
+    char buffer[1 << 16];
+    std::size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), labels)) > 0) {
+      std::fwrite(buffer, 1, read, output);
+    }
+
+    std::rewind(output);
+    std::fwrite(&header, sizeof(header), 1, output);
+  }
+
+  valid = valid && columns > 0 && !std::ferror(output) && !std::ferror(labels);
+  std::fclose(labels);
+  valid = std::fclose(output) == 0 && valid;
+
+  if (!valid) {
+    std::remove(datasetPath.c_str());
+  }
+
+  return valid;
+}
@@ -0,0 +1,148 @@
+#ifndef DATASET_H_
+#define DATASET_H_
+
+/*
+ * Datasets used for training and evaluation. Training code only needs to know how
+ * many samples there are and how to gather a set of them into a batch matrix (one
+ * sample per row), which DatasetView provides over any of the supported sources.
+ * MappedDataset owns a binary dataset file which is memory-mapped and read on demand,
+ * so datasets larger than memory can be used.
+ *
+ * Binary dataset file layout (native byte order):
+ *   DatasetHeader (64 bytes)
+ *   feature block: rows x features values, row-major, starting at featureOffset
+ *   label block:   rows x labels values, row-major, starting at labelOffset
+ * Values are float32 or float64 as given by valueType; both blocks are 64-byte aligned.
+ */
+
+#include <boost/numeric/ublas/matrix.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct DatasetHeader {
+  char magic[8]; // "MLDATA" followed by two zero bytes
+  uint32_t version;
+  uint32_t valueType; // 0 = float32, 1 = float64
+  uint64_t rows;
+  uint64_t features;
+  uint64_t labels;
+  uint64_t featureOffset;
+  uint64_t labelOffset;
+  uint64_t reserved;
+};
+
+static_assert(sizeof(DatasetHeader) == 64, "Dataset header must be 64 bytes");
+
+class MappedDataset;
+
+/*
+ * A non-owning view of a dataset. It is cheap to copy and never copies the samples,
+ * so it is what the cost function and the optimizers take. It can view:
+ * - one ublas vector per sample (input and expected), all inputs of one size and all
+ *   expected values of another; otherwise the view is empty and no network accepts it,
+ * - a pair of row-major matrices holding one sample per row,
+ * - a memory-mapped dataset file.
+ * The viewed data must outlive the view.
+ */
+class DatasetView {
+private:
+  int samples;
+  int features;
+  int labels;
+
+  // One vector per sample
+  const std::vector<boost::numeric::ublas::vector<double> > *inputVectors;
+  const std::vector<boost::numeric::ublas::vector<double> > *expectedVectors;
+
+  // Otherwise row-major blocks of float or double values
+  const void *featureBlock;
+  const void *labelBlock;
+  bool singlePrecision;
+
+public:
+  DatasetView(const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected);
+  DatasetView(const boost::numeric::ublas::matrix<double> &input, const boost::numeric::ublas::matrix<double> &expected);
+  DatasetView(const MappedDataset &data);
+
+  int size() const {
+    return samples;
+  }
+
+  int getInputSize() const {
+    return features;
+  }
+
+  int getOutputSize() const {
+    return labels;
+  }
+
+  // Copy the given samples into consecutive rows of the batch matrices (which must have count rows),
+  // converting the stored values to the type of the matrices.
+  void gather(const int *rows, const int count, boost::numeric::ublas::matrix<double> &batchInput, boost::numeric::ublas::matrix<double> &batchExpected) const;
+  void gather(const int *rows, const int count, boost::numeric::ublas::matrix<float> &batchInput, boost::numeric::ublas::matrix<float> &batchExpected) const;
+
+private:
+  template <typename T>
+  void gatherInto(const int *rows, const int count, boost::numeric::ublas::matrix<T> &batchInput, boost::numeric::ublas::matrix<T> &batchExpected) const;
+};
+
+class MappedDataset {
+private:
+  int descriptor;
+  void *mapping;
+  std::size_t length;
+  DatasetHeader header;
+
+public:
+  static const uint32_t FLOAT32 = 0;
+  static const uint32_t FLOAT64 = 1;
+
+  MappedDataset(): descriptor(-1), mapping(nullptr), length(0) {}
+  ~MappedDataset() {
+    close();
+  }
+
+  MappedDataset(const MappedDataset&) = delete;
+  MappedDataset& operator=(const MappedDataset&) = delete;
+
+  // Map a dataset file, returning false if it cannot be opened or is not a valid dataset.
+  bool open(const std::string &path);
+  void close();
+
+  bool isOpen() const {
+    return mapping != nullptr;
+  }
+
+  int size() const {
+    return header.rows;
+  }
+
+  int getInputSize() const {
+    return header.features;
+  }
+
+  int getOutputSize() const {
+    return header.labels;
+  }
+
+  bool isSinglePrecision() const {
+    return header.valueType == FLOAT32;
+  }
+
+  // The mapped feature and label blocks
+  const void* features() const {
+    return static_cast<const char*>(mapping) + header.featureOffset;
+  }
+
+  const void* labels() const {
+    return static_cast<const char*>(mapping) + header.labelOffset;
+  }
+};
+
+// Convert a CSV file (one sample per line, the last labelColumns values being the labels)
+// into a binary dataset file. Returns false if the CSV cannot be read or has inconsistent rows.
+bool convertCSV(const std::string &csvPath, const std::string &datasetPath, const int labelColumns,
+                const bool singlePrecision = true, const bool skipHeader = false, const char delimiter = ',');
+
+#endif
@@ -1,157 +1,613 @@
 #include "evolution.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
 
-void EvolutionaryProgramming::generatePopulation() {
+namespace {
+
+// Rows per block of a race
+const int raceBlockSize = 256;
+
+}
+
+template <typename Scalar>
+void BasicEvolutionaryProgramming<Scalar>::generatePopulation() {
   /*
-   * This function generates the initial population.
+   * This function generates the initial population, in the first half of the candidate
+   * slots (the offspring fill the second half).
    */
-   population.clear();
-
-   auto weights = network->getWeights();
+   const int candidates = 2 * populationSize;
+   weights.resize(static_cast<std::size_t>(candidates) * dim);
+   fitness.assign(candidates, -1.0);
+   wins.assign(candidates, 0);
+   ranking.resize(candidates);
+   for (int k = 0; k < candidates; ++k) {
+     ranking[k] = k;
+   }
 
-   unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-   std::default_random_engine generator (seed);
+   // Randomly initialize weights
    std::uniform_real_distribution<double> distribution(minValue, maxValue);
+   std::for_each(weights.begin(), weights.begin() + static_cast<std::size_t>(populationSize) * dim, [&] (Scalar &val) {val = distribution(generator);});
 
-   for (int i = 0; i < populationSize; ++i) {
-     Individual tmp;
-     tmp.weights = weights;
-     tmp.stepSize = weights;
+   // Set initial self-adaptive strategy parameter
+   stepSizes.assign(static_cast<std::size_t>(candidates) * dim, 3.0);
 
-     // Randomly initialize weights
-     for (auto &w : tmp.weights) {
-       std::for_each(w.begin1(), w.end1(), [&] (double &val) {val = distribution(generator);});
-     }
+   // Nothing has been scored yet
+   partialCost.assign(candidates, 0.0);
+   partialSquares.assign(candidates, 0.0);
+   scoredBlocks.assign(candidates, 0);
 
-     // Set initial self-adaptive strategy parameter
-     for (auto &step : tmp.stepSize) {
-       std::for_each(step.begin1(), step.end1(), [] (double &val) {val = 3.0;});
-     }
-
-     population.push_back(tmp);
-   }
+   // Key the mutations of this run
+   const uint64_t high = generator();
+   mutations = Philox((high << 32) ^ generator());
 }
 
-void EvolutionaryProgramming::spawnOffspring() {
+template <typename Scalar>
+void BasicEvolutionaryProgramming<Scalar>::spawnOffspring() {
   /*
    * This function generates the offspring by random mutation (each member of
    * the population produces a single offspring).
    */
+   ML_TRACE_SCOPE("mutation");
 
-   unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-   std::default_random_engine generator (seed);
    std::normal_distribution<double> NormalDist(0.0, 1.0);
-   std::cauchy_distribution<double> CauchyDist(0.0, 1.0);
-
-   double stepRandom = NormalDist(generator);
+   generationStep = NormalDist(generator);
+
+   // Each offspring draws its own random numbers by counter, so they can be mutated in any order
+   if (pool) {
+     pool->run(populationSize, [this] (int i) { mutate(i); });
+   } else {
+     for (int i = 0; i < populationSize; ++i) {
+       mutate(i);
+     }
+   }
+}
 
-   for (int i = 0; i < populationSize; ++i) {
-     auto current = population[i];
+template <typename Scalar>
+void BasicEvolutionaryProgramming<Scalar>::mutate(const int parent) {
+  /*
+   * Write the offspring of the parent of the given rank into its slot. Random numbers are
+   * generated a block at a time into the stack, then the weights and step sizes are
+   * updated in one pass.
+   */
+   const Scalar *parentWeights = weights.data() + static_cast<std::size_t>(ranking[parent]) * dim;
+   const double *parentSteps = stepSizes.data() + static_cast<std::size_t>(ranking[parent]) * dim;
+   Scalar *childWeights = weights.data() + static_cast<std::size_t>(ranking[populationSize + parent]) * dim;
+   double *childSteps = stepSizes.data() + static_cast<std::size_t>(ranking[populationSize + parent]) * dim;
+
+   // The offspring has not been scored yet
+   partialCost[ranking[populationSize + parent]] = 0.0;
+   partialSquares[ranking[populationSize + parent]] = 0.0;
+   scoredBlocks[ranking[populationSize + parent]] = 0;
+
+   const double globalStep = (1.0/sqrt(2.0*dim))*generationStep;
+   const double localRate = 1.0/sqrt(2.0*sqrt(dim));
+
+   const int block = 64;
+   double uniform[block];
+   double normal[block];
+   double growth[block];
+
+   for (int start = 0; start < dim; start += block) {
+     const int count = std::min(block, dim - start);
+
+     // Every pair of weights takes four random numbers: one for each Cauchy deviate and
+     // two for a pair of normal deviates (Box-Muller)
+     for (int k = 0; k < count; k += 2) {
+       uint32_t r[4];
+       mutations((start + k) / 2, parent, generation, 0, r);
+       const double radius = sqrt(-2.0*log(Philox::uniform(r[2])));
+       const double angle = 2.0*M_PI*Philox::uniform(r[3]);
+       uniform[k] = Philox::uniform(r[0]);
+       uniform[k + 1] = Philox::uniform(r[1]);
+       normal[k] = radius*cos(angle);
+       normal[k + 1] = radius*sin(angle);
+     }
 
-     for (int weight = 0; weight < current.weights.size(); ++weight) {
-       for (int x = 0; x < current.weights[weight].size1(); ++x) {
-         for (int y = 0; y < current.weights[weight].size2(); ++y) {
+     // The factors of the step sizes, with the vectorized exponential of the activations
+     for (int k = 0; k < count; ++k) {
+       growth[k] = globalStep + localRate*normal[k];
+     }
+     vectorExp(growth, count);
+
+     for (int k = 0; k < count; ++k) {
+       const double value = parentWeights[start + k];
+       const double step = parentSteps[start + k];
+
+       // Mutate the weight using Cauchy random numbers
+       double mutated = value + step*tan(M_PI*(uniform[k] - 0.5));
+
+       // Make sure the new value is within the desired bounds. Instead of redrawing until
+       // it fits, a second draw is conditioned on fitting by inverting the distribution
+       // function over the allowed range, which gives the same distribution.
+       if (mutated < minValue || mutated > maxValue) {
+         const double low = atan((minValue - value)/step);
+         const double high = atan((maxValue - value)/step);
+         uint32_t r[4];
+         mutations((start + k) / 2, parent, generation, 1, r);
+         const double u = Philox::uniform(r[k & 1]);
+         mutated = step > 0.0 ? value + step*tan(low + u*(high - low)) : value;
+       }
+       childWeights[start + k] = std::min(std::max(mutated, minValue), maxValue);
 
-           // Mutate the value of the matrix element using Cauchy random numbers
-           double value = current.weights[weight](x,y) + current.stepSize[weight](x,y)*CauchyDist(generator);
+       // Update the self-adaptive strategy parameter
+       childSteps[start + k] = step*growth[k];
+     }
+   }
+}
 
-           // Make sure the new value is within the desired bounds
-           while (value < minValue || value > maxValue) {
-             value = current.weights[weight](x,y) + current.stepSize[weight](x,y)*CauchyDist(generator);
-           }
+template <typename Scalar>
+double BasicEvolutionaryProgramming<Scalar>::evaluateFitness(const DatasetView &data) {
+  /*
+   * For all members of the population we calculate the fitness.
+   */
+   ML_TRACE_SCOPE("fitness");
 
-           // Assign mutated value
-           current.weights[weight](x,y) = value;
+   if (racing) {
+     return raceFitness(data);
+   }
 
-           // Update the self-adaptive strategy parameter
-           current.stepSize[weight](x,y) = current.stepSize[weight](x,y)*exp((1.0/sqrt(2.0*dim))*stepRandom + (1.0/sqrt(2.0*sqrt(dim)))*NormalDist(generator));
-         }
-       }
+   // Every individual is scored with its own weights through the stateless cost
+   // function, so the shared network is never modified and individuals can be
+   // scored concurrently.
+   auto score = [&] (int k) {
+     fitness[k] = network->cost(Span<const Scalar>(weights.data() + static_cast<std::size_t>(k) * dim, dim), data);
+   };
+
+   if (pool) {
+     pool->run(fitness.size(), score);
+   } else {
+     for (int k = 0; k < fitness.size(); ++k) {
+       score(k);
      }
-
-     // Add the offspring to the population
-     population.push_back(current);
    }
+
+   fitnessEvaluations += fitness.size();
+
+   // We calculate the minimum fitness for this generation
+   return *std::min_element(fitness.begin(), fitness.end());
 }
 
-double EvolutionaryProgramming::evaluateFitness(const std::vector<boost::numeric::ublas::vector<double> > input, const std::vector<boost::numeric::ublas::vector<double> > expected) {
+template <typename Scalar>
+void BasicEvolutionaryProgramming<Scalar>::prepareRace(const DatasetView &data) {
   /*
-   * For all members of the population we calculate the fitness.
+   * Shuffle the order the blocks of the dataset are scored in (Fisher-Yates, with random
+   * numbers from the mutation key so a resumed run uses the same order) and size the
+   * scratch of the races.
    */
+  const int blocks = (data.size() + raceBlockSize - 1) / raceBlockSize;
+  blockOrder.resize(blocks);
+  for (int b = 0; b < blocks; ++b) {
+    blockOrder[b] = b;
+  }
+  for (int b = blocks - 1; b > 0; --b) {
+    uint32_t r[4];
+    mutations(b, 0, 0, 2, r);
+    std::swap(blockOrder[b], blockOrder[r[0] % (b + 1)]);
+  }
 
-   // We calculate the minimum fitness for this generation
-   double minFit = -1;
+  blockRows.resize(blocks + 1);
+  blockRows[0] = 0;
+  for (int b = 0; b < blocks; ++b) {
+    blockRows[b + 1] = blockRows[b] + std::min(raceBlockSize, data.size() - blockOrder[b] * raceBlockSize);
+  }
+
+  // Every candidate starts again on a dataset of another size than the partial costs
+  // were scored on (a resumed run must be given the same dataset, which is not checked)
+  if (data.size() != raceRows) {
+    std::fill(scoredBlocks.begin(), scoredBlocks.end(), 0);
+    std::fill(partialCost.begin(), partialCost.end(), 0.0);
+    std::fill(partialSquares.begin(), partialSquares.end(), 0.0);
+    raceRows = data.size();
+  }
 
-   for (Individual &x: population) {
-     // Set the network weights and use the cost function as the fitness
-     network->setWeights(x.weights);
-     x.fitness = network->cost(input, expected);
+  dropped.resize(fitness.size());
+  racers.reserve(fitness.size());
+  exactFitness.reserve(fitness.size());
+}
 
-     if (minFit == -1 || x.fitness < minFit) {
-       minFit = x.fitness;
-     }
+template <typename Scalar>
+double BasicEvolutionaryProgramming<Scalar>::raceFitness(const DatasetView &data) {
+  /*
+   * Race every candidate that is not fully scored over rounds of growing shares of the
+   * dataset. After each round the bar is the populationSize-th lowest cost among the
+   * fully scored candidates; a candidate whose cost is certainly or very probably above
+   * it would lose to that many others and is dropped.
+   */
+  const int candidates = fitness.size();
+  const int blocks = blockOrder.size();
+  const double rows = blockRows[blocks];
+  std::fill(dropped.begin(), dropped.end(), 0);
+
+  // Only candidates not yet fully scored count as fitness evaluations. The rows left
+  // unscored by a candidate dropped in an earlier generation (and selected) were counted
+  // as saved then, so they are taken back here and counted again if it is dropped again.
+  int scoredCandidates = 0;
+  int64_t unscored = 0;
+  for (int slot = 0; slot < candidates; ++slot) {
+    if (scoredBlocks[slot] < blocks) {
+      ++scoredCandidates;
+      if (scoredBlocks[slot] > 0) {
+        unscored -= blockRows[blocks] - blockRows[scoredBlocks[slot]];
+      }
+    }
+  }
 
-     fitnessEvaluations++;
-   }
+  auto score = [this, &data] (int r) {
+    const int slot = racers[r];
+    const Span<const Scalar> candidate(weights.data() + static_cast<std::size_t>(slot) * dim, dim);
+    double sum = partialCost[slot];
+    double squares = partialSquares[slot];
+    for (int b = scoredBlocks[slot]; b < raceTarget; ++b) {
+      const int start = blockOrder[b] * raceBlockSize;
+      const double cost = network->costSum(candidate, data, start, std::min(start + raceBlockSize, data.size()));
+      const double mean = cost / (blockRows[b + 1] - blockRows[b]);
+      sum += cost;
+      squares += mean * mean;
+    }
+    partialCost[slot] = sum;
+    partialSquares[slot] = squares;
+  };
+
+  const int first = std::min(std::max(static_cast<int>(std::ceil(raceFraction * blocks)), 1), blocks);
+  for (raceTarget = first; ; raceTarget = std::min(2 * raceTarget, blocks)) {
+    racers.clear();
+    for (int k = 0; k < candidates; ++k) {
+      const int slot = ranking[k];
+      if (!dropped[slot] && scoredBlocks[slot] < raceTarget) {
+        racers.push_back(slot);
+      }
+    }
+
+    if (pool) {
+      pool->run(racers.size(), score);
+    } else {
+      for (int r = 0; r < racers.size(); ++r) {
+        score(r);
+      }
+    }
+
+    // The fitness of a candidate which is not fully scored is its mean cost so far
+    exactFitness.clear();
+    for (const int slot : racers) {
+      scoredBlocks[slot] = raceTarget;
+      fitness[slot] = partialCost[slot] / blockRows[raceTarget];
+    }
+    for (int slot = 0; slot < candidates; ++slot) {
+      if (scoredBlocks[slot] == blocks) {
+        exactFitness.push_back(fitness[slot]);
+      }
+    }
+
+    if (raceTarget == blocks) {
+      break;
+    }
+
+    if (exactFitness.size() >= populationSize) {
+      std::nth_element(exactFitness.begin(), exactFitness.begin() + populationSize - 1, exactFitness.end());
+      const double bar = exactFitness[populationSize - 1];
+
+      // The standard error of the mean cost is estimated from the spread of the mean
+      // costs of the blocks, corrected for the share of the blocks already scored
+      const int m = raceTarget;
+      const double remaining = 1.0 - static_cast<double>(m) / blocks;
+      for (const int slot : racers) {
+        const double mean = fitness[slot];
+        const double variance = m > 1 ? std::max(partialSquares[slot] - m * mean * mean, 0.0) / (m - 1) : 0.0;
+        const double error = std::sqrt(variance / m * remaining);
+        dropped[slot] = partialCost[slot] / rows > bar || (m > 1 && mean - raceConfidence * error > bar);
+      }
+    }
+  }
+
+  for (int slot = 0; slot < candidates; ++slot) {
+    unscored += blockRows[blocks] - blockRows[scoredBlocks[slot]];
+  }
+  fitnessEvaluations += scoredCandidates;
+  samplesSaved += unscored;
 
-   return minFit;
+  // We calculate the minimum fitness for this generation
+  return *std::min_element(fitness.begin(), fitness.end());
 }
 
-void EvolutionaryProgramming::tournamentSelection() {
+template <typename Scalar>
+void BasicEvolutionaryProgramming<Scalar>::tournamentSelection() {
   /*
    * Carry out the tournament selection procedure: Individuals randomly compete with
    * one another and those with the largest number of wins make up the new population.
    */
-   unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-   std::default_random_engine generator (seed);
-   std::uniform_int_distribution<int> distribution(0, population.size() - 1);
-
-   for (Individual &x: population) {
-
-     x.wins = 0;
+   ML_TRACE_SCOPE("selection");
+   const int candidates = ranking.size();
+   const int rounds = opponents.size();
+   std::uniform_int_distribution<int> distribution(0, candidates - 1);
 
-     std::unordered_set<int> seen;
-     int select;
+   for (int k = 0; k < candidates; ++k) {
+     const double current = fitness[ranking[k]];
+     int count = 0;
 
-     // Make the current Individual compete with the desired number of opponents
-     for (int i = 0; i < opponentNumber; ++i) {
-       select = distribution(generator);
+     // Make the current Individual compete with the desired number of distinct opponents
+     for (int i = 0; i < rounds; ++i) {
+       int select = distribution(generator);
 
-       while (seen.count(select)) {
+       while (std::find(opponents.begin(), opponents.begin() + i, select) != opponents.begin() + i) {
          select = distribution(generator);
        }
 
-       seen.insert(select);
+       opponents[i] = select;
 
-       if (x.fitness <= population[select].fitness) {
-         x.wins++;
+       if (current <= fitness[ranking[select]]) {
+         count++;
        }
      }
+
+     wins[ranking[k]] = count;
+   }
+
+   // Move the individuals with the most wins to the front of the ranking. Only the split
+   // between survivors and the rest matters, so the order is not completed.
+   std::nth_element(ranking.begin(), ranking.begin() + populationSize, ranking.end(), [this] (int i, int j) { return wins[i] > wins[j]; });
+}
+
+template <typename Scalar>
+void BasicEvolutionaryProgramming<Scalar>::emigrate(const int count, Scalar *out, double *outSteps, double *outFitness) {
+  /*
+   * Bring the fittest members to the front of the selected population, then copy them out.
+   */
+   const int n = std::min(count, populationSize);
+   std::nth_element(ranking.begin(), ranking.begin() + n, ranking.begin() + populationSize, [this] (int i, int j) { return fitness[i] < fitness[j]; });
+
+   for (int k = 0; k < n; ++k) {
+     const std::size_t offset = static_cast<std::size_t>(ranking[k]) * dim;
+     std::copy(weights.begin() + offset, weights.begin() + offset + dim, out + static_cast<std::size_t>(k) * dim);
+     std::copy(stepSizes.begin() + offset, stepSizes.begin() + offset + dim, outSteps + static_cast<std::size_t>(k) * dim);
+     outFitness[k] = fitness[ranking[k]];
    }
+}
 
-   // We sort the population by the number of wins (decreasing)
-   std::sort(population.begin(), population.end(), [] (Individual i, Individual j) { return (i.wins > j.wins);});
+template <typename Scalar>
+void BasicEvolutionaryProgramming<Scalar>::immigrate(const int count, const Scalar *in, const double *inSteps, const double *inFitness) {
+  /*
+   * Move the least fit members to the back of the selected population and overwrite their slots.
+   */
+   const int n = std::min(count, populationSize);
+   const int first = populationSize - n;
+   std::nth_element(ranking.begin(), ranking.begin() + first, ranking.begin() + populationSize, [this] (int i, int j) { return fitness[i] < fitness[j]; });
+
+   for (int k = 0; k < n; ++k) {
+     const std::size_t offset = static_cast<std::size_t>(ranking[first + k]) * dim;
+     std::copy(in + static_cast<std::size_t>(k) * dim, in + static_cast<std::size_t>(k + 1) * dim, weights.begin() + offset);
+     std::copy(inSteps + static_cast<std::size_t>(k) * dim, inSteps + static_cast<std::size_t>(k + 1) * dim, stepSizes.begin() + offset);
+     fitness[ranking[first + k]] = inFitness[k];
+
+     // The fitness of an immigrant is taken as fully scored
+     scoredBlocks[ranking[first + k]] = blockOrder.size();
+     partialCost[ranking[first + k]] = blockRows.empty() ? 0.0 : inFitness[k] * blockRows.back();
+     partialSquares[ranking[first + k]] = 0.0;
+   }
+}
 
-   // Resize the population
-   population.resize(populationSize);
+template <typename Scalar>
+void BasicEvolutionaryProgramming<Scalar>::train(const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected, int maxFitnessEval) {
+  train(DatasetView(input, expected), maxFitnessEval);
 }
 
-void EvolutionaryProgramming::train(const std::vector<boost::numeric::ublas::vector<double> > input, const std::vector<boost::numeric::ublas::vector<double> > expected, int maxFitnessEval) {
+template <typename Scalar>
+void BasicEvolutionaryProgramming<Scalar>::train(const DatasetView &data, int maxFitnessEval) {
 
-  // Initialize population
-  generatePopulation();
+  // The dataset must match the shape of the network
+  if (data.getInputSize() != network->getInputSize() || data.getOutputSize() != network->getOutputSize()) {
+    return;
+  }
+
+  // Initialize population, unless continuing a resumed run
+  if (!resumed) {
+    generator.seed(fixedSeed ? seed : std::chrono::system_clock::now().time_since_epoch().count());
+    generatePopulation();
+    generation = 1;
+  }
+  resumed = false;
 
-  int generation = 1;
+  // Scratch for the tournaments (an individual cannot meet more distinct opponents than there are)
+  opponents.resize(std::min(opponentNumber, 2 * populationSize));
+
+  if (racing) {
+    prepareRace(data);
+  }
 
   while (fitnessEvaluations < maxFitnessEval) {
     spawnOffspring();
-    double fit = evaluateFitness(input, expected);
+    double fit = evaluateFitness(data);
     tournamentSelection();
     generation++;
+
+    if (migrationInterval > 0 && generation % migrationInterval == 0 && migration) {
+      migration(*this);
+    }
+
+    if (progress || telemetryEnabled) {
+      reportProgress();
+    }
+
+    if (checkpointInterval > 0 && generation % checkpointInterval == 0) {
+      writeCheckpoint();
+    }
+  }
+
+  if (checkpoints) {
+    checkpoints->wait();
+  }
+
+  // Finally set the network weights to the fittest of the final generation
+  int best = ranking[0];
+  for (int k = 1; k < populationSize; ++k) {
+    if (fitness[ranking[k]] < fitness[best]) {
+      best = ranking[k];
+    }
+  }
+  network->setParameters(Span<const Scalar>(weights.data() + static_cast<std::size_t>(best) * dim, dim));
+}
+
+template <typename Scalar>
+void BasicEvolutionaryProgramming<Scalar>::reportProgress() {
+  /*
+   * Summarize the fitness and the step sizes of the selected population.
+   */
+  FEPProgress current;
+  current.generation = generation;
+  current.fitnessEvaluations = fitnessEvaluations;
+  current.bestFitness = std::numeric_limits<double>::infinity();
+  current.meanFitness = 0.0;
+  current.minStepSize = std::numeric_limits<double>::infinity();
+  current.meanStepSize = 0.0;
+  current.maxStepSize = 0.0;
+  current.samplesSaved = samplesSaved;
+
+  for (int k = 0; k < populationSize; ++k) {
+    const double *steps = stepSizes.data() + static_cast<std::size_t>(ranking[k]) * dim;
+    current.bestFitness = std::min(current.bestFitness, fitness[ranking[k]]);
+    current.meanFitness += fitness[ranking[k]];
+    for (int j = 0; j < dim; ++j) {
+      current.minStepSize = std::min(current.minStepSize, steps[j]);
+      current.maxStepSize = std::max(current.maxStepSize, steps[j]);
+      current.meanStepSize += steps[j];
+    }
+  }
+  current.meanFitness /= populationSize;
+  current.meanStepSize /= static_cast<double>(populationSize) * dim;
+
+  ML_TRACE_COUNTER("best fitness", current.bestFitness);
+  ML_TRACE_COUNTER("mean fitness", current.meanFitness);
+  ML_TRACE_COUNTER("mean step size", current.meanStepSize);
+  if (progress) {
+    progress(current);
+  }
+}
+
+template <typename Scalar>
+void BasicEvolutionaryProgramming<Scalar>::writeCheckpoint() {
+  /*
+   * Copy the population into the snapshot buffer (reused between checkpoints) and hand
+   * it to the background writer.
+   */
+  SnapshotWriter out(snapshot, FEP_CHECKPOINT);
+  out.value(static_cast<uint32_t>(sizeof(Scalar)));
+  out.value(fitnessEvaluations);
+  out.value(generation);
+
+  std::ostringstream engine;
+  engine << generator;
+  out.string(engine.str());
+  out.value(mutations.key[0]);
+  out.value(mutations.key[1]);
+  out.value(samplesSaved);
+  out.value(raceRows);
+
+  // The selected population in rank order
+  out.value(static_cast<uint64_t>(populationSize));
+  for (int k = 0; k < populationSize; ++k) {
+    const std::size_t offset = static_cast<std::size_t>(ranking[k]) * dim;
+    out.array(weights.data() + offset, dim);
+    out.array(stepSizes.data() + offset, dim);
+    out.value(fitness[ranking[k]]);
+    out.value(wins[ranking[k]]);
+    out.value(partialCost[ranking[k]]);
+    out.value(partialSquares[ranking[k]]);
+    out.value(scoredBlocks[ranking[k]]);
+  }
+
+  checkpoints->submit(checkpointPath, snapshot);
+}
+
+template <typename Scalar>
+bool BasicEvolutionaryProgramming<Scalar>::resume(const std::string &path) {
+  /*
+   * Everything is read into temporaries first, so a bad checkpoint changes nothing.
+   */
+  std::vector<char> buffer;
+  if (!readCheckpoint(path, buffer)) {
+    return false;
+  }
+
+  SnapshotReader in(buffer, FEP_CHECKPOINT);
+  uint32_t scalarSize = 0;
+  int savedEvaluations = 0;
+  int savedGeneration = 0;
+  std::string engine;
+  Philox savedMutations;
+  int64_t savedSamples = 0;
+  int savedRaceRows = 0;
+  uint64_t size = 0;
+
+  in.value(scalarSize);
+  in.value(savedEvaluations);
+  in.value(savedGeneration);
+  in.string(engine);
+  in.value(savedMutations.key[0]);
+  in.value(savedMutations.key[1]);
+  in.value(savedSamples);
+  in.value(savedRaceRows);
+  in.value(size);
+
+  if (!in.good() || scalarSize != sizeof(Scalar) || size != populationSize) {
+    return false;
+  }
+
+  // The saved population goes into the first slots, in rank order
+  const int candidates = 2 * populationSize;
+  AlignedVector<Scalar> savedWeights(static_cast<std::size_t>(candidates) * dim);
+  ParameterVector savedSteps(static_cast<std::size_t>(candidates) * dim, 3.0);
+  std::vector<double> savedFitness(candidates, -1.0);
+  std::vector<int> savedWins(candidates, 0);
+  std::vector<double> savedPartial(candidates, 0.0);
+  std::vector<double> savedSquares(candidates, 0.0);
+  std::vector<int> savedScored(candidates, 0);
+  AlignedVector<Scalar> individualWeights;
+  ParameterVector individualSteps;
+
+  for (int k = 0; k < populationSize; ++k) {
+    in.array(individualWeights);
+    in.array(individualSteps);
+    in.value(savedFitness[k]);
+    in.value(savedWins[k]);
+    in.value(savedPartial[k]);
+    in.value(savedSquares[k]);
+    in.value(savedScored[k]);
+    if (!in.good() || individualWeights.size() != dim || individualSteps.size() != dim || savedScored[k] < 0) {
+      return false;
+    }
+    std::copy(individualWeights.begin(), individualWeights.end(), savedWeights.begin() + static_cast<std::size_t>(k) * dim);
+    std::copy(individualSteps.begin(), individualSteps.end(), savedSteps.begin() + static_cast<std::size_t>(k) * dim);
   }
 
-  // We sort the final generation by fitness (increasing)
-  std::sort(population.begin(), population.end(), [] (Individual i, Individual j) { return (i.fitness < j.fitness);});
+  std::istringstream engineStream(engine);
+  std::default_random_engine savedGenerator;
+  engineStream >> savedGenerator;
+  if (engineStream.fail()) {
+    return false;
+  }
 
-  // Finally set the network weights to the best found
-  network->setWeights(population[0].weights);
+  weights.swap(savedWeights);
+  stepSizes.swap(savedSteps);
+  fitness.swap(savedFitness);
+  wins.swap(savedWins);
+  partialCost.swap(savedPartial);
+  partialSquares.swap(savedSquares);
+  scoredBlocks.swap(savedScored);
+  ranking.resize(candidates);
+  for (int k = 0; k < candidates; ++k) {
+    ranking[k] = k;
+  }
+  mutations = savedMutations;
+  samplesSaved = savedSamples;
+  raceRows = savedRaceRows;
+  fitnessEvaluations = savedEvaluations;
+  generation = savedGeneration;
+  generator = savedGenerator;
+  resumed = true;
+  return true;
 }
+
+template class BasicEvolutionaryProgramming<double>;
+template class BasicEvolutionaryProgramming<float>;
@@ -4,54 +4,188 @@
 /*
  * An optimization class which implements Fast Evolutionary Programming for learning network weights.
  * Fast Evolutionary Programming is a global optimization technique which works well for multi-modal data.
+ * Individuals hold their weights in the network's scalar type, so a single precision network
+ * also halves the memory used by the population. The population lives in one contiguous
+ * buffer; offspring are mutated in place with a counter-based random number generator
+ * (so the members can be mutated on several threads with the same result) and selection
+ * only reorders an array of indices.
+ * Long runs can be checkpointed every few generations (the population, the evaluation count
+ * and the random state, written in the background) and resumed exactly.
+ * Racing (setRacing) scores candidates on growing shares of the dataset and stops scoring
+ * those which will not beat the parents, which saves most of the fitness evaluation time on
+ * large datasets.
+ * A callback can follow the best and mean fitness and the step sizes after every generation,
+ * and builds with ML_TELEMETRY trace the mutation, fitness and selection phases.
  */
 
 #include "network.h"
-#include <unordered_set>
+#include "threadpool.h"
+#include "checkpoint.h"
+#include "telemetry.h"
+#include "philox.h"
+#include <functional>
 
-class EvolutionaryProgramming {
+template <typename Scalar>
+class BasicEvolutionaryProgramming {
 private:
-  // Representation for each member of the population (contains the trained weights)
-  struct Individual {
-    std::vector<boost::numeric::ublas::matrix<double>> weights;
-    std::vector<boost::numeric::ublas::matrix<double>> stepSize;
-    double fitness;
-    int wins;
-
-    Individual():fitness(-1.0),
-                 wins(0) {}
-  };
-
-  NeuralNetwork * network;
+  /*
+   * The population is stored as one structure of arrays with room for the parents and
+   * their offspring: candidate slot k holds weights[k*dim .. (k+1)*dim - 1], the matching
+   * step sizes, and its fitness and number of wins. ranking lists the slots, the selected
+   * parents first and the slots their offspring are written to after them, so neither
+   * mutation nor selection ever copies an individual.
+   */
+  BasicNeuralNetwork<Scalar> * network;
   double maxValue;
   double minValue;
   int populationSize;
   int fitnessEvaluations;
-  std::vector<Individual> population;
+  AlignedVector<Scalar> weights;
+  ParameterVector stepSizes;
+  std::vector<double> fitness;
+  std::vector<int> wins;
+  std::vector<int> ranking;
+  std::vector<int> opponents;
   int dim;
+
+  // Racing: the dataset is scored in blocks taken in a shuffled order. Each candidate
+  // slot keeps the cost summed over the first scoredBlocks blocks, so an individual which
+  // was dropped from a race and still selected carries on where it stopped.
+  bool racing;
+  double raceFraction;
+  double raceConfidence;
+  std::vector<int> blockOrder;
+  std::vector<int64_t> blockRows; // Rows in the first k blocks of blockOrder
+  std::vector<double> partialCost;
+  std::vector<double> partialSquares; // Sum of the squared mean costs of the blocks scored
+  std::vector<int> scoredBlocks;
+  std::vector<char> dropped;
+  std::vector<int> racers;
+  std::vector<double> exactFitness;
+  int raceTarget; // Blocks every racer is scored up to in the current round
+  int raceRows; // Size of the dataset the partial costs were scored on
+  int64_t samplesSaved;
   int opponentNumber;
+  std::unique_ptr<ThreadPool> pool;
+  std::default_random_engine generator;
+  Philox mutations; // Keyed once per run; counters are (weight pair, parent rank, generation)
+  double generationStep; // The normal deviate shared by every step size of a generation
+  unsigned seed;
+  bool fixedSeed;
+  int generation;
+  bool resumed;
+
+  std::string checkpointPath;
+  int checkpointInterval;
+  std::vector<char> snapshot;
+  std::unique_ptr<CheckpointWriter> checkpoints;
+  std::function<void(const FEPProgress&)> progress;
+  int migrationInterval;
+  std::function<void(BasicEvolutionaryProgramming&)> migration;
 
   void generatePopulation();
   void spawnOffspring();
-  double evaluateFitness(const std::vector<boost::numeric::ublas::vector<double> > input, const std::vector<boost::numeric::ublas::vector<double> > expected);
+  void mutate(const int parent);
+  double evaluateFitness(const DatasetView &data);
+  double raceFitness(const DatasetView &data);
+  void prepareRace(const DatasetView &data);
   void tournamentSelection();
+  void writeCheckpoint();
+  void reportProgress();
 
 public:
-  EvolutionaryProgramming(NeuralNetwork * _net, double minVal, double maxVal, int popSize, int opNum = 10):
+  BasicEvolutionaryProgramming(BasicNeuralNetwork<Scalar> * _net, double minVal, double maxVal, int popSize, int opNum = 10):
       network(_net), minValue(minVal), maxValue(maxVal), populationSize(popSize), opponentNumber(opNum),
-      fitnessEvaluations(0), dim(0) {
+      fitnessEvaluations(0), dim(network->getParameterSize()), generationStep(0.0), seed(0), fixedSeed(false), generation(0), resumed(false),
+      checkpointInterval(0), migrationInterval(0), racing(false), raceFraction(1.0/16), raceConfidence(3.0), raceTarget(0), raceRows(0), samplesSaved(0) {}
+
+  // Use a fixed seed for the population and its mutations instead of a time-based one.
+  void setSeed(const unsigned _seed) {
+    seed = _seed;
+    fixedSeed = true;
+  }
 
-    // Work out the dimensionality of the weights
-    auto weights = network->getWeights();
+  // Score the candidates of each generation by racing: every candidate not yet fully scored
+  // is scored on a first share (fraction) of the dataset, then on twice as much, and so on.
+  // After each round the bar is the cost of the populationSize-th best fully scored
+  // candidate, and a candidate is dropped once it cannot get under the bar: either its
+  // cost so far already exceeds the bar (certain, as the cost of a sample is never negative
+  // for labels in [0, 1]), or its mean cost so far exceeds the bar by more than confidence
+  // standard errors (estimated from the spread of its cost between blocks of the dataset).
+  // A dropped candidate keeps its mean cost so far as its fitness. The parents keep their
+  // exact fitness and are not scored again, so only the candidates scored in a generation
+  // count towards maxFitnessEval (without racing every candidate is scored).
+  void setRacing(const bool enable, const double fraction = 1.0/16, const double confidence = 3.0) {
+    racing = enable;
+    raceFraction = std::min(std::max(fraction, 0.0), 1.0);
+    raceConfidence = std::max(confidence, 0.0);
+  }
 
-    for (auto w : weights) {
-      for_each(w.begin1(), w.end1(), [this] (double &val) {
-        dim++;
-      });
+  // Number of sample evaluations racing has skipped by dropping candidates: the rows the
+  // candidates dropped were never scored on. Parents which are not scored again are not
+  // counted, as reusing their fitness does not depend on racing.
+  int64_t getSamplesSaved() const {
+    return samplesSaved;
+  }
+
+  // Write a checkpoint to path every interval generations (0 disables checkpoints). The
+  // population is copied at the end of the generation and written by a background thread;
+  // train does not return until the last checkpoint is on disk.
+  void setCheckpoint(const std::string &path, const int interval) {
+    checkpointPath = path;
+    checkpointInterval = std::max(interval, 0);
+    if (checkpointInterval > 0 && !checkpoints) {
+      checkpoints.reset(new CheckpointWriter());
     }
   }
 
-  void train(const std::vector<boost::numeric::ublas::vector<double> > input, const std::vector<boost::numeric::ublas::vector<double> > expected, int maxFitnessEval = 100000);
+  // Call callback after every generation with the fitness and step size statistics of the
+  // population (an empty function disables it). With telemetry built in they are also
+  // recorded as trace counters.
+  void setProgress(const std::function<void(const FEPProgress&)> &callback) {
+    progress = callback;
+  }
+
+  // Call exchange every interval generations, after selection, so the population can trade
+  // members with other populations through emigrate and immigrate (see island.h). An
+  // interval of 0 disables migration.
+  void setMigration(const int interval, const std::function<void(BasicEvolutionaryProgramming&)> &exchange) {
+    migrationInterval = std::max(interval, 0);
+    migration = exchange;
+  }
+
+  // Copy the weights, step sizes and fitness of the count fittest members of the population
+  // (count at most the population size) into the given arrays, member k at weights[k*dim ...].
+  void emigrate(const int count, Scalar *weights, double *stepSizes, double *fitness);
+
+  // Replace the count least fit members of the population with the given individuals,
+  // laid out as for emigrate.
+  void immigrate(const int count, const Scalar *weights, const double *stepSizes, const double *fitness);
+
+  int getPopulationSize() const {
+    return populationSize;
+  }
+
+  int getGeneration() const {
+    return generation;
+  }
+
+  // Restore the population and the training state from a checkpoint, so the next call to
+  // train continues the interrupted run, which must use the same dataset (with racing,
+  // partial costs are only discarded if its size differs). Returns false if the checkpoint
+  // cannot be read or does not fit the network and population size.
+  bool resume(const std::string &path);
+
+  // Mutate and score the members of the population concurrently on the given number of threads.
+  void setThreads(const int threads) {
+    pool.reset(threads > 1 ? new ThreadPool(threads) : nullptr);
+  }
+
+  void train(const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected, int maxFitnessEval = 100000);
+  void train(const DatasetView &data, int maxFitnessEval = 100000);
 };
 
+typedef BasicEvolutionaryProgramming<double> EvolutionaryProgramming;
+typedef BasicEvolutionaryProgramming<float> FloatEvolutionaryProgramming;
+
 #endif
@@ -1,97 +1,390 @@
 #include "gradient.h"
+#include <cmath>
+#include <limits>
+#include <sstream>
 
-void StochasticGradientDescent::train(const std::vector<boost::numeric::ublas::vector<double>> input, const std::vector<boost::numeric::ublas::vector<double> > expected, const double minCost, const int batchSize) {
+template <typename Scalar>
+void BasicStochasticGradientDescent<Scalar>::batchGradient(const DatasetView &data, const std::vector<int> &batch,
+                                                           const typename BasicBatchPrefetcher<Scalar>::Batch *gathered) {
   /*
-   * This function trains a network using SGD: we reduce the cost function until the
-   * desired accuracy or the maximum number of itterations is reached.
+   * Calculate the gradient summed over the samples of a mini-batch. When a thread pool
+   * is available the batch is split into contiguous slices, one per thread, and every
+   * thread gathers and back propogates its slice into its own buffers. A batch already
+   * gathered by the prefetcher (split into the same slices) is used as it is.
    */
+  const int slices = pool ? std::min<int>(pool->size(), batch.size()) : 1;
+
+  if (sliceInput.size() != slices) {
+    sliceInput.resize(slices);
+    sliceExpected.resize(slices);
+    sliceGradient.resize(slices);
+    sliceWorkspace.resize(slices);
+    sliceLoss.resize(slices);
+  }
 
-  unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-  std::default_random_engine generator (seed);
-  std::uniform_int_distribution<int> distribution(0, input.size() - 1);
+  // The batch cost is only needed for the moving average convergence check
+  const bool findLoss = lossSmoothing > 0.0;
+
+  gradient.resize(network->getParameterSize());
+  std::mutex gradientLock;
+
+  if (!deterministic && slices > 1) {
+    std::fill(gradient.begin(), gradient.end(), Scalar(0));
+  }
 
-  int select;
-  int itt = 0;
-  double J = network->cost(input, expected);
+  auto work = [&] (int t) {
+    const int begin = t * batch.size() / slices;
+    const int end = (t + 1) * batch.size() / slices;
 
-  while (J > minCost && itt < maxItterations) {
+    if (!gathered && sliceInput[t].size1() != end - begin) {
+      sliceInput[t].resize(end - begin, network->getInputSize(), false);
+      sliceExpected[t].resize(end - begin, network->getOutputSize(), false);
+    }
+
+    if (!gathered) {
+      data.gather(&batch[begin], end - begin, sliceInput[t], sliceExpected[t]);
+    }
+
+    const auto &in = gathered ? gathered->input[t] : sliceInput[t];
+    const auto &out = gathered ? gathered->expected[t] : sliceExpected[t];
+
+    // A single slice is written straight into the batch gradient
+    if (slices == 1) {
+      network->backPropogateBatch(in, out, gradient, sliceWorkspace[t], findLoss ? &sliceLoss[t] : nullptr);
+      return;
+    }
 
-    auto weights = network->getWeights();
+    sliceGradient[t].resize(gradient.size());
+    network->backPropogateBatch(in, out, sliceGradient[t], sliceWorkspace[t], findLoss ? &sliceLoss[t] : nullptr);
 
-    // If we are using the momentum strategy construct a velocity vector with
-    // the same dimensions as the weights
-    if (velocity.size() > 0 && enableMomentum) {
-      for (int k = 0; k < velocity.size(); ++k) {
-        velocity[k] = momentum*velocity[k];
+    // Without the deterministic flag each slice is added to the total as soon as it is ready
+    if (!deterministic) {
+      std::unique_lock<std::mutex> guard(gradientLock);
+      for (int j = 0; j < gradient.size(); ++j) {
+        gradient[j] += sliceGradient[t][j];
       }
-    } else if (enableMomentum) {
-      for (int i = 0; i < weights.size(); ++i) {
-        velocity.push_back(boost::numeric::ublas::matrix<double>(weights[i].size1(), weights[i].size2(), 0.0));
+    }
+  };
+
+  if (slices > 1) {
+    // Passed by reference so wrapping the closure in a std::function does not allocate
+    pool->run(slices, std::ref(work));
+  } else {
+    work(0);
+  }
+
+  if (deterministic && slices > 1) {
+    // Combine the slices in a fixed order so the floating point sums are reproducible
+    std::copy(sliceGradient[0].begin(), sliceGradient[0].end(), gradient.begin());
+    for (int t = 1; t < slices; ++t) {
+      for (int j = 0; j < gradient.size(); ++j) {
+        gradient[j] += sliceGradient[t][j];
       }
     }
+  }
 
-    // Add support for training a small subset of the data (minibatch)
-    if (batchSize > 1) {
+  if (findLoss) {
+    batchLoss = 0.0;
+    for (int t = 0; t < slices; ++t) {
+      batchLoss += sliceLoss[t];
+    }
+    batchLoss /= batch.size();
+  }
+}
+
+template <typename Scalar>
+void BasicStochasticGradientDescent<Scalar>::selectSamples(std::default_random_engine &generator, const int size, const int count, std::vector<int> &indices) {
+  /*
+   * Fill indices with count distinct samples chosen at random from a dataset of the given
+   * size. They are kept sorted as they are drawn, which finds repeats without a separate
+   * set, reuses the capacity of indices and means the samples are read in dataset order
+   * (keeping a mapped dataset's page accesses sequential).
+   */
+  std::uniform_int_distribution<int> distribution(0, size - 1);
+  indices.clear();
 
-      // We keep a record of the elements which have already been learnt.
-      std::unordered_set<int> seen;
+  while (indices.size() != count) {
 
-      // Return If the batchSize is larger than the dataset
-      if (batchSize > input.size()) {
-        return;
-      }
+    // Find an element which we haven't previously selected
+    const int select = distribution(generator);
+    auto position = std::lower_bound(indices.begin(), indices.end(), select);
+
+    if (position == indices.end() || *position != select) {
+      indices.insert(position, select);
+    }
+  }
+}
 
-      while (seen.size() != batchSize) {
+template <typename Scalar>
+void BasicStochasticGradientDescent<Scalar>::train(const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected, const double minCost, const int batchSize) {
+  train(DatasetView(input, expected), minCost, batchSize);
+}
 
-        // Find an element which we haven't previously trained
-        select = distribution(generator);
+template <typename Scalar>
+void BasicStochasticGradientDescent<Scalar>::train(const DatasetView &data, const double minCost, const int batchSize) {
+  /*
+   * This function trains a network using SGD: we reduce the cost function until the
+   * desired accuracy or the maximum number of itterations is reached.
+   */
 
-        while (seen.count(select)) {
-          select = distribution(generator);
-        }
+  // The dataset must match the shape of the network
+  if (data.getInputSize() != network->getInputSize() || data.getOutputSize() != network->getOutputSize()) {
+    return;
+  }
 
-        seen.insert(select);
-        auto derivative = network->backPropogateVector(input[select], expected[select]);
+  // A batch size of zero or one trains on a single randomly selected sample. A batch
+  // larger than the dataset runs on into the next epoch.
+  const int samples = std::max(batchSize, 1);
 
-        if (enableMomentum) {
-          for (int j = 0; j < weights.size(); ++j) {
-            velocity[j] += (trainingRate/batchSize)*derivative[j];
-          }
-        } else {
-          for (int j = 0; j < weights.size(); ++j) {
-            weights[j] = weights[j] - (trainingRate/batchSize)*derivative[j];
-          }
-        }
-      }
+  // The indices of the samples making up the current mini-batch
+  std::vector<int> batch;
+  batch.reserve(samples);
+
+  // A resumed run continues with the state restored from its checkpoint
+  const bool sampled = checkSamples > 0 && checkSamples < data.size();
+  if (!resumed) {
+    generator.seed(fixedSeed ? seed : std::chrono::system_clock::now().time_since_epoch().count());
+    itteration = 0;
+
+    // Fails if the strata or sample weights do not match the dataset
+    if (!sampler.reset(data.size())) {
+      return;
+    }
+
+    // Convergence is checked on a fixed subsample when one is configured
+    checkRows.clear();
+    if (sampled) {
+      selectSamples(generator, data.size(), checkSamples, checkRows);
+    }
+  }
 
+  if (mixedPrecision && (!resumed || master.size() != network->getParameterSize())) {
+    master.assign(network->getParameters().begin(), network->getParameters().end());
+  }
+
+  // The optimizer keeps its state between calls to train, until it is replaced
+  if (mixedPrecision && !masterOptimizer) {
+    masterOptimizer = createOptimizer<double>(settings);
+  }
+  if (!mixedPrecision && !optimizer) {
+    optimizer = createOptimizer<Scalar>(settings);
+  }
+
+  // The subsample is gathered once
+  if (sampled && checkRows.size() == checkSamples) {
+    checkInput.resize(checkSamples, data.getInputSize(), false);
+    checkExpected.resize(checkSamples, data.getOutputSize(), false);
+    data.gather(checkRows.data(), checkSamples, checkInput, checkExpected);
+  }
+  const DatasetView checkData = sampled ? DatasetView(checkInput, checkExpected) : data;
+
+  double J = resumed ? currentCost : network->cost(checkData, pool.get());
+
+  // A resumed run continues with the batch drawn before its checkpoint, unless the batch size differs
+  if (!resumed || nextRows.size() != samples || sampler.size() != data.size()) {
+    if (sampler.size() != data.size() && !sampler.reset(data.size())) {
+      return;
+    }
+    sampler.next(generator, samples, nextRows);
+  }
+  resumed = false;
+
+  const int slices = pool ? std::min(pool->size(), samples) : 1;
+
+  // Momentum can move a weight with no gradient, so pruned weights are zeroed after every update
+  const bool masked = pruningMask.size() == network->getParameterSize();
+  if (prefetcher) {
+    prefetcher->submit(data, nextRows, slices);
+  }
+
+  while (J > minCost && itteration < maxItterations) {
+
+    // Draw the following batch, and with prefetching start gathering it while this one is trained on
+    batch.swap(nextRows);
+    sampler.next(generator, samples, nextRows);
+
+    if (prefetcher) {
+      const auto &gathered = prefetcher->take();
+      prefetcher->submit(data, nextRows, slices);
+      batchGradient(data, batch, &gathered);
     } else {
-      // We randomly select an element from the dataset for training.
-      select = distribution(generator);
+      batchGradient(data, batch, nullptr);
+    }
+
+    // The weights are updated in place in the network's parameter buffer, or in the
+    // master copy which is then rounded into it
+    Span<Scalar> weights = network->getParameters();
+    const double rate = trainingRate * schedule.multiplier(itteration, maxItterations);
 
-      auto weights = network->getWeights();
-      auto derivative = network->backPropogateVector(input[select], expected[select]);
+    // Norm of the mean gradient of the mini-batch
+    const bool report = progress || telemetryEnabled;
+    double gradientNorm = 0.0;
+    if (report) {
+      for (const Scalar g : gradient) {
+        gradientNorm += static_cast<double>(g) * g;
+      }
+      gradientNorm = std::sqrt(gradientNorm) / samples;
+    }
 
-      if (enableMomentum) {
-        for (int j = 0; j < weights.size(); ++j) {
-          velocity[j] += (trainingRate/batchSize)*derivative[j];
+    {
+      ML_TRACE_SCOPE("update");
+      if (masked) {
+        for (int i = 0; i < gradient.size(); ++i) {
+          gradient[i] = pruningMask[i] ? gradient[i] : 0;
+        }
+      }
+      if (mixedPrecision) {
+        masterOptimizer->update(master.data(), gradient.data(), gradient.size(), rate, 1.0 / samples);
+        if (masked) {
+          for (int i = 0; i < master.size(); ++i) {
+            master[i] = pruningMask[i] ? master[i] : 0.0;
+          }
         }
+        std::copy(master.begin(), master.end(), weights.begin());
       } else {
-        for (int i = 0; i < weights.size(); ++i) {
-          weights[i] = weights[i] - trainingRate*derivative[i];
+        optimizer->update(weights.data(), gradient.data(), gradient.size(), rate, 1.0 / samples);
+        if (masked) {
+          for (int i = 0; i < weights.size(); ++i) {
+            weights[i] = pruningMask[i] ? weights[i] : 0;
+          }
         }
       }
+    }
+
+    itteration++;
 
+    if (lossSmoothing > 0.0) {
+      J = (1.0 - lossSmoothing)*J + lossSmoothing*batchLoss;
+    } else if (itteration % checkInterval == 0) {
+      J = network->cost(checkData, pool.get());
     }
 
-    if (enableMomentum) {
-      for (int i = 0; i < weights.size(); ++i) {
-        weights[i] = weights[i] - velocity[i];
+    if (report) {
+      SGDProgress current;
+      current.itteration = itteration;
+      current.cost = J;
+      current.batchLoss = lossSmoothing > 0.0 ? batchLoss : std::numeric_limits<double>::quiet_NaN();
+      current.gradientNorm = gradientNorm;
+
+      ML_TRACE_COUNTER("cost", current.cost);
+      ML_TRACE_COUNTER("gradient norm", current.gradientNorm);
+      if (progress) {
+        progress(current);
       }
-      network->setWeights(weights);
-    } else {
-      network->setWeights(weights);
     }
-    J = network->cost(input, expected);
-    itt++;
+
+    if (checkpointInterval > 0 && itteration % checkpointInterval == 0) {
+      currentCost = J;
+      writeCheckpoint();
+    }
+  }
+
+  if (prefetcher) {
+    prefetcher->wait();
+  }
+
+  if (checkpoints) {
+    checkpoints->wait();
   }
 }
+
+template <typename Scalar>
+void BasicStochasticGradientDescent<Scalar>::writeCheckpoint() {
+  /*
+   * Copy the training state into the snapshot buffer (reused between checkpoints) and
+   * hand it to the background writer.
+   */
+  SnapshotWriter out(snapshot, SGD_CHECKPOINT);
+  out.value(static_cast<uint32_t>(sizeof(Scalar)));
+  out.value(itteration);
+  out.value(currentCost);
+
+  std::ostringstream engine;
+  engine << generator;
+  out.string(engine.str());
+
+  out.array(checkRows.data(), checkRows.size());
+  sampler.save(out);
+  out.array(nextRows.data(), nextRows.size());
+  out.array(network->getParameters().data(), network->getParameterSize());
+  out.array(master.data(), mixedPrecision ? master.size() : 0);
+  if (mixedPrecision) {
+    masterOptimizer->save(out);
+  } else {
+    optimizer->save(out);
+  }
+
+  checkpoints->submit(checkpointPath, snapshot);
+}
+
+template <typename Scalar>
+bool BasicStochasticGradientDescent<Scalar>::resume(const std::string &path) {
+  /*
+   * Everything is read into temporaries first, so a bad checkpoint changes nothing.
+   */
+  std::vector<char> buffer;
+  if (!readCheckpoint(path, buffer)) {
+    return false;
+  }
+
+  SnapshotReader in(buffer, SGD_CHECKPOINT);
+  uint32_t scalarSize = 0;
+  int savedItteration = 0;
+  double savedCost = 0.0;
+  std::string engine;
+  std::vector<int> savedRows;
+  AlignedVector<Scalar> weights;
+  ParameterVector savedMaster;
+
+  in.value(scalarSize);
+  in.value(savedItteration);
+  in.value(savedCost);
+  in.string(engine);
+  in.array(savedRows);
+
+  BatchSampler savedSampler(sampler);
+  std::vector<int> savedNext;
+  const bool sampling = savedSampler.load(in);
+  in.array(savedNext);
+  in.array(weights);
+  in.array(savedMaster);
+
+  // The optimizer state is restored into a new optimizer with the current settings
+  const bool savedMixed = !savedMaster.empty();
+  std::unique_ptr<BasicOptimizer<Scalar> > savedOptimizer;
+  std::unique_ptr<BasicOptimizer<double> > savedMasterOptimizer;
+  bool optimizing = false;
+  if (savedMixed) {
+    savedMasterOptimizer = createOptimizer<double>(settings);
+    optimizing = savedMasterOptimizer->load(in);
+  } else {
+    savedOptimizer = createOptimizer<Scalar>(settings);
+    optimizing = savedOptimizer->load(in);
+  }
+
+  std::istringstream engineStream(engine);
+  std::default_random_engine savedGenerator;
+  engineStream >> savedGenerator;
+
+  if (!in.good() || !sampling || !optimizing || engineStream.fail() || scalarSize != sizeof(Scalar) ||
+      weights.size() != network->getParameterSize() || (savedMixed && savedMaster.size() != weights.size())) {
+    return false;
+  }
+
+  network->setParameters(weights);
+  itteration = savedItteration;
+  currentCost = savedCost;
+  generator = savedGenerator;
+  checkRows.swap(savedRows);
+  sampler = savedSampler;
+  nextRows.swap(savedNext);
+  master.swap(savedMaster);
+  optimizer.swap(savedOptimizer);
+  masterOptimizer.swap(savedMasterOptimizer);
+  mixedPrecision = savedMixed;
+  resumed = true;
+  return true;
+}
+
+template class BasicStochasticGradientDescent<double>;
+template class BasicStochasticGradientDescent<float>;
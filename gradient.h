@@ -5,24 +5,211 @@
  * A class which implements Stochastic Gradient Descent.
  * Features:
  * - Specify number of samples to train per time-step.
- * - Momentum strategy implemented allowing for faster convergence.
+ * - Mini-batches drawn from a shuffled permutation every epoch (or stratified by class,
+ *   or weighted), optionally gathered on a background thread ahead of time.
+ * - Momentum strategy implemented allowing for faster convergence, or any of the fused
+ *   update rules of optimizer.h (Nesterov, AdaGrad, RMSProp, Adam), with learning rate schedules.
+ * - Data-parallel training: each mini-batch can be split across a pool of threads.
+ * - Streaming training from memory-mapped datasets larger than memory.
+ * - Configurable convergence checks: the full cost every K steps, the cost of a fixed
+ *   subsample, or a moving average of the mini-batch losses found during back propogation.
+ * - Single precision networks, optionally in mixed precision: a double master copy of the
+ *   weights receives the updates while the forward and backward passes run in float.
+ * - Pruned weights held at zero while the rest are retrained.
+ * - Periodic checkpoints written in the background, from which an interrupted run resumes
+ *   exactly where it stopped (weights, momentum, itteration count and random state).
+ * - A progress callback after every itteration (cost, mini-batch loss, gradient norm), and
+ *   trace timers around the update when built with ML_TELEMETRY.
  */
 
  #include "network.h"
- #include <unordered_set>
+ #include "threadpool.h"
+ #include "checkpoint.h"
+ #include "telemetry.h"
+ #include "sampler.h"
+ #include "optimizer.h"
+ #include <algorithm>
+ #include <functional>
+ #include <random>
+ #include <type_traits>
 
-class StochasticGradientDescent {
-  NeuralNetwork * network;
+template <typename Scalar>
+class BasicStochasticGradientDescent {
+  BasicNeuralNetwork<Scalar> * network;
   double trainingRate;
   int maxItterations;
-  std::vector<boost::numeric::ublas::matrix<double> > velocity;
-  double momentum;
-  bool enableMomentum;
+  AlignedVector<Scalar> gradient; // Gradient summed over the current mini-batch
+  bool mixedPrecision;
+  ParameterVector master; // Double precision weights used in mixed precision
+  OptimizerSettings settings;
+  LearningRateSchedule schedule;
+  std::unique_ptr<BasicOptimizer<Scalar> > optimizer; // Created when training starts, with the settings
+  std::unique_ptr<BasicOptimizer<double> > masterOptimizer; // Its counterpart for the master weights
+  std::vector<char> pruningMask; // Weights held at zero, where it is 0
+  unsigned seed;
+  bool fixedSeed;
+  bool deterministic;
+  std::unique_ptr<ThreadPool> pool;
+  int checkInterval;
+  int checkSamples;
+  double lossSmoothing;
+  double batchLoss; // Mean cost of the current mini-batch (only found when smoothing losses)
+
+  // Per-thread buffers holding each worker's slice of the current mini-batch
+  std::vector<boost::numeric::ublas::matrix<Scalar> > sliceInput;
+  std::vector<boost::numeric::ublas::matrix<Scalar> > sliceExpected;
+  std::vector<AlignedVector<Scalar> > sliceGradient;
+  std::vector<BasicTrainingWorkspace<Scalar> > sliceWorkspace;
+  std::vector<double> sliceLoss;
+
+  // State of the current training run, kept between calls so it can be checkpointed
+  std::default_random_engine generator;
+  BatchSampler sampler;
+  std::vector<int> nextRows; // The mini-batch after the current one, drawn a step ahead so it can be prefetched
+  int itteration;
+  double currentCost; // The cost last used for the convergence check
+  std::vector<int> checkRows;
+  bool resumed;
+
+  std::string checkpointPath;
+  int checkpointInterval;
+  std::vector<char> snapshot;
+  std::unique_ptr<CheckpointWriter> checkpoints;
+  std::function<void(const SGDProgress&)> progress;
+  std::unique_ptr<BasicBatchPrefetcher<Scalar> > prefetcher;
+
+  // The subsample used for convergence checks
+  boost::numeric::ublas::matrix<Scalar> checkInput;
+  boost::numeric::ublas::matrix<Scalar> checkExpected;
+
+  void selectSamples(std::default_random_engine &generator, const int size, const int count, std::vector<int> &indices);
+  void batchGradient(const DatasetView &data, const std::vector<int> &batch, const typename BasicBatchPrefetcher<Scalar>::Batch *gathered);
+  void writeCheckpoint();
+
 public:
-  StochasticGradientDescent(NeuralNetwork * _net, const double rate = 0.01, const int _max = 20000, const double _momentum = 0.9, const bool _enableMomentum = true):
-    network(_net), trainingRate(rate), maxItterations(_max), momentum(_momentum), enableMomentum(_enableMomentum) {}
+  BasicStochasticGradientDescent(BasicNeuralNetwork<Scalar> * _net, const double rate = 0.01, const int _max = 20000, const double _momentum = 0.9, const bool _enableMomentum = true):
+    network(_net), trainingRate(rate), maxItterations(_max), mixedPrecision(false), settings(OptimizerSettings::sgd(_enableMomentum ? _momentum : 0.0)),
+    seed(0), fixedSeed(false), deterministic(false), checkInterval(1), checkSamples(0), lossSmoothing(0.0), batchLoss(0.0),
+    itteration(0), currentCost(0.0), resumed(false), checkpointInterval(0) {}
+
+  // Use a fixed seed for selecting mini-batches instead of a time-based one.
+  void setSeed(const unsigned _seed) {
+    seed = _seed;
+    fixedSeed = true;
+  }
+
+  // Split every mini-batch across the given number of threads. In deterministic mode the
+  // per-thread gradients are combined in thread order, so a fixed seed and thread count
+  // give bit-reproducible results; otherwise they are combined as the threads finish.
+  void setThreads(const int threads, const bool _deterministic = false) {
+    pool.reset(threads > 1 ? new ThreadPool(threads) : nullptr);
+    deterministic = _deterministic;
+  }
+
+  // Evaluate the cost for the convergence check only every interval steps (by default every step).
+  void setCheckInterval(const int interval) {
+    checkInterval = std::max(interval, 1);
+  }
+
+  // Evaluate the cost for the convergence check on a fixed random subsample of this many
+  // samples, chosen when training starts (0 uses the whole dataset).
+  void setCheckSubsample(const int samples) {
+    checkSamples = std::max(samples, 0);
+  }
+
+  // Check convergence against an exponential moving average of the mini-batch costs found
+  // during back propogation, J = (1 - smoothing)J + smoothing*batchCost, instead of evaluating
+  // the cost separately (0 disables it). The moving average starts from the initial cost.
+  void setLossSmoothing(const double smoothing) {
+    lossSmoothing = std::min(std::max(smoothing, 0.0), 1.0);
+  }
+
+  // Keep a double precision master copy of a single precision network's weights, which is
+  // copied from the network when training starts and rounded back into it after every
+  // step. Small updates then accumulate instead of being lost to float rounding.
+  // Networks of doubles are always trained in double.
+  void setMixedPrecision(const bool enable) {
+    mixedPrecision = enable && !std::is_same<Scalar, double>::value;
+  }
+
+  // Write a checkpoint to path every interval itterations (0 disables checkpoints). The
+  // state is copied at the end of the itteration and written by a background thread;
+  // train does not return until the last checkpoint is on disk.
+  void setCheckpoint(const std::string &path, const int interval) {
+    checkpointPath = path;
+    checkpointInterval = std::max(interval, 0);
+    if (checkpointInterval > 0 && !checkpoints) {
+      checkpoints.reset(new CheckpointWriter());
+    }
+  }
 
-  void train(const std::vector<boost::numeric::ublas::vector<double> > input, const std::vector<boost::numeric::ublas::vector<double> > expected, const double minCost, const int batchSize = 0);
+  // Use another update rule (see optimizer.h) instead of the momentum given to the
+  // constructor. The state of the previous rule (e.g. its velocity) is discarded.
+  void setOptimizer(const OptimizerSettings &_settings) {
+    settings = _settings;
+    optimizer.reset();
+    masterOptimizer.reset();
+  }
+
+  // Hold the weights whose entry of mask is 0 at zero (see sparse.h): their gradient is
+  // dropped and they are zeroed again after every update. An empty mask trains every weight.
+  void setPruningMask(const std::vector<char> &mask) {
+    pruningMask = mask;
+  }
+
+  // Scale the training rate over the maximum number of itterations.
+  void setSchedule(const LearningRateSchedule &_schedule) {
+    schedule = _schedule;
+  }
+
+  // Draw every mini-batch with the same proportion of each class as the dataset, given
+  // the class of every sample (see BatchSampler::labelClasses).
+  void setStrata(const std::vector<int> &strata) {
+    sampler.setStrata(strata);
+  }
+
+  // Draw the samples of every mini-batch with replacement, with probability proportional
+  // to the given weight of each sample. Returns false if no weight is positive.
+  bool setSampleWeights(const std::vector<double> &weights) {
+    return sampler.setWeights(weights);
+  }
+
+  // Draw mini-batches uniformly from a permutation shuffled every epoch (the default).
+  void setUniformSampling() {
+    sampler.setUniform();
+  }
+
+  // Gather the next mini-batch on a background thread while the current one is trained
+  // on. The mini-batches, and so the results, are the same either way.
+  void setPrefetch(const bool enable) {
+    prefetcher.reset(enable ? new BasicBatchPrefetcher<Scalar>() : nullptr);
+  }
+
+  // Number of passes over the dataset made by the current (or last) training run
+  double getEpoch() const {
+    return sampler.getEpoch();
+  }
+
+  // Call callback after every itteration with the progress of the run (an empty function
+  // disables it). The gradient norm is only computed when a callback is set or telemetry
+  // is built in, in which case the progress is also recorded as trace counters.
+  void setProgress(const std::function<void(const SGDProgress&)> &callback) {
+    progress = callback;
+  }
+
+  // Restore the network's weights and the training state from a checkpoint, so the next
+  // call to train continues the interrupted run (which must use the same data, batch size
+  // and settings). Returns false if the checkpoint cannot be read or does not fit the network.
+  bool resume(const std::string &path);
+
+  void train(const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected, const double minCost, const int batchSize = 0);
+
+  // Train on any dataset view; only the samples of each mini-batch are read (so a
+  // memory-mapped dataset is streamed from disk).
+  void train(const DatasetView &data, const double minCost, const int batchSize = 0);
 };
 
+typedef BasicStochasticGradientDescent<double> StochasticGradientDescent;
+typedef BasicStochasticGradientDescent<float> FloatStochasticGradientDescent;
+
 #endif
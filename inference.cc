@@ -0,0 +1,139 @@
+#include "inference.h"
+#include <algorithm>
+
+template <typename Scalar>
+BasicInferenceServer<Scalar>::BasicInferenceServer(const BasicNeuralNetwork<Scalar> &_network, const int _maxBatch, const int maxWaitMicroseconds,
+                                                   const int threads, const int capacity):
+  network(_network), maxBatch(std::max(_maxBatch, 1)), maxWait(std::max(maxWaitMicroseconds, 0)),
+  head(0), pending(0), stopping(false), batches(0), served(0) {
+  const int workerCount = std::max(threads, 1);
+  const int slots = capacity > 0 ? std::max(capacity, maxBatch) : 4 * maxBatch * workerCount;
+
+  requests.resize(slots);
+  inputs.resize(static_cast<std::size_t>(slots) * network.getInputSize());
+
+  for (int i = 0; i < workerCount; ++i) {
+    workers.push_back(std::thread(&BasicInferenceServer<Scalar>::workerLoop, this));
+  }
+}
+
+template <typename Scalar>
+BasicInferenceServer<Scalar>::~BasicInferenceServer() {
+  /*
+   * Requests already queued are still served before the workers exit.
+   */
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    stopping = true;
+  }
+  ready.notify_all();
+  space.notify_all();
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+template <typename Scalar>
+std::future<typename BasicInferenceServer<Scalar>::Vector> BasicInferenceServer<Scalar>::submit(const Vector &input) {
+  /*
+   * Copy the input into the next free slot. Workers are only woken when a request
+   * arrives at an empty queue (to start its wait) or completes a batch.
+   */
+  std::promise<Vector> result;
+  std::future<Vector> future = result.get_future();
+
+  if (input.size() != network.getInputSize()) {
+    result.set_value(Vector());
+    return future;
+  }
+
+  std::unique_lock<std::mutex> guard(lock);
+  space.wait(guard, [this] { return pending < requests.size() || stopping; });
+
+  if (stopping) {
+    guard.unlock();
+    result.set_value(Vector());
+    return future;
+  }
+
+  const int slot = (head + pending) % requests.size();
+  std::copy(input.begin(), input.end(), inputs.begin() + static_cast<std::size_t>(slot) * input.size());
+  requests[slot].result = std::move(result);
+  requests[slot].arrival = std::chrono::steady_clock::now();
+  pending++;
+
+  const bool wake = pending == 1 || pending % maxBatch == 0;
+  guard.unlock();
+  if (wake) {
+    ready.notify_one();
+  }
+
+  return future;
+}
+
+template <typename Scalar>
+void BasicInferenceServer<Scalar>::workerLoop() {
+  /*
+   * Wait for a request, then for either a full batch or the oldest request's deadline.
+   * The batch is copied out of the ring under the lock and run without it, so other
+   * workers can form the next batch meanwhile.
+   */
+  const int inputSize = network.getInputSize();
+  const int outputSize = network.getOutputSize();
+
+  AlignedVector<Scalar> batchInput(static_cast<std::size_t>(maxBatch) * inputSize);
+  AlignedVector<Scalar> batchOutput(static_cast<std::size_t>(maxBatch) * outputSize);
+  std::vector<std::promise<Vector> > results(maxBatch);
+  BasicTrainingWorkspace<Scalar> workspace;
+
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    ready.wait(guard, [this] { return pending > 0 || stopping; });
+    if (pending == 0) {
+      return;
+    }
+
+    const auto deadline = requests[head].arrival + maxWait;
+    ready.wait_until(guard, deadline, [this] { return pending >= maxBatch || stopping; });
+
+    // Another worker may have taken the requests while this one waited
+    const int count = std::min(pending, maxBatch);
+    if (count == 0) {
+      continue;
+    }
+
+    for (int k = 0; k < count; ++k) {
+      const int slot = (head + k) % requests.size();
+      std::copy(inputs.begin() + static_cast<std::size_t>(slot) * inputSize, inputs.begin() + static_cast<std::size_t>(slot + 1) * inputSize,
+                batchInput.begin() + static_cast<std::size_t>(k) * inputSize);
+      results[k] = std::move(requests[slot].result);
+    }
+    head = (head + count) % requests.size();
+    pending -= count;
+
+    // Let another worker pick up any remaining requests
+    const bool more = pending > 0;
+    guard.unlock();
+    space.notify_all();
+    if (more) {
+      ready.notify_one();
+    }
+
+    network.feedForwardBatch(batchInput.data(), count, batchOutput.data(), workspace);
+
+    for (int k = 0; k < count; ++k) {
+      Vector output(outputSize);
+      std::copy(batchOutput.begin() + static_cast<std::size_t>(k) * outputSize, batchOutput.begin() + static_cast<std::size_t>(k + 1) * outputSize,
+                output.begin());
+      results[k].set_value(std::move(output));
+    }
+
+    guard.lock();
+    batches++;
+    served += count;
+  }
+}
+
+template class BasicInferenceServer<double>;
+template class BasicInferenceServer<float>;
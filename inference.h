@@ -0,0 +1,84 @@
+#ifndef INFERENCE_H_
+#define INFERENCE_H_
+
+/*
+ * An in-process inference engine for serving single-sample requests from many threads.
+ * Requests are queued and grouped into micro-batches: a worker runs a batch as soon as
+ * maxBatch requests are waiting, or once the oldest waiting request has waited maxWait
+ * microseconds, trading at most that much latency for the throughput of batched matrix
+ * products. Inputs are copied into a preallocated ring of request slots and batches run
+ * on buffers owned by each worker, so the only allocations per request are the future's
+ * shared state and the output vector it carries. When every slot is taken, submit blocks
+ * until a batch has been taken off the queue.
+ *
+ * The network is only read, and must outlive the server and not be modified while serving.
+ */
+
+#include "network.h"
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+
+template <typename Scalar>
+class BasicInferenceServer {
+public:
+  typedef boost::numeric::ublas::vector<double> Vector;
+
+private:
+  struct Request {
+    std::promise<Vector> result;
+    std::chrono::steady_clock::time_point arrival;
+  };
+
+  const BasicNeuralNetwork<Scalar> &network;
+  const int maxBatch;
+  const std::chrono::microseconds maxWait;
+
+  // Ring of request slots; the inputs of slot i are inputs[i*inputSize ...]
+  std::vector<Request> requests;
+  std::vector<double> inputs;
+  int head;
+  int pending;
+
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable ready; // Signalled when a batch may be ready or the server stops
+  std::condition_variable space; // Signalled when slots are freed
+  bool stopping;
+
+  long batches;
+  long served;
+
+  void workerLoop();
+
+public:
+  // capacity is the number of requests that may wait at once (0 gives four batches per worker)
+  BasicInferenceServer(const BasicNeuralNetwork<Scalar> &_network, const int _maxBatch = 32, const int maxWaitMicroseconds = 200,
+                       const int threads = 1, const int capacity = 0);
+  ~BasicInferenceServer();
+
+  BasicInferenceServer(const BasicInferenceServer&) = delete;
+  BasicInferenceServer& operator=(const BasicInferenceServer&) = delete;
+
+  // Queue a sample, returning a future for the network's output. An input of the wrong
+  // size (or one submitted while the server shuts down) gives an empty output.
+  std::future<Vector> submit(const Vector &input);
+
+  // Number of batches run and requests served so far
+  long getBatches() {
+    std::unique_lock<std::mutex> guard(lock);
+    return batches;
+  }
+
+  long getServed() {
+    std::unique_lock<std::mutex> guard(lock);
+    return served;
+  }
+};
+
+typedef BasicInferenceServer<double> InferenceServer;
+typedef BasicInferenceServer<float> FloatInferenceServer;
+
+#endif
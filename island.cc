@@ -0,0 +1,217 @@
+#include "island.h"
+#include "philox.h"
+#include <algorithm>
+#include <chrono>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+// Every block of the shared mapping starts on its own cache line
+std::size_t alignBlock(const std::size_t bytes) {
+  return (bytes + 63) & ~static_cast<std::size_t>(63);
+}
+
+}
+
+template <typename Scalar>
+void BasicIslandEvolution<Scalar>::layout() {
+  /*
+   * The mapping holds the barrier, then one mailbox per island (the fitness, step sizes
+   * and weights of its migrants) and one result per island (the fitness and weights of
+   * its fittest member).
+   */
+  mailboxOffset = alignBlock(sizeof(pthread_barrier_t));
+  mailboxSize = alignBlock(migrants * sizeof(double) + static_cast<std::size_t>(migrants) * dim * (sizeof(double) + sizeof(Scalar)));
+  resultOffset = mailboxOffset + islands * mailboxSize;
+  resultSize = alignBlock(sizeof(double) + dim * sizeof(Scalar));
+  mappingSize = resultOffset + islands * resultSize;
+}
+
+template <typename Scalar>
+void BasicIslandEvolution<Scalar>::runIsland(char *shared, const int island, const DatasetView &data, const int maxFitnessEval) {
+  /*
+   * Evolve one island in a worker process, exchanging migrants through the mailboxes.
+   */
+  pthread_barrier_t *barrier = reinterpret_cast<pthread_barrier_t*>(shared);
+  auto mailbox = [&] (const int i) { return reinterpret_cast<double*>(shared + mailboxOffset + i * mailboxSize); };
+
+  BasicEvolutionaryProgramming<Scalar> fep(network, minValue, maxValue, populationSize, opponentNumber);
+  fep.setSeed(seed + island);
+  fep.setThreads(threads);
+  fep.setRacing(racing, raceFraction, raceConfidence);
+
+  // Receive buffers, sized for every migrant of every other island
+  const int offered = topology == FULLY_CONNECTED ? (islands - 1) * migrants : migrants;
+  AlignedVector<Scalar> incoming(static_cast<std::size_t>(offered) * dim);
+  ParameterVector incomingSteps(static_cast<std::size_t>(offered) * dim);
+  std::vector<double> incomingFitness(offered);
+  std::vector<int> order(offered);
+  const Philox sources(seed);
+
+  // Copy migrant k of island source into slot to of the receive buffers
+  auto receive = [&] (const int source, const int k, const int to) {
+    const double *fitness = mailbox(source);
+    const double *steps = fitness + migrants;
+    const Scalar *weights = reinterpret_cast<const Scalar*>(steps + static_cast<std::size_t>(migrants) * dim);
+    std::copy(weights + static_cast<std::size_t>(k) * dim, weights + static_cast<std::size_t>(k + 1) * dim, incoming.begin() + static_cast<std::size_t>(to) * dim);
+    std::copy(steps + static_cast<std::size_t>(k) * dim, steps + static_cast<std::size_t>(k + 1) * dim, incomingSteps.begin() + static_cast<std::size_t>(to) * dim);
+    incomingFitness[to] = fitness[k];
+  };
+
+  fep.setMigration(islands > 1 && migrants > 0 ? migrationInterval : 0, [&] (BasicEvolutionaryProgramming<Scalar> &population) {
+    double *fitness = mailbox(island);
+    double *steps = fitness + migrants;
+    population.emigrate(migrants, reinterpret_cast<Scalar*>(steps + static_cast<std::size_t>(migrants) * dim), steps, fitness);
+
+    // Every mailbox is full once all islands reach the barrier
+    pthread_barrier_wait(barrier);
+
+    if (topology == FULLY_CONNECTED) {
+      // Take the fittest of all the migrants offered by the other islands
+      for (int k = 0; k < offered; ++k) {
+        order[k] = k;
+      }
+      std::partial_sort(order.begin(), order.begin() + migrants, order.end(), [&] (int i, int j) {
+        const double *a = mailbox((island + 1 + i / migrants) % islands);
+        const double *b = mailbox((island + 1 + j / migrants) % islands);
+        return a[i % migrants] < b[j % migrants];
+      });
+      for (int k = 0; k < migrants; ++k) {
+        receive((island + 1 + order[k] / migrants) % islands, order[k] % migrants, k);
+      }
+    } else {
+      int source = (island + islands - 1) % islands;
+      if (topology == RANDOM) {
+        uint32_t r[4];
+        sources(population.getGeneration(), island, 0, 0, r);
+        source = (island + 1 + r[0] % (islands - 1)) % islands;
+      }
+      for (int k = 0; k < migrants; ++k) {
+        receive(source, k, k);
+      }
+    }
+
+    // No mailbox is written again until every island has read its migrants
+    pthread_barrier_wait(barrier);
+
+    population.immigrate(migrants, incoming.data(), incomingSteps.data(), incomingFitness.data());
+  });
+
+  fep.train(data, maxFitnessEval);
+
+  // Training leaves the island's fittest member in (this process's copy of) the network
+  double *result = reinterpret_cast<double*>(shared + resultOffset + island * resultSize);
+  const Span<const Scalar> best = network->getParameters();
+  std::copy(best.begin(), best.end(), reinterpret_cast<Scalar*>(result + 1));
+  result[0] = network->cost(data);
+}
+
+template <typename Scalar>
+bool BasicIslandEvolution<Scalar>::train(const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected, int maxFitnessEval) {
+  return train(DatasetView(input, expected), maxFitnessEval);
+}
+
+template <typename Scalar>
+bool BasicIslandEvolution<Scalar>::train(const DatasetView &data, int maxFitnessEval) {
+  /*
+   * Fork a worker process per island and wait for all of them. If one fails, the others
+   * would wait for it at the next exchange forever, so they are killed.
+   */
+
+  // The dataset must match the shape of the network
+  if (data.getInputSize() != network->getInputSize() || data.getOutputSize() != network->getOutputSize()) {
+    return false;
+  }
+
+  layout();
+  void *memory = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    return false;
+  }
+  char *shared = static_cast<char*>(memory);
+
+  pthread_barrier_t *barrier = reinterpret_cast<pthread_barrier_t*>(shared);
+  pthread_barrierattr_t attributes;
+  pthread_barrierattr_init(&attributes);
+  pthread_barrierattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+  pthread_barrier_init(barrier, &attributes, islands);
+  pthread_barrierattr_destroy(&attributes);
+
+  if (!fixedSeed) {
+    seed = std::chrono::system_clock::now().time_since_epoch().count();
+  }
+
+  std::vector<pid_t> workers;
+  bool succeeded = true;
+
+  for (int i = 0; i < islands; ++i) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+      // Leave without running the parent's exit handlers or flushing its buffers again.
+      // An exception must not unwind into the caller's stack, which the child shares a
+      // copy of; failing instead makes the parent stop the other workers.
+      try {
+        runIsland(shared, i, data, maxFitnessEval);
+      } catch (...) {
+        _exit(1);
+      }
+      _exit(0);
+    }
+    if (pid < 0) {
+      succeeded = false;
+      break;
+    }
+    workers.push_back(pid);
+  }
+
+  // Reap the workers as they finish, stopping all of them at the first failure
+  std::vector<bool> running(workers.size(), true);
+  int remaining = workers.size();
+  while (remaining > 0) {
+    if (!succeeded) {
+      for (int i = 0; i < workers.size(); ++i) {
+        if (running[i]) {
+          kill(workers[i], SIGKILL);
+        }
+      }
+    }
+
+    bool reaped = false;
+    for (int i = 0; i < workers.size(); ++i) {
+      int status = 0;
+      if (running[i] && waitpid(workers[i], &status, WNOHANG) == workers[i]) {
+        running[i] = false;
+        remaining--;
+        reaped = true;
+        succeeded = succeeded && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+      }
+    }
+
+    if (!reaped) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  if (succeeded) {
+    int best = 0;
+    for (int i = 1; i < islands; ++i) {
+      if (*reinterpret_cast<double*>(shared + resultOffset + i * resultSize) < *reinterpret_cast<double*>(shared + resultOffset + best * resultSize)) {
+        best = i;
+      }
+    }
+    const Scalar *weights = reinterpret_cast<const Scalar*>(shared + resultOffset + best * resultSize + sizeof(double));
+    network->setParameters(Span<const Scalar>(weights, dim));
+  }
+
+  pthread_barrier_destroy(barrier);
+  munmap(memory, mappingSize);
+  return succeeded;
+}
+
+template class BasicIslandEvolution<double>;
+template class BasicIslandEvolution<float>;
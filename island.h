@@ -0,0 +1,105 @@
+#ifndef ISLAND_H_
+#define ISLAND_H_
+
+/*
+ * Island model Fast Evolutionary Programming. Each island is a separate worker process
+ * (forked from the caller) running its own population with EvolutionaryProgramming.
+ * Every few generations the islands stop together and send copies of their fittest
+ * members to their neighbours, which replace their least fit members with them:
+ * - RING:            island i receives from island i - 1,
+ * - FULLY_CONNECTED: every island receives the fittest migrants of all the others,
+ * - RANDOM:          every island receives from another island chosen afresh each time.
+ * Migrants travel through an anonymous shared memory mapping: each island writes its
+ * migrants into its own mailbox, and a process-shared barrier before and after the
+ * reads keeps the exchange in step. No files, sockets or services are needed, and with
+ * a fixed seed a run is reproducible.
+ *
+ * Each island spends its own budget of fitness evaluations, so N islands scale the
+ * work of a single population over N cores while keeping N separate populations, which
+ * keeps diversity higher than one population of N times the size.
+ */
+
+#include "evolution.h"
+#include <cstdint>
+
+enum MigrationTopology { RING = 0, FULLY_CONNECTED = 1, RANDOM = 2 };
+
+template <typename Scalar>
+class BasicIslandEvolution {
+private:
+  BasicNeuralNetwork<Scalar> * network;
+  double minValue;
+  double maxValue;
+  int populationSize;
+  int islands;
+  int opponentNumber;
+  int dim;
+  unsigned seed;
+  bool fixedSeed;
+  int threads;
+  bool racing;
+  double raceFraction;
+  double raceConfidence;
+
+  MigrationTopology topology;
+  int migrationInterval;
+  int migrants;
+
+  // Shared memory layout, in bytes from the start of the mapping
+  std::size_t mailboxOffset;
+  std::size_t mailboxSize;
+  std::size_t resultOffset;
+  std::size_t resultSize;
+  std::size_t mappingSize;
+
+  void layout();
+  void runIsland(char *shared, const int island, const DatasetView &data, const int maxFitnessEval);
+
+public:
+  BasicIslandEvolution(BasicNeuralNetwork<Scalar> * _net, double minVal, double maxVal, int popSize, int _islands, int opNum = 10):
+      network(_net), minValue(minVal), maxValue(maxVal), populationSize(popSize), islands(std::max(_islands, 1)),
+      opponentNumber(opNum), dim(network->getParameterSize()), seed(0), fixedSeed(false), threads(1), racing(false), raceFraction(1.0/16), raceConfidence(3.0), topology(RING),
+      migrationInterval(10), migrants(1) {}
+
+  // Use fixed seeds (seed + island) for the populations instead of time-based ones.
+  void setSeed(const unsigned _seed) {
+    seed = _seed;
+    fixedSeed = true;
+  }
+
+  // Send count migrants along the given topology every interval generations (an interval
+  // of 0 keeps the islands apart). The migrants replace as many of the receiving population.
+  void setMigration(const MigrationTopology _topology, const int interval, const int count) {
+    topology = _topology;
+    migrationInterval = std::max(interval, 0);
+    migrants = std::max(std::min(count, populationSize), 0);
+  }
+
+  // Score the members of each island's population on the given number of threads.
+  void setThreads(const int _threads) {
+    threads = std::max(_threads, 1);
+  }
+
+  // Score each island's candidates by racing (see EvolutionaryProgramming::setRacing).
+  void setRacing(const bool enable, const double fraction = 1.0/16, const double confidence = 3.0) {
+    racing = enable;
+    raceFraction = fraction;
+    raceConfidence = confidence;
+  }
+
+  int getIslands() const {
+    return islands;
+  }
+
+  // Evolve every island for up to maxFitnessEval fitness evaluations, then set the network
+  // weights to the fittest member found on any island. Returns false (leaving the network
+  // unchanged) if the dataset does not fit the network, or the workers cannot be started
+  // or do not all finish.
+  bool train(const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected, int maxFitnessEval = 100000);
+  bool train(const DatasetView &data, int maxFitnessEval = 100000);
+};
+
+typedef BasicIslandEvolution<double> IslandEvolution;
+typedef BasicIslandEvolution<float> FloatIslandEvolution;
+
+#endif
@@ -0,0 +1,900 @@
+#include "kernels.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86
+#endif
+
+namespace {
+
+// Inputs are clamped so 2^n stays a normal double
+const double expLow = -708.0;
+const double expHigh = 709.0;
+const double log2e = 1.4426950408889634;
+// ln(2) split so n * ln2Hi is exact for every n we can produce
+const double ln2Hi = 6.93147180369123816490e-01;
+const double ln2Lo = 1.90821492927058770002e-10;
+// 1.5 * 2^52: adding it rounds to an integer held in the low mantissa bits
+const double shifter = 6755399441055744.0;
+
+// Taylor coefficients 1/k! of the polynomial approximating exp(r) on |r| <= ln(2)/2
+const double expCoefficients[13] = {
+  1.0, 1.0, 1.0/2.0, 1.0/6.0, 1.0/24.0, 1.0/120.0, 1.0/720.0, 1.0/5040.0,
+  1.0/40320.0, 1.0/362880.0, 1.0/3628800.0, 1.0/39916800.0, 1.0/479001600.0
+};
+
+// Single precision constants: 2^n stays a normal float on [-87, 88], ln(2) is split so
+// n * ln2HiFloat is exact and 1.5 * 2^23 rounds to an integer in the low mantissa bits.
+const float expLowFloat = -87.0f;
+const float expHighFloat = 88.0f;
+const float log2eFloat = 1.44269504f;
+const float ln2HiFloat = 0.693359375f;
+const float ln2LoFloat = -2.12194440e-4f;
+const float shifterFloat = 12582912.0f;
+
+const float expCoefficientsFloat[8] = {
+  1.0f, 1.0f, 1.0f/2.0f, 1.0f/6.0f, 1.0f/24.0f, 1.0f/120.0f, 1.0f/720.0f, 1.0f/5040.0f
+};
+
+struct KernelTable {
+  const char *name;
+  void (*exp)(double*, int);
+  void (*sigmoid)(double*, int);
+  void (*tanh)(double*, int);
+  void (*leakyRelu)(double*, int, double);
+  void (*sigmoidGradient)(const double*, double*, int);
+  void (*tanhGradient)(const double*, double*, int);
+  void (*leakyReluGradient)(const double*, double*, int, double);
+
+  // Single precision
+  void (*expFloat)(float*, int);
+  void (*sigmoidFloat)(float*, int);
+  void (*tanhFloat)(float*, int);
+  void (*leakyReluFloat)(float*, int, float);
+  void (*sigmoidGradientFloat)(const float*, float*, int);
+  void (*tanhGradientFloat)(const float*, float*, int);
+  void (*leakyReluGradientFloat)(const float*, float*, int, float);
+
+  // Quantized inference
+  void (*dotInt8)(const uint8_t*, const int8_t*, int, int, int, int32_t*);
+};
+
+/*
+ * Portable scalar kernels, also used for the tails of the vector kernels.
+ */
+
+void scalarExp(double *values, const int n) {
+  for (int i = 0; i < n; ++i) {
+    values[i] = fastExp(values[i]);
+  }
+}
+
+void scalarSigmoid(double *values, const int n) {
+  for (int i = 0; i < n; ++i) {
+    values[i] = 1.0/(1.0 + fastExp(-values[i]));
+  }
+}
+
+void scalarTanh(double *values, const int n) {
+  for (int i = 0; i < n; ++i) {
+    values[i] = 1.0 - 2.0/(fastExp(2.0*values[i]) + 1.0);
+  }
+}
+
+void scalarLeakyRelu(double *values, const int n, const double alpha) {
+  for (int i = 0; i < n; ++i) {
+    values[i] = values[i] > 0.0 ? values[i] : alpha*values[i];
+  }
+}
+
+void scalarSigmoidGradient(const double *output, double *delta, const int n) {
+  for (int i = 0; i < n; ++i) {
+    delta[i] *= output[i]*(1.0 - output[i]);
+  }
+}
+
+void scalarTanhGradient(const double *output, double *delta, const int n) {
+  for (int i = 0; i < n; ++i) {
+    delta[i] *= 1.0 - output[i]*output[i];
+  }
+}
+
+void scalarLeakyReluGradient(const double *input, double *delta, const int n, const double alpha) {
+  for (int i = 0; i < n; ++i) {
+    delta[i] *= input[i] > 0.0 ? 1.0 : alpha;
+  }
+}
+
+void scalarExpFloat(float *values, const int n) {
+  for (int i = 0; i < n; ++i) {
+    values[i] = fastExp(values[i]);
+  }
+}
+
+void scalarSigmoidFloat(float *values, const int n) {
+  for (int i = 0; i < n; ++i) {
+    values[i] = 1.0f/(1.0f + fastExp(-values[i]));
+  }
+}
+
+void scalarTanhFloat(float *values, const int n) {
+  for (int i = 0; i < n; ++i) {
+    values[i] = 1.0f - 2.0f/(fastExp(2.0f*values[i]) + 1.0f);
+  }
+}
+
+void scalarLeakyReluFloat(float *values, const int n, const float alpha) {
+  for (int i = 0; i < n; ++i) {
+    values[i] = values[i] > 0.0f ? values[i] : alpha*values[i];
+  }
+}
+
+void scalarSigmoidGradientFloat(const float *output, float *delta, const int n) {
+  for (int i = 0; i < n; ++i) {
+    delta[i] *= output[i]*(1.0f - output[i]);
+  }
+}
+
+void scalarTanhGradientFloat(const float *output, float *delta, const int n) {
+  for (int i = 0; i < n; ++i) {
+    delta[i] *= 1.0f - output[i]*output[i];
+  }
+}
+
+void scalarLeakyReluGradientFloat(const float *input, float *delta, const int n, const float alpha) {
+  for (int i = 0; i < n; ++i) {
+    delta[i] *= input[i] > 0.0f ? 1.0f : alpha;
+  }
+}
+
+void scalarDotInt8(const uint8_t *x, const int8_t *w, const int n, const int rows, const int stride, int32_t *out) {
+  for (int r = 0; r < rows; ++r) {
+    const int8_t *row = w + r*stride;
+    int32_t sum = 0;
+    for (int j = 0; j < n; ++j) {
+      sum += x[j] * row[j];
+    }
+    out[r] = sum;
+  }
+}
+
+const KernelTable scalarKernels = {
+  "scalar", scalarExp, scalarSigmoid, scalarTanh, scalarLeakyRelu,
+  scalarSigmoidGradient, scalarTanhGradient, scalarLeakyReluGradient,
+  scalarExpFloat, scalarSigmoidFloat, scalarTanhFloat, scalarLeakyReluFloat,
+  scalarSigmoidGradientFloat, scalarTanhGradientFloat, scalarLeakyReluGradientFloat,
+  scalarDotInt8
+};
+
+#ifdef KERNELS_X86
+
+/*
+ * AVX2 + FMA kernels (4 doubles per register).
+ */
+
+__attribute__((target("avx2,fma"))) inline __m256d exp4(__m256d x) {
+  x = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(expLow)), _mm256_set1_pd(expHigh));
+
+  const __m256d shift = _mm256_set1_pd(shifter);
+  const __m256d t = _mm256_fmadd_pd(x, _mm256_set1_pd(log2e), shift);
+  const __m256d n = _mm256_sub_pd(t, shift);
+
+  __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(ln2Hi), x);
+  r = _mm256_fnmadd_pd(n, _mm256_set1_pd(ln2Lo), r);
+
+  __m256d p = _mm256_set1_pd(expCoefficients[12]);
+  for (int k = 11; k >= 0; --k) {
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(expCoefficients[k]));
+  }
+
+  // 2^n built directly from the rounded integer sitting in the low bits of t
+  const __m256i bits = _mm256_slli_epi64(_mm256_add_epi64(_mm256_castpd_si256(t), _mm256_set1_epi64x(1023)), 52);
+  return _mm256_mul_pd(p, _mm256_castsi256_pd(bits));
+}
+
+__attribute__((target("avx2,fma"))) void avx2Exp(double *values, const int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(values + i, exp4(_mm256_loadu_pd(values + i)));
+  }
+  scalarExp(values + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void avx2Sigmoid(double *values, const int n) {
+  const __m256d one = _mm256_set1_pd(1.0);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256d x = _mm256_loadu_pd(values + i);
+    const __m256d e = exp4(_mm256_sub_pd(_mm256_setzero_pd(), x));
+    _mm256_storeu_pd(values + i, _mm256_div_pd(one, _mm256_add_pd(one, e)));
+  }
+  scalarSigmoid(values + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void avx2Tanh(double *values, const int n) {
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d two = _mm256_set1_pd(2.0);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256d e = exp4(_mm256_mul_pd(two, _mm256_loadu_pd(values + i)));
+    _mm256_storeu_pd(values + i, _mm256_sub_pd(one, _mm256_div_pd(two, _mm256_add_pd(e, one))));
+  }
+  scalarTanh(values + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void avx2LeakyRelu(double *values, const int n, const double alpha) {
+  const __m256d slope = _mm256_set1_pd(alpha);
+  const __m256d zero = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256d x = _mm256_loadu_pd(values + i);
+    const __m256d positive = _mm256_cmp_pd(x, zero, _CMP_GT_OQ);
+    _mm256_storeu_pd(values + i, _mm256_blendv_pd(_mm256_mul_pd(slope, x), x, positive));
+  }
+  scalarLeakyRelu(values + i, n - i, alpha);
+}
+
+__attribute__((target("avx2,fma"))) void avx2SigmoidGradient(const double *output, double *delta, const int n) {
+  const __m256d one = _mm256_set1_pd(1.0);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256d a = _mm256_loadu_pd(output + i);
+    const __m256d g = _mm256_mul_pd(a, _mm256_sub_pd(one, a));
+    _mm256_storeu_pd(delta + i, _mm256_mul_pd(_mm256_loadu_pd(delta + i), g));
+  }
+  scalarSigmoidGradient(output + i, delta + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void avx2TanhGradient(const double *output, double *delta, const int n) {
+  const __m256d one = _mm256_set1_pd(1.0);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256d a = _mm256_loadu_pd(output + i);
+    const __m256d g = _mm256_fnmadd_pd(a, a, one);
+    _mm256_storeu_pd(delta + i, _mm256_mul_pd(_mm256_loadu_pd(delta + i), g));
+  }
+  scalarTanhGradient(output + i, delta + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void avx2LeakyReluGradient(const double *input, double *delta, const int n, const double alpha) {
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d slope = _mm256_set1_pd(alpha);
+  const __m256d zero = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256d positive = _mm256_cmp_pd(_mm256_loadu_pd(input + i), zero, _CMP_GT_OQ);
+    const __m256d g = _mm256_blendv_pd(slope, one, positive);
+    _mm256_storeu_pd(delta + i, _mm256_mul_pd(_mm256_loadu_pd(delta + i), g));
+  }
+  scalarLeakyReluGradient(input + i, delta + i, n - i, alpha);
+}
+
+/*
+ * AVX2 + FMA single precision kernels (8 floats per register).
+ */
+
+__attribute__((target("avx2,fma"))) inline __m256 exp8f(__m256 x) {
+  x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(expLowFloat)), _mm256_set1_ps(expHighFloat));
+
+  const __m256 shift = _mm256_set1_ps(shifterFloat);
+  const __m256 t = _mm256_fmadd_ps(x, _mm256_set1_ps(log2eFloat), shift);
+  const __m256 n = _mm256_sub_ps(t, shift);
+
+  __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(ln2HiFloat), x);
+  r = _mm256_fnmadd_ps(n, _mm256_set1_ps(ln2LoFloat), r);
+
+  __m256 p = _mm256_set1_ps(expCoefficientsFloat[7]);
+  for (int k = 6; k >= 0; --k) {
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(expCoefficientsFloat[k]));
+  }
+
+  const __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_castps_si256(t), _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+}
+
+__attribute__((target("avx2,fma"))) void avx2ExpFloat(float *values, const int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(values + i, exp8f(_mm256_loadu_ps(values + i)));
+  }
+  scalarExpFloat(values + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void avx2SigmoidFloat(float *values, const int n) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 x = _mm256_loadu_ps(values + i);
+    const __m256 e = exp8f(_mm256_sub_ps(_mm256_setzero_ps(), x));
+    _mm256_storeu_ps(values + i, _mm256_div_ps(one, _mm256_add_ps(one, e)));
+  }
+  scalarSigmoidFloat(values + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void avx2TanhFloat(float *values, const int n) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 two = _mm256_set1_ps(2.0f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 e = exp8f(_mm256_mul_ps(two, _mm256_loadu_ps(values + i)));
+    _mm256_storeu_ps(values + i, _mm256_sub_ps(one, _mm256_div_ps(two, _mm256_add_ps(e, one))));
+  }
+  scalarTanhFloat(values + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void avx2LeakyReluFloat(float *values, const int n, const float alpha) {
+  const __m256 slope = _mm256_set1_ps(alpha);
+  const __m256 zero = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 x = _mm256_loadu_ps(values + i);
+    const __m256 positive = _mm256_cmp_ps(x, zero, _CMP_GT_OQ);
+    _mm256_storeu_ps(values + i, _mm256_blendv_ps(_mm256_mul_ps(slope, x), x, positive));
+  }
+  scalarLeakyReluFloat(values + i, n - i, alpha);
+}
+
+__attribute__((target("avx2,fma"))) void avx2SigmoidGradientFloat(const float *output, float *delta, const int n) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 a = _mm256_loadu_ps(output + i);
+    const __m256 g = _mm256_mul_ps(a, _mm256_sub_ps(one, a));
+    _mm256_storeu_ps(delta + i, _mm256_mul_ps(_mm256_loadu_ps(delta + i), g));
+  }
+  scalarSigmoidGradientFloat(output + i, delta + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void avx2TanhGradientFloat(const float *output, float *delta, const int n) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 a = _mm256_loadu_ps(output + i);
+    const __m256 g = _mm256_fnmadd_ps(a, a, one);
+    _mm256_storeu_ps(delta + i, _mm256_mul_ps(_mm256_loadu_ps(delta + i), g));
+  }
+  scalarTanhGradientFloat(output + i, delta + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void avx2LeakyReluGradientFloat(const float *input, float *delta, const int n, const float alpha) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 slope = _mm256_set1_ps(alpha);
+  const __m256 zero = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 positive = _mm256_cmp_ps(_mm256_loadu_ps(input + i), zero, _CMP_GT_OQ);
+    const __m256 g = _mm256_blendv_ps(slope, one, positive);
+    _mm256_storeu_ps(delta + i, _mm256_mul_ps(_mm256_loadu_ps(delta + i), g));
+  }
+  scalarLeakyReluGradientFloat(input + i, delta + i, n - i, alpha);
+}
+
+/*
+ * AVX2 int8 dot products (16 values per register, widened to 16 bits so that the
+ * products and their pairwise sums are exact).
+ */
+
+__attribute__((target("avx2,fma"))) inline int32_t horizontalSum(const __m256i v) {
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+}
+
+// R rows at a time, so each widened block of x is reused R times
+template <int R>
+__attribute__((target("avx2,fma"))) inline void avx2DotRows(const uint8_t *x, const int8_t *w, const int n, const int stride, int32_t *out) {
+  __m256i acc[R];
+  for (int k = 0; k < R; ++k) {
+    acc[k] = _mm256_setzero_si256();
+  }
+
+  int j = 0;
+  for (; j + 16 <= n; j += 16) {
+    const __m256i xv = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + j)));
+    for (int k = 0; k < R; ++k) {
+      const __m256i wv = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w + k*stride + j)));
+      acc[k] = _mm256_add_epi32(acc[k], _mm256_madd_epi16(xv, wv));
+    }
+  }
+
+  for (int k = 0; k < R; ++k) {
+    int32_t sum = horizontalSum(acc[k]);
+    for (int t = j; t < n; ++t) {
+      sum += x[t] * w[k*stride + t];
+    }
+    out[k] = sum;
+  }
+}
+
+__attribute__((target("avx2,fma"))) void avx2DotInt8(const uint8_t *x, const int8_t *w, const int n, const int rows, const int stride, int32_t *out) {
+  int r = 0;
+  for (; r + 4 <= rows; r += 4) {
+    avx2DotRows<4>(x, w + r*stride, n, stride, out + r);
+  }
+  for (; r < rows; ++r) {
+    avx2DotRows<1>(x, w + r*stride, n, stride, out + r);
+  }
+}
+
+const KernelTable avx2Kernels = {
+  "avx2", avx2Exp, avx2Sigmoid, avx2Tanh, avx2LeakyRelu,
+  avx2SigmoidGradient, avx2TanhGradient, avx2LeakyReluGradient,
+  avx2ExpFloat, avx2SigmoidFloat, avx2TanhFloat, avx2LeakyReluFloat,
+  avx2SigmoidGradientFloat, avx2TanhGradientFloat, avx2LeakyReluGradientFloat,
+  avx2DotInt8
+};
+
+/*
+ * AVX-512 kernels (8 doubles per register).
+ */
+
+__attribute__((target("avx512f"))) inline __m512d exp8(__m512d x) {
+  x = _mm512_min_pd(_mm512_max_pd(x, _mm512_set1_pd(expLow)), _mm512_set1_pd(expHigh));
+
+  const __m512d shift = _mm512_set1_pd(shifter);
+  const __m512d t = _mm512_fmadd_pd(x, _mm512_set1_pd(log2e), shift);
+  const __m512d n = _mm512_sub_pd(t, shift);
+
+  __m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(ln2Hi), x);
+  r = _mm512_fnmadd_pd(n, _mm512_set1_pd(ln2Lo), r);
+
+  __m512d p = _mm512_set1_pd(expCoefficients[12]);
+  for (int k = 11; k >= 0; --k) {
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(expCoefficients[k]));
+  }
+
+  const __m512i bits = _mm512_slli_epi64(_mm512_add_epi64(_mm512_castpd_si512(t), _mm512_set1_epi64(1023)), 52);
+  return _mm512_mul_pd(p, _mm512_castsi512_pd(bits));
+}
+
+__attribute__((target("avx512f"))) void avx512Exp(double *values, const int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm512_storeu_pd(values + i, exp8(_mm512_loadu_pd(values + i)));
+  }
+  scalarExp(values + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void avx512Sigmoid(double *values, const int n) {
+  const __m512d one = _mm512_set1_pd(1.0);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m512d x = _mm512_loadu_pd(values + i);
+    const __m512d e = exp8(_mm512_sub_pd(_mm512_setzero_pd(), x));
+    _mm512_storeu_pd(values + i, _mm512_div_pd(one, _mm512_add_pd(one, e)));
+  }
+  scalarSigmoid(values + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void avx512Tanh(double *values, const int n) {
+  const __m512d one = _mm512_set1_pd(1.0);
+  const __m512d two = _mm512_set1_pd(2.0);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m512d e = exp8(_mm512_mul_pd(two, _mm512_loadu_pd(values + i)));
+    _mm512_storeu_pd(values + i, _mm512_sub_pd(one, _mm512_div_pd(two, _mm512_add_pd(e, one))));
+  }
+  scalarTanh(values + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void avx512LeakyRelu(double *values, const int n, const double alpha) {
+  const __m512d slope = _mm512_set1_pd(alpha);
+  const __m512d zero = _mm512_setzero_pd();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m512d x = _mm512_loadu_pd(values + i);
+    const __mmask8 positive = _mm512_cmp_pd_mask(x, zero, _CMP_GT_OQ);
+    _mm512_storeu_pd(values + i, _mm512_mask_blend_pd(positive, _mm512_mul_pd(slope, x), x));
+  }
+  scalarLeakyRelu(values + i, n - i, alpha);
+}
+
+__attribute__((target("avx512f"))) void avx512SigmoidGradient(const double *output, double *delta, const int n) {
+  const __m512d one = _mm512_set1_pd(1.0);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m512d a = _mm512_loadu_pd(output + i);
+    const __m512d g = _mm512_mul_pd(a, _mm512_sub_pd(one, a));
+    _mm512_storeu_pd(delta + i, _mm512_mul_pd(_mm512_loadu_pd(delta + i), g));
+  }
+  scalarSigmoidGradient(output + i, delta + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void avx512TanhGradient(const double *output, double *delta, const int n) {
+  const __m512d one = _mm512_set1_pd(1.0);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m512d a = _mm512_loadu_pd(output + i);
+    const __m512d g = _mm512_fnmadd_pd(a, a, one);
+    _mm512_storeu_pd(delta + i, _mm512_mul_pd(_mm512_loadu_pd(delta + i), g));
+  }
+  scalarTanhGradient(output + i, delta + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void avx512LeakyReluGradient(const double *input, double *delta, const int n, const double alpha) {
+  const __m512d one = _mm512_set1_pd(1.0);
+  const __m512d slope = _mm512_set1_pd(alpha);
+  const __m512d zero = _mm512_setzero_pd();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __mmask8 positive = _mm512_cmp_pd_mask(_mm512_loadu_pd(input + i), zero, _CMP_GT_OQ);
+    const __m512d g = _mm512_mask_blend_pd(positive, slope, one);
+    _mm512_storeu_pd(delta + i, _mm512_mul_pd(_mm512_loadu_pd(delta + i), g));
+  }
+  scalarLeakyReluGradient(input + i, delta + i, n - i, alpha);
+}
+
+/*
+ * AVX-512 single precision kernels (16 floats per register).
+ */
+
+__attribute__((target("avx512f"))) inline __m512 exp16f(__m512 x) {
+  x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(expLowFloat)), _mm512_set1_ps(expHighFloat));
+
+  const __m512 shift = _mm512_set1_ps(shifterFloat);
+  const __m512 t = _mm512_fmadd_ps(x, _mm512_set1_ps(log2eFloat), shift);
+  const __m512 n = _mm512_sub_ps(t, shift);
+
+  __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(ln2HiFloat), x);
+  r = _mm512_fnmadd_ps(n, _mm512_set1_ps(ln2LoFloat), r);
+
+  __m512 p = _mm512_set1_ps(expCoefficientsFloat[7]);
+  for (int k = 6; k >= 0; --k) {
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(expCoefficientsFloat[k]));
+  }
+
+  const __m512i bits = _mm512_slli_epi32(_mm512_add_epi32(_mm512_castps_si512(t), _mm512_set1_epi32(127)), 23);
+  return _mm512_mul_ps(p, _mm512_castsi512_ps(bits));
+}
+
+__attribute__((target("avx512f"))) void avx512ExpFloat(float *values, const int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(values + i, exp16f(_mm512_loadu_ps(values + i)));
+  }
+  scalarExpFloat(values + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void avx512SigmoidFloat(float *values, const int n) {
+  const __m512 one = _mm512_set1_ps(1.0f);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 x = _mm512_loadu_ps(values + i);
+    const __m512 e = exp16f(_mm512_sub_ps(_mm512_setzero_ps(), x));
+    _mm512_storeu_ps(values + i, _mm512_div_ps(one, _mm512_add_ps(one, e)));
+  }
+  scalarSigmoidFloat(values + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void avx512TanhFloat(float *values, const int n) {
+  const __m512 one = _mm512_set1_ps(1.0f);
+  const __m512 two = _mm512_set1_ps(2.0f);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 e = exp16f(_mm512_mul_ps(two, _mm512_loadu_ps(values + i)));
+    _mm512_storeu_ps(values + i, _mm512_sub_ps(one, _mm512_div_ps(two, _mm512_add_ps(e, one))));
+  }
+  scalarTanhFloat(values + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void avx512LeakyReluFloat(float *values, const int n, const float alpha) {
+  const __m512 slope = _mm512_set1_ps(alpha);
+  const __m512 zero = _mm512_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 x = _mm512_loadu_ps(values + i);
+    const __mmask16 positive = _mm512_cmp_ps_mask(x, zero, _CMP_GT_OQ);
+    _mm512_storeu_ps(values + i, _mm512_mask_blend_ps(positive, _mm512_mul_ps(slope, x), x));
+  }
+  scalarLeakyReluFloat(values + i, n - i, alpha);
+}
+
+__attribute__((target("avx512f"))) void avx512SigmoidGradientFloat(const float *output, float *delta, const int n) {
+  const __m512 one = _mm512_set1_ps(1.0f);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 a = _mm512_loadu_ps(output + i);
+    const __m512 g = _mm512_mul_ps(a, _mm512_sub_ps(one, a));
+    _mm512_storeu_ps(delta + i, _mm512_mul_ps(_mm512_loadu_ps(delta + i), g));
+  }
+  scalarSigmoidGradientFloat(output + i, delta + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void avx512TanhGradientFloat(const float *output, float *delta, const int n) {
+  const __m512 one = _mm512_set1_ps(1.0f);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 a = _mm512_loadu_ps(output + i);
+    const __m512 g = _mm512_fnmadd_ps(a, a, one);
+    _mm512_storeu_ps(delta + i, _mm512_mul_ps(_mm512_loadu_ps(delta + i), g));
+  }
+  scalarTanhGradientFloat(output + i, delta + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void avx512LeakyReluGradientFloat(const float *input, float *delta, const int n, const float alpha) {
+  const __m512 one = _mm512_set1_ps(1.0f);
+  const __m512 slope = _mm512_set1_ps(alpha);
+  const __m512 zero = _mm512_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __mmask16 positive = _mm512_cmp_ps_mask(_mm512_loadu_ps(input + i), zero, _CMP_GT_OQ);
+    const __m512 g = _mm512_mask_blend_ps(positive, slope, one);
+    _mm512_storeu_ps(delta + i, _mm512_mul_ps(_mm512_loadu_ps(delta + i), g));
+  }
+  scalarLeakyReluGradientFloat(input + i, delta + i, n - i, alpha);
+}
+
+/*
+ * AVX-512 VNNI int8 dot products: vpdpbusd multiplies 64 unsigned by signed bytes and
+ * accumulates groups of four straight into 32-bit sums. Tails use masked loads.
+ */
+
+template <int R>
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) inline void vnniDotRows(const uint8_t *x, const int8_t *w, const int n, const int stride, int32_t *out) {
+  __m512i acc[R];
+  for (int k = 0; k < R; ++k) {
+    acc[k] = _mm512_setzero_si512();
+  }
+
+  int j = 0;
+  for (; j + 64 <= n; j += 64) {
+    const __m512i xv = _mm512_loadu_si512(x + j);
+    for (int k = 0; k < R; ++k) {
+      acc[k] = _mm512_dpbusd_epi32(acc[k], xv, _mm512_loadu_si512(w + k*stride + j));
+    }
+  }
+
+  if (j < n) {
+    const __mmask64 tail = ~0ULL >> (64 - (n - j));
+    const __m512i xv = _mm512_maskz_loadu_epi8(tail, x + j);
+    for (int k = 0; k < R; ++k) {
+      acc[k] = _mm512_dpbusd_epi32(acc[k], xv, _mm512_maskz_loadu_epi8(tail, w + k*stride + j));
+    }
+  }
+
+  for (int k = 0; k < R; ++k) {
+    out[k] = _mm512_reduce_add_epi32(acc[k]);
+  }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) void vnniDotInt8(const uint8_t *x, const int8_t *w, const int n, const int rows, const int stride, int32_t *out) {
+  int r = 0;
+  for (; r + 4 <= rows; r += 4) {
+    vnniDotRows<4>(x, w + r*stride, n, stride, out + r);
+  }
+  for (; r < rows; ++r) {
+    vnniDotRows<1>(x, w + r*stride, n, stride, out + r);
+  }
+}
+
+// Without VNNI the AVX2 integer dot products are used
+const KernelTable avx512Kernels = {
+  "avx512", avx512Exp, avx512Sigmoid, avx512Tanh, avx512LeakyRelu,
+  avx512SigmoidGradient, avx512TanhGradient, avx512LeakyReluGradient,
+  avx512ExpFloat, avx512SigmoidFloat, avx512TanhFloat, avx512LeakyReluFloat,
+  avx512SigmoidGradientFloat, avx512TanhGradientFloat, avx512LeakyReluGradientFloat,
+  avx2DotInt8
+};
+
+#endif
+
+KernelTable selectKernels() {
+  /*
+   * Pick the widest instruction set supported by the CPU. The ML_KERNELS environment
+   * variable ("scalar", "avx2" or "avx512") can be used to force a narrower one.
+   */
+  const char *forced = getenv("ML_KERNELS");
+  const std::string limit = forced ? forced : "";
+
+#ifdef KERNELS_X86
+  __builtin_cpu_init();
+
+  if (limit != "scalar" && limit != "avx2" && __builtin_cpu_supports("avx512f")) {
+    KernelTable table = avx512Kernels;
+    if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni")) {
+      table.dotInt8 = vnniDotInt8;
+    }
+    return table;
+  }
+
+  if (limit != "scalar" && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return avx2Kernels;
+  }
+#endif
+
+  return scalarKernels;
+}
+
+const KernelTable& kernels() {
+  static const KernelTable table = selectKernels();
+  return table;
+}
+
+}
+
+double fastExp(double x) {
+  /*
+   * exp(x) = 2^n * exp(r) with n = round(x / ln(2)) and r = x - n ln(2).
+   */
+  x = std::min(std::max(x, expLow), expHigh);
+
+  const double t = x*log2e + shifter;
+  const double n = t - shifter;
+  const double r = (x - n*ln2Hi) - n*ln2Lo;
+
+  double p = expCoefficients[12];
+  for (int k = 11; k >= 0; --k) {
+    p = p*r + expCoefficients[k];
+  }
+
+  // 2^n built directly from the rounded integer sitting in the low bits of t
+  uint64_t bits;
+  std::memcpy(&bits, &t, sizeof(bits));
+  bits = (bits + 1023) << 52;
+
+  double scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return p*scale;
+}
+
+float fastExp(float x) {
+  /*
+   * The single precision form of the reduction above.
+   */
+  x = std::min(std::max(x, expLowFloat), expHighFloat);
+
+  const float t = x*log2eFloat + shifterFloat;
+  const float n = t - shifterFloat;
+  const float r = (x - n*ln2HiFloat) - n*ln2LoFloat;
+
+  float p = expCoefficientsFloat[7];
+  for (int k = 6; k >= 0; --k) {
+    p = p*r + expCoefficientsFloat[k];
+  }
+
+  uint32_t bits;
+  std::memcpy(&bits, &t, sizeof(bits));
+  bits = (bits + 127) << 23;
+
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return p*scale;
+}
+
+const char* kernelInstructionSet() {
+  return kernels().name;
+}
+
+void vectorExp(double *values, const int n) {
+  kernels().exp(values, n);
+}
+
+void vectorSigmoid(double *values, const int n) {
+  kernels().sigmoid(values, n);
+}
+
+void vectorTanh(double *values, const int n) {
+  kernels().tanh(values, n);
+}
+
+void vectorLeakyRelu(double *values, const int n, const double alpha) {
+  kernels().leakyRelu(values, n, alpha);
+}
+
+namespace {
+
+template <typename T>
+void softmaxRows(T *values, const int rows, const int cols) {
+  /*
+   * Each row is shifted by its maximum before exponentiating so large inputs
+   * cannot overflow, then normalized to sum to one.
+   */
+  for (int i = 0; i < rows; ++i) {
+    T *row = values + i*cols;
+    const T largest = *std::max_element(row, row + cols);
+
+    for (int j = 0; j < cols; ++j) {
+      row[j] -= largest;
+    }
+
+    vectorExp(row, cols);
+
+    T sum = 0;
+    for (int j = 0; j < cols; ++j) {
+      sum += row[j];
+    }
+
+    const T scale = 1/sum;
+    for (int j = 0; j < cols; ++j) {
+      row[j] *= scale;
+    }
+  }
+}
+
+template <typename T>
+void softmaxGradientRows(const T *output, T *delta, const int rows, const int cols) {
+  /*
+   * The Jacobian of a softmax row is diag(s) - s*s^T, and it is symmetric, so its
+   * product with a row of deltas is s*(d - s.d) without forming it.
+   */
+  for (int i = 0; i < rows; ++i) {
+    const T *s = output + i*cols;
+    T *d = delta + i*cols;
+
+    double projection = 0.0;
+    for (int j = 0; j < cols; ++j) {
+      projection += static_cast<double>(d[j]) * s[j];
+    }
+    for (int j = 0; j < cols; ++j) {
+      d[j] = s[j] * (d[j] - projection);
+    }
+  }
+}
+
+}
+
+void vectorSoftmax(double *values, const int rows, const int cols) {
+  softmaxRows(values, rows, cols);
+}
+
+void vectorSigmoidGradient(const double *output, double *delta, const int n) {
+  kernels().sigmoidGradient(output, delta, n);
+}
+
+void vectorTanhGradient(const double *output, double *delta, const int n) {
+  kernels().tanhGradient(output, delta, n);
+}
+
+void vectorLeakyReluGradient(const double *input, double *delta, const int n, const double alpha) {
+  kernels().leakyReluGradient(input, delta, n, alpha);
+}
+
+void vectorSoftmaxGradient(const double *output, double *delta, const int rows, const int cols) {
+  softmaxGradientRows(output, delta, rows, cols);
+}
+
+void vectorExp(float *values, const int n) {
+  kernels().expFloat(values, n);
+}
+
+void vectorSigmoid(float *values, const int n) {
+  kernels().sigmoidFloat(values, n);
+}
+
+void vectorTanh(float *values, const int n) {
+  kernels().tanhFloat(values, n);
+}
+
+void vectorLeakyRelu(float *values, const int n, const float alpha) {
+  kernels().leakyReluFloat(values, n, alpha);
+}
+
+void vectorSoftmax(float *values, const int rows, const int cols) {
+  softmaxRows(values, rows, cols);
+}
+
+void vectorSigmoidGradient(const float *output, float *delta, const int n) {
+  kernels().sigmoidGradientFloat(output, delta, n);
+}
+
+void vectorTanhGradient(const float *output, float *delta, const int n) {
+  kernels().tanhGradientFloat(output, delta, n);
+}
+
+void vectorLeakyReluGradient(const float *input, float *delta, const int n, const float alpha) {
+  kernels().leakyReluGradientFloat(input, delta, n, alpha);
+}
+
+void vectorSoftmaxGradient(const float *output, float *delta, const int rows, const int cols) {
+  softmaxGradientRows(output, delta, rows, cols);
+}
+
+void vectorDotInt8(const uint8_t *x, const int8_t *w, const int n, const int rows, const int stride, int32_t *out) {
+  kernels().dotInt8(x, w, n, rows, stride, out);
+}
@@ -0,0 +1,65 @@
+#ifndef KERNELS_H_
+#define KERNELS_H_
+
+/*
+ * Vectorized array kernels for the activation functions and their gradients.
+ * Each kernel has an AVX-512, an AVX2 and a portable scalar implementation; the
+ * fastest one supported by the CPU is chosen once at runtime.
+ *
+ * Exponentials use fastExp: Cody-Waite range reduction to |r| <= ln(2)/2 followed
+ * by a degree 12 Taylor polynomial. For inputs in [-708, 709] its relative error
+ * against std::exp is below 5e-16 (about 2 ulp); inputs outside that range are
+ * clamped to it, so the result is never 0, inf or NaN.
+ *
+ * Every kernel also has a single precision form, which processes twice as many values
+ * per register. Its exponential uses a degree 7 polynomial on [-87, 88], accurate to
+ * a relative error below 2e-7 (about 2 ulp in float).
+ *
+ * The int8 dot products used by quantized inference are exact on every instruction
+ * set: AVX2 widens to 16 bits before multiplying (vpmaddubsw would saturate) and
+ * AVX-512 VNNI (vpdpbusd) is used when the CPU supports it.
+ */
+
+#include <cstdint>
+
+double fastExp(const double x);
+float fastExp(const float x);
+
+// Name of the instruction set the kernels dispatch to ("avx512", "avx2" or "scalar").
+const char* kernelInstructionSet();
+
+// In place element-wise activations
+void vectorExp(double *values, const int n);
+void vectorSigmoid(double *values, const int n);
+void vectorTanh(double *values, const int n);
+void vectorLeakyRelu(double *values, const int n, const double alpha);
+
+// Row-wise softmax of a rows x cols row-major block
+void vectorSoftmax(double *values, const int rows, const int cols);
+
+// delta[i] *= derivative of the activation, given the activation's outputs (sigmoid, tanh)
+// or inputs (leaky ReLU) so no exponential has to be re-evaluated.
+void vectorSigmoidGradient(const double *output, double *delta, const int n);
+void vectorTanhGradient(const double *output, double *delta, const int n);
+void vectorLeakyReluGradient(const double *input, double *delta, const int n, const double alpha);
+
+// Each row of delta times the Jacobian of the softmax whose outputs are the same row of
+// output: delta = output*(delta - sum(delta*output)).
+void vectorSoftmaxGradient(const double *output, double *delta, const int rows, const int cols);
+
+// Single precision forms of the kernels above
+void vectorExp(float *values, const int n);
+void vectorSigmoid(float *values, const int n);
+void vectorTanh(float *values, const int n);
+void vectorLeakyRelu(float *values, const int n, const float alpha);
+void vectorSoftmax(float *values, const int rows, const int cols);
+void vectorSigmoidGradient(const float *output, float *delta, const int n);
+void vectorTanhGradient(const float *output, float *delta, const int n);
+void vectorLeakyReluGradient(const float *input, float *delta, const int n, const float alpha);
+void vectorSoftmaxGradient(const float *output, float *delta, const int rows, const int cols);
+
+// Dot products of n unsigned 8-bit values with each of rows rows of signed 8-bit weights,
+// consecutive rows being stride values apart: out[r] = sum_j x[j]*w[r*stride + j].
+void vectorDotInt8(const uint8_t *x, const int8_t *w, const int n, const int rows, const int stride, int32_t *out);
+
+#endif
@@ -0,0 +1,163 @@
+#include "linalg.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// Cache blocking parameters: an MC x KC block of op(A) is kept in L2 and a
+// KC x NC panel of op(B) in L3 while the MR x NR micro-kernel runs out of registers.
+// The tile width NR is eight values in either precision: a sixteen float tile needs more
+// accumulators than there are vector registers and spills, halving throughput.
+const int MC = 128;
+const int KC = 256;
+const int NC = 2048;
+const int MR = 4;
+
+template <typename T>
+struct Tile {
+  static const int NR = 8;
+};
+
+// Packing buffers are reused between calls so steady-state products do not allocate.
+template <typename T>
+std::vector<T>& packingBuffer(const int which) {
+  static thread_local std::vector<T> buffers[2];
+  return buffers[which];
+}
+
+template <typename T>
+inline T element(const Transpose trans, const T* X, const int ld, const int row, const int col) {
+  return trans == NoTrans ? X[row * ld + col] : X[col * ld + row];
+}
+
+template <typename T>
+void packA(const Transpose trans, const T* A, const int lda, const int i0, const int p0, const int mc, const int kc, T* dst) {
+  /*
+   * Copy an mc x kc block of op(A) into strips of MR rows, stored so that the
+   * MR values belonging to one k are adjacent. Short strips are zero padded.
+   */
+  for (int i = 0; i < mc; i += MR) {
+    const int mr = std::min(MR, mc - i);
+    for (int p = 0; p < kc; ++p) {
+      for (int r = 0; r < MR; ++r) {
+        *dst++ = r < mr ? element(trans, A, lda, i0 + i + r, p0 + p) : 0.0;
+      }
+    }
+  }
+}
+
+template <typename T>
+void packB(const Transpose trans, const T* B, const int ldb, const int p0, const int j0, const int kc, const int nc, T* dst) {
+  /*
+   * Copy a kc x nc panel of op(B) into strips of NR columns, stored so that the
+   * NR values belonging to one k are adjacent. Short strips are zero padded.
+   */
+  const int NR = Tile<T>::NR;
+  for (int j = 0; j < nc; j += NR) {
+    const int nr = std::min(NR, nc - j);
+    for (int p = 0; p < kc; ++p) {
+      for (int c = 0; c < NR; ++c) {
+        *dst++ = c < nr ? element(trans, B, ldb, p0 + p, j0 + j + c) : 0.0;
+      }
+    }
+  }
+}
+
+template <typename T>
+void microKernel(const int kc, const T alpha, const T* Ap, const T* Bp, T* C, const int ldc, const int mr, const int nr) {
+  /*
+   * Accumulate an MR x NR tile of the product in registers and add it to C.
+   * The inner loop runs over NR contiguous values and is vectorized by the compiler.
+   */
+  const int NR = Tile<T>::NR;
+  T acc[MR][NR] = {{0}};
+
+  for (int p = 0; p < kc; ++p) {
+    for (int i = 0; i < MR; ++i) {
+      const T a = Ap[i];
+      for (int j = 0; j < NR; ++j) {
+        acc[i][j] += a * Bp[j];
+      }
+    }
+    Ap += MR;
+    Bp += NR;
+  }
+
+  for (int i = 0; i < mr; ++i) {
+    for (int j = 0; j < nr; ++j) {
+      C[i * ldc + j] += alpha * acc[i][j];
+    }
+  }
+}
+
+template <typename T>
+void blockedGemm(const Transpose transA, const Transpose transB, const int M, const int N, const int K,
+                 const T alpha, const T* A, const int lda, const T* B, const int ldb,
+                 const T beta, T* C, const int ldc) {
+  /*
+   * Cache blocked general matrix multiply. Blocks of op(A) and op(B) are packed
+   * into contiguous buffers and the product is built up from register tiles.
+   */
+
+  // Scale C once up front so the kernel only ever accumulates.
+  if (beta != 1.0) {
+    for (int i = 0; i < M; ++i) {
+      for (int j = 0; j < N; ++j) {
+        C[i * ldc + j] = beta == 0.0 ? 0.0 : beta * C[i * ldc + j];
+      }
+    }
+  }
+
+  if (M == 0 || N == 0 || K == 0 || alpha == 0.0) {
+    return;
+  }
+
+  const int NR = Tile<T>::NR;
+  std::vector<T> &packedA = packingBuffer<T>(0);
+  std::vector<T> &packedB = packingBuffer<T>(1);
+
+  const int roundedMC = ((std::min(MC, M) + MR - 1) / MR) * MR;
+  const int roundedNC = ((std::min(NC, N) + NR - 1) / NR) * NR;
+
+  if (packedA.size() < roundedMC * KC) {
+    packedA.resize(roundedMC * KC);
+  }
+  if (packedB.size() < KC * roundedNC) {
+    packedB.resize(KC * roundedNC);
+  }
+
+  for (int jc = 0; jc < N; jc += NC) {
+    const int nc = std::min(NC, N - jc);
+
+    for (int pc = 0; pc < K; pc += KC) {
+      const int kc = std::min(KC, K - pc);
+      packB(transB, B, ldb, pc, jc, kc, nc, packedB.data());
+
+      for (int ic = 0; ic < M; ic += MC) {
+        const int mc = std::min(MC, M - ic);
+        packA(transA, A, lda, ic, pc, mc, kc, packedA.data());
+
+        for (int jr = 0; jr < nc; jr += NR) {
+          for (int ir = 0; ir < mc; ir += MR) {
+            microKernel(kc, alpha, &packedA[ir * kc], &packedB[jr * kc], &C[(ic + ir) * ldc + jc + jr], ldc,
+                        std::min(MR, mc - ir), std::min(NR, nc - jr));
+          }
+        }
+      }
+    }
+  }
+}
+
+}
+
+void gemm(const Transpose transA, const Transpose transB, const int M, const int N, const int K,
+          const double alpha, const double* A, const int lda, const double* B, const int ldb,
+          const double beta, double* C, const int ldc) {
+  blockedGemm(transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void gemm(const Transpose transA, const Transpose transB, const int M, const int N, const int K,
+          const float alpha, const float* A, const int lda, const float* B, const int ldb,
+          const float beta, float* C, const int ldc) {
+  blockedGemm(transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
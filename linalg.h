@@ -0,0 +1,22 @@
+#ifndef LINALG_H_
+#define LINALG_H_
+
+/*
+ * Dense linear algebra kernels used by the batched network code paths.
+ * All matrices are row-major and described by a pointer and a leading dimension
+ * (the distance in elements between two consecutive rows), so they can operate
+ * directly on the storage of boost::numeric::ublas::matrix. Single and double
+ * precision versions are provided.
+ */
+
+enum Transpose { NoTrans, Trans };
+
+// C = alpha * op(A) * op(B) + beta * C where op(A) is M x K and op(B) is K x N.
+void gemm(const Transpose transA, const Transpose transB, const int M, const int N, const int K,
+          const double alpha, const double* A, const int lda, const double* B, const int ldb,
+          const double beta, double* C, const int ldc);
+void gemm(const Transpose transA, const Transpose transB, const int M, const int N, const int K,
+          const float alpha, const float* A, const int lda, const float* B, const int ldb,
+          const float beta, float* C, const int ldc);
+
+#endif
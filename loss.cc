@@ -0,0 +1,161 @@
+#include "loss.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Number of values summed directly at the leaves of the pairwise summation
+const int pairwiseBlockSize = 128;
+
+// Number of independent partial sums at the leaves, enough to fill a vector register
+const int pairwiseLanes = 8;
+
+}
+
+double pairwiseSum(const double *values, const int n) {
+  /*
+   * Short runs are added in independent lanes, which the compiler keeps in a vector
+   * register, and longer ones are split in halves (on a multiple of the lane count).
+   */
+  if (n <= pairwiseBlockSize) {
+    double lanes[pairwiseLanes] = {0.0};
+    int i = 0;
+    for (; i + pairwiseLanes <= n; i += pairwiseLanes) {
+      for (int j = 0; j < pairwiseLanes; ++j) {
+        lanes[j] += values[i + j];
+      }
+    }
+
+    double sum = 0.0;
+    for (; i < n; ++i) {
+      sum += values[i];
+    }
+    for (int width = pairwiseLanes / 2; width > 0; width /= 2) {
+      for (int j = 0; j < width; ++j) {
+        lanes[j] += lanes[j + width];
+      }
+    }
+    return lanes[0] + sum;
+  }
+
+  const int half = n / 2 / pairwiseLanes * pairwiseLanes;
+  return pairwiseSum(values, half) + pairwiseSum(values + half, n - half);
+}
+
+template <typename T>
+void outputLoss(const LossFunction loss, ActivationFunction &activation, const T *z, const T *a, const T *y, const int samples, const int outputs,
+                double *cost, T *delta, std::vector<double> &terms) {
+  /*
+   * A single loop over each sample's outputs finds both their loss terms and deltas.
+   * - Cross entropy: the softplus of sigmoid logits is max(z, 0) + log(1 + exp(-|z|)),
+   *   whose exponentials (found first, vectorized) cannot overflow, and the delta is
+   *   a - y. Softmax logits are shifted by their maximum, and the same exponentials give
+   *   the log-sum-exp and the delta s*sum(y) - y (which is s - y for class labels).
+   *   Other activations keep the log likelihood of their outputs and the delta a - y.
+   * - Squared error: the delta is (a - y) times the Jacobian of the activation.
+   * The loss of each sample is kept and the samples are added pairwise.
+   */
+  const int n = samples * outputs;
+  const bool summing = cost != nullptr;
+  const ActivationFunction::Type type = activation.type();
+  const bool sigmoid = loss == CROSS_ENTROPY && type == ActivationFunction::SIGMOID;
+  const bool softmax = type == ActivationFunction::SOFTMAX;
+
+  // The loss of each sample, followed by scratch for the exponentials
+  terms.resize(samples + (sigmoid && summing ? n : softmax && loss == CROSS_ENTROPY ? outputs : 0));
+  double *exponentials = terms.data() + samples;
+
+  if (loss == MEAN_SQUARED_ERROR) {
+    for (int i = 0; i < samples; ++i) {
+      const T *outputRow = a + i * outputs;
+      const T *labels = y + i * outputs;
+      T *deltas = delta ? delta + i * outputs : nullptr;
+      double sum = 0.0;
+      for (int j = 0; j < outputs; ++j) {
+        const double difference = static_cast<double>(outputRow[j]) - labels[j];
+        sum += 0.5 * difference * difference;
+        if (deltas) {
+          deltas[j] = difference;
+        }
+      }
+      terms[i] = sum;
+    }
+    if (delta) {
+      activation.gradient(z, a, delta, samples, outputs);
+    }
+  } else if (sigmoid) {
+    if (summing) {
+      for (int k = 0; k < n; ++k) {
+        exponentials[k] = -std::abs(static_cast<double>(z[k]));
+      }
+      vectorExp(exponentials, n);
+    }
+    for (int i = 0; i < samples; ++i) {
+      double sum = 0.0;
+      for (int k = i * outputs; k < (i + 1) * outputs; ++k) {
+        if (summing) {
+          const double x = z[k];
+          sum += std::max(x, 0.0) - y[k] * x + std::log1p(exponentials[k]);
+        }
+        if (delta) {
+          delta[k] = a[k] - y[k];
+        }
+      }
+      terms[i] = sum;
+    }
+  } else if (softmax) {
+    for (int i = 0; i < samples; ++i) {
+      const T *row = z + i * outputs;
+      const T *labels = y + i * outputs;
+      const double largest = *std::max_element(row, row + outputs);
+      for (int j = 0; j < outputs; ++j) {
+        exponentials[j] = row[j] - largest;
+      }
+      vectorExp(exponentials, outputs);
+
+      double sum = 0.0;
+      double total = 0.0;
+      double weighted = 0.0;
+      for (int j = 0; j < outputs; ++j) {
+        sum += exponentials[j];
+        total += labels[j];
+        weighted += labels[j] * static_cast<double>(row[j]);
+      }
+      terms[i] = total * (largest + std::log(sum)) - weighted;
+
+      if (delta) {
+        const double scale = total / sum;
+        for (int j = 0; j < outputs; ++j) {
+          delta[i * outputs + j] = exponentials[j] * scale - labels[j];
+        }
+      }
+    }
+  } else {
+    // Outputs are clamped inside (0, 1) by the precision of T, so 0*log(0) cannot occur
+    const double lowest = std::numeric_limits<T>::min();
+    const double highest = 1.0 - std::numeric_limits<T>::epsilon() / 2;
+    for (int i = 0; i < samples; ++i) {
+      double sum = 0.0;
+      for (int k = i * outputs; k < (i + 1) * outputs; ++k) {
+        if (summing) {
+          const double p = std::min(std::max<double>(a[k], lowest), highest);
+          sum -= y[k] * std::log(p) + (1 - y[k]) * std::log(1 - p);
+        }
+        if (delta) {
+          delta[k] = a[k] - y[k];
+        }
+      }
+      terms[i] = sum;
+    }
+  }
+
+  if (summing) {
+    *cost = pairwiseSum(terms.data(), samples);
+  }
+}
+
+template void outputLoss(const LossFunction loss, ActivationFunction &activation, const double *z, const double *a, const double *y, const int samples, const int outputs,
+                         double *cost, double *delta, std::vector<double> &terms);
+template void outputLoss(const LossFunction loss, ActivationFunction &activation, const float *z, const float *a, const float *y, const int samples, const int outputs,
+                         double *cost, float *delta, std::vector<double> &terms);
@@ -0,0 +1,66 @@
+#ifndef LOSS_H_
+#define LOSS_H_
+
+/*
+ * Losses of the output layer, computed from its weighted inputs (the logits) rather than
+ * from its activations wherever the activation allows it:
+ * - CROSS_ENTROPY with sigmoid outputs uses softplus(z) - y*z, and with softmax outputs
+ *   log-sum-exp(z) - sum(y*z) over each sample, so saturated outputs give large finite
+ *   losses instead of log(0). Other activations fall back to the log likelihood of their
+ *   outputs clamped inside (0, 1).
+ * - MEAN_SQUARED_ERROR is half the squared distance between outputs and labels; with
+ *   softmax outputs its delta is taken through the full Jacobian of the softmax.
+ * The derivative of the loss with respect to the logits (the delta of the output layer)
+ * is produced in the same pass, and the per-sample losses are added by pairwise
+ * summation, whose rounding error grows with log(n) rather than n.
+ */
+
+#include "activation.h"
+#include <vector>
+
+enum LossFunction { CROSS_ENTROPY = 0, MEAN_SQUARED_ERROR = 1 };
+
+// Sum of n values by pairwise summation, with the leaves added in independent lanes
+double pairwiseSum(const double *values, const int n);
+
+// Pairwise summation of a stream of values in fixed memory. partial[k] holds the sum of
+// 2^k values, and each value added merges the equal partials below it like the carries
+// of a binary counter.
+class PairwiseAccumulator {
+private:
+  double partial[64];
+  unsigned long long count;
+
+public:
+  PairwiseAccumulator(): count(0) {}
+
+  void add(double value) {
+    int k = 0;
+    for (unsigned long long c = count; c & 1; c >>= 1, ++k) {
+      value += partial[k];
+    }
+    partial[k] = value;
+    ++count;
+  }
+
+  double total() const {
+    double sum = 0.0;
+    int k = 0;
+    for (unsigned long long c = count; c; c >>= 1, ++k) {
+      if (c & 1) {
+        sum += partial[k];
+      }
+    }
+    return sum;
+  }
+};
+
+// The loss of a batch of samples x outputs (row-major) given the logits z, the outputs
+// a (the activation of z) and the labels y. If cost is given it receives the loss summed
+// over the batch, and if delta is given it receives the derivative of the loss with
+// respect to the logits. terms is scratch memory, which only grows.
+template <typename T>
+void outputLoss(const LossFunction loss, ActivationFunction &activation, const T *z, const T *a, const T *y, const int samples, const int outputs,
+                double *cost, T *delta, std::vector<double> &terms);
+
+#endif
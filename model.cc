@@ -0,0 +1,377 @@
+#include "model.h"
+#include "linalg.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char modelMagic[8] = {'M', 'L', 'M', 'O', 'D', 'E', 'L', 0};
+const uint32_t modelVersion = 1;
+const uint64_t blockAlignment = 64;
+
+uint64_t alignUp(const uint64_t value) {
+  return (value + blockAlignment - 1) / blockAlignment * blockAlignment;
+}
+
+// Constants and steps of the 64-bit xxHash algorithm
+const uint64_t prime1 = 11400714785074694791ULL;
+const uint64_t prime2 = 14029467366897019727ULL;
+const uint64_t prime3 = 1609587929392839161ULL;
+const uint64_t prime4 = 9650029242287828579ULL;
+const uint64_t prime5 = 2870177450012600261ULL;
+
+inline uint64_t rotateLeft(const uint64_t x, const int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t hashRound(uint64_t acc, const uint64_t input) {
+  acc += input * prime2;
+  return rotateLeft(acc, 31) * prime1;
+}
+
+inline uint64_t read64(const unsigned char *p) {
+  uint64_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint32_t read32(const unsigned char *p) {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint64_t checksum(const void *data, const std::size_t n) {
+  /*
+   * xxHash64 with a zero seed: four independent lanes consume 32 bytes per step, so
+   * the hash runs at memory bandwidth, and the lanes are then mixed with the tail.
+   */
+  const unsigned char *p = static_cast<const unsigned char*>(data);
+  const unsigned char *end = p + n;
+  uint64_t h;
+
+  if (n >= 32) {
+    uint64_t v1 = prime1 + prime2;
+    uint64_t v2 = prime2;
+    uint64_t v3 = 0;
+    uint64_t v4 = 0 - prime1;
+
+    for (; p + 32 <= end; p += 32) {
+      v1 = hashRound(v1, read64(p));
+      v2 = hashRound(v2, read64(p + 8));
+      v3 = hashRound(v3, read64(p + 16));
+      v4 = hashRound(v4, read64(p + 24));
+    }
+
+    h = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+    for (const uint64_t v : {v1, v2, v3, v4}) {
+      h = (h ^ hashRound(0, v)) * prime1 + prime4;
+    }
+  } else {
+    h = prime5;
+  }
+
+  h += n;
+
+  for (; p + 8 <= end; p += 8) {
+    h = rotateLeft(h ^ hashRound(0, read64(p)), 27) * prime1 + prime4;
+  }
+  if (p + 4 <= end) {
+    h = rotateLeft(h ^ (read32(p) * prime1), 23) * prime2 + prime3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h = rotateLeft(h ^ (*p * prime5), 11) * prime1;
+  }
+
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+  return h;
+}
+
+template <typename T>
+void denseLayer(const T *w, const int rows, const int cols, const T *input, const int samples, T *output) {
+  /*
+   * output = input * w(:, 1:)^T + w(:, 0), as in the network's forward pass.
+   */
+  for (int i = 0; i < samples; ++i) {
+    for (int j = 0; j < rows; ++j) {
+      output[i * rows + j] = w[j * cols];
+    }
+  }
+
+  gemm(NoTrans, Trans, samples, rows, cols - 1, T(1), input, cols - 1, w + 1, cols, T(1), output, rows);
+}
+
+}
+
+bool ModelFile::open(const std::string &path, const bool verify) {
+  /*
+   * Map the file read-only and check that the header, the layer table and the weights
+   * are consistent with each other and with the size of the file. The layer table must
+   * end before the weights start. Sizes are compared against the space left after an
+   * offset, so offsets read from the file cannot overflow the checks.
+   */
+  close();
+
+  descriptor = ::open(path.c_str(), O_RDONLY);
+  if (descriptor < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(descriptor, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(ModelHeader)) {
+    close();
+    return false;
+  }
+
+  length = info.st_size;
+  void *memory = mmap(nullptr, length, PROT_READ, MAP_SHARED, descriptor, 0);
+  if (memory == MAP_FAILED) {
+    close();
+    return false;
+  }
+  mapping = memory;
+
+  std::memcpy(&header, mapping, sizeof(header));
+
+  const uint64_t valueSize = header.valueType == FLOAT32 ? sizeof(float) : sizeof(double);
+  bool valid = std::memcmp(header.magic, modelMagic, sizeof(modelMagic)) == 0 &&
+               header.version == modelVersion &&
+               (header.valueType == FLOAT32 || header.valueType == FLOAT64) &&
+               header.layers > 0 && header.layers <= length / sizeof(ModelLayer) &&
+               header.layerOffset >= sizeof(ModelHeader) && header.layerOffset % sizeof(uint64_t) == 0 &&
+               header.parameterOffset % blockAlignment == 0 && header.parameterOffset <= length &&
+               header.parameters <= (length - header.parameterOffset) / valueSize &&
+               header.layerOffset <= header.parameterOffset &&
+               header.layers <= (header.parameterOffset - header.layerOffset) / sizeof(ModelLayer);
+
+  // Every layer must take the previous layer's outputs (plus the bias) and follow it in the weights
+  uint64_t offset = 0;
+  uint64_t previous = header.inputs;
+  for (uint32_t k = 0; valid && k < header.layers; ++k) {
+    const ModelLayer &layer = layers()[k];
+    valid = layer.rows > 0 && layer.cols == previous + 1 && layer.offset == offset &&
+            static_cast<uint64_t>(layer.rows) * layer.cols <= header.parameters - offset;
+    offset += static_cast<uint64_t>(layer.rows) * layer.cols;
+    previous = layer.rows;
+  }
+  valid = valid && offset == header.parameters && previous == header.outputs;
+
+  if (valid && verify) {
+    const uint64_t end = header.parameterOffset + header.parameters * valueSize;
+    valid = checksum(static_cast<const char*>(mapping) + sizeof(ModelHeader), end - sizeof(ModelHeader)) == header.checksum;
+  }
+
+  if (!valid) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void ModelFile::close() {
+  if (mapping) {
+    munmap(mapping, length);
+    mapping = nullptr;
+  }
+
+  if (descriptor >= 0) {
+    ::close(descriptor);
+    descriptor = -1;
+  }
+
+  length = 0;
+  std::memset(&header, 0, sizeof(header));
+}
+
+template <typename Scalar>
+bool saveModel(const BasicNeuralNetwork<Scalar> &network, const std::string &path) {
+  /*
+   * The file is written under a temporary name and renamed into place, so an existing
+   * model is never left half overwritten.
+   */
+  const ActivationFunction &activation = network.getActivation();
+  if (activation.type() == ActivationFunction::CUSTOM) {
+    return false;
+  }
+
+  ModelHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, modelMagic, sizeof(modelMagic));
+  header.version = modelVersion;
+  header.valueType = sizeof(Scalar) == sizeof(float) ? ModelFile::FLOAT32 : ModelFile::FLOAT64;
+  header.layers = network.getLayerCount();
+  header.inputs = network.getInputSize();
+  header.outputs = network.getOutputSize();
+  header.parameters = network.getParameterSize();
+  header.layerOffset = sizeof(ModelHeader);
+  header.parameterOffset = alignUp(header.layerOffset + header.layers * sizeof(ModelLayer));
+
+  // Everything after the header, which the checksum covers
+  std::vector<char> body(header.parameterOffset - sizeof(ModelHeader) + header.parameters * sizeof(Scalar), 0);
+
+  uint64_t offset = 0;
+  for (int k = 0; k < network.getLayerCount(); ++k) {
+    const MatrixView<const Scalar> w = network.getLayer(k);
+    ModelLayer layer;
+    std::memset(&layer, 0, sizeof(layer));
+    layer.rows = w.size1();
+    layer.cols = w.size2();
+    layer.activation = activation.type();
+    layer.parameter = activation.parameter();
+    layer.offset = offset;
+    std::memcpy(body.data() + header.layerOffset - sizeof(ModelHeader) + k * sizeof(ModelLayer), &layer, sizeof(layer));
+    offset += layer.rows * layer.cols;
+  }
+
+  std::memcpy(body.data() + header.parameterOffset - sizeof(ModelHeader), network.getParameters().data(), header.parameters * sizeof(Scalar));
+  header.checksum = checksum(body.data(), body.size());
+
+  const std::string temporary = path + ".tmp";
+  std::FILE *file = std::fopen(temporary.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+
+  std::fwrite(&header, sizeof(header), 1, file);
+  std::fwrite(body.data(), 1, body.size(), file);
+
+  bool valid = !std::ferror(file);
+  valid = std::fclose(file) == 0 && valid;
+  valid = valid && std::rename(temporary.c_str(), path.c_str()) == 0;
+
+  if (!valid) {
+    std::remove(temporary.c_str());
+  }
+
+  return valid;
+}
+
+template <typename Scalar>
+std::unique_ptr<BasicNeuralNetwork<Scalar> > loadModel(const std::string &path, const bool verify) {
+  /*
+   * NeuralNetwork applies one activation function to every layer and has at least one
+   * hidden layer, so only models of that form can be loaded into it.
+   */
+  ModelFile file;
+  if (!file.open(path, verify) || file.getHeader().layers < 2) {
+    return nullptr;
+  }
+
+  const ModelHeader &header = file.getHeader();
+  const ModelLayer *layers = file.layers();
+
+  std::vector<int> size;
+  for (uint32_t k = 0; k < header.layers; ++k) {
+    if (layers[k].activation != layers[0].activation || layers[k].parameter != layers[0].parameter) {
+      return nullptr;
+    }
+    if (k + 1 < header.layers) {
+      size.push_back(layers[k].rows);
+    }
+  }
+
+  ActivationFunction *activation = createActivation(layers[0].activation, layers[0].parameter);
+  if (!activation) {
+    return nullptr;
+  }
+
+  std::unique_ptr<BasicNeuralNetwork<Scalar> > network(new BasicNeuralNetwork<Scalar>(size, header.inputs, header.outputs, activation));
+
+  Span<Scalar> parameters = network->getParameters();
+  if (header.valueType == ModelFile::FLOAT32) {
+    const float *weights = static_cast<const float*>(file.parameters());
+    std::copy(weights, weights + header.parameters, parameters.begin());
+  } else {
+    const double *weights = static_cast<const double*>(file.parameters());
+    std::copy(weights, weights + header.parameters, parameters.begin());
+  }
+
+  return network;
+}
+
+template <typename Scalar>
+bool BasicMappedModel<Scalar>::open(const std::string &path, const bool verify) {
+  close();
+
+  const uint32_t valueType = sizeof(Scalar) == sizeof(float) ? ModelFile::FLOAT32 : ModelFile::FLOAT64;
+  if (!file.open(path, verify) || file.getHeader().valueType != valueType) {
+    close();
+    return false;
+  }
+
+  for (uint32_t k = 0; k < file.getHeader().layers; ++k) {
+    activations.push_back(std::unique_ptr<ActivationFunction>(createActivation(file.layers()[k].activation, file.layers()[k].parameter)));
+    if (!activations.back()) {
+      close();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+template <typename Scalar>
+void BasicMappedModel<Scalar>::close() {
+  file.close();
+  activations.clear();
+}
+
+template <typename Scalar>
+typename BasicMappedModel<Scalar>::Matrix BasicMappedModel<Scalar>::feedForwardBatch(const Matrix &input) const {
+  /*
+   * The network's forward pass, reading every layer's weights from the mapping.
+   */
+  if (!isOpen() || input.size2() != getInputSize()) {
+    return Matrix();
+  }
+
+  const int samples = input.size1();
+  const Scalar *weights = getParameters().data();
+  Matrix current = input;
+
+  for (int k = 0; k < getLayerCount(); ++k) {
+    const ModelLayer &layer = file.layers()[k];
+    Matrix next(samples, layer.rows);
+
+    if (samples > 0) {
+      denseLayer(weights + layer.offset, layer.rows, layer.cols, &current.data()[0], samples, &next.data()[0]);
+      activations[k]->activation(&next.data()[0], samples, layer.rows);
+    }
+
+    current.swap(next);
+  }
+
+  return current;
+}
+
+template <typename Scalar>
+boost::numeric::ublas::vector<double> BasicMappedModel<Scalar>::feedForwardVector(const boost::numeric::ublas::vector<double> &input) const {
+  if (!isOpen() || input.size() != getInputSize()) {
+    return boost::numeric::ublas::vector<double>();
+  }
+
+  Matrix batch(1, input.size());
+  std::copy(input.begin(), input.end(), batch.data().begin());
+
+  const Matrix output = feedForwardBatch(batch);
+  boost::numeric::ublas::vector<double> result(output.size2());
+  std::copy(output.data().begin(), output.data().end(), result.begin());
+  return result;
+}
+
+template bool saveModel(const BasicNeuralNetwork<double> &network, const std::string &path);
+template bool saveModel(const BasicNeuralNetwork<float> &network, const std::string &path);
+template std::unique_ptr<BasicNeuralNetwork<double> > loadModel(const std::string &path, const bool verify);
+template std::unique_ptr<BasicNeuralNetwork<float> > loadModel(const std::string &path, const bool verify);
+template class BasicMappedModel<double>;
+template class BasicMappedModel<float>;
@@ -0,0 +1,146 @@
+#ifndef MODEL_H_
+#define MODEL_H_
+
+/*
+ * Binary model files. A saved network can be loaded back into a NeuralNetwork (a copy of
+ * the weights), or memory-mapped with MappedModel, which runs inference straight from the
+ * mapped weights: opening a model only validates the header and layer table (and
+ * optionally the checksum), so a serving process starts in milliseconds however large the
+ * model is, and processes mapping the same file share its pages.
+ *
+ * Model file layout (native byte order):
+ *   ModelHeader (64 bytes)
+ *   layer table: one ModelLayer per layer, starting at layerOffset
+ *   weights: the network's flat parameters (row-major per layer, bias in column 0),
+ *            starting at the 64-byte aligned parameterOffset
+ * Values are float32 or float64 as given by valueType. The checksum is a 64-bit hash of
+ * everything after the header.
+ */
+
+#include "network.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct ModelHeader {
+  char magic[8]; // "MLMODEL" followed by a zero byte
+  uint32_t version;
+  uint32_t valueType; // 0 = float32, 1 = float64
+  uint32_t layers;
+  uint32_t inputs;
+  uint32_t outputs;
+  uint32_t reserved;
+  uint64_t parameters; // Number of weights
+  uint64_t layerOffset;
+  uint64_t parameterOffset;
+  uint64_t checksum;
+};
+
+struct ModelLayer {
+  uint32_t rows;
+  uint32_t cols; // Inputs plus the bias
+  uint32_t activation; // ActivationFunction::Type
+  uint32_t reserved;
+  double parameter; // Parameter of the activation function
+  uint64_t offset; // Position of the layer's first weight in the weights
+};
+
+static_assert(sizeof(ModelHeader) == 64, "Model header must be 64 bytes");
+static_assert(sizeof(ModelLayer) == 32, "Model layers must be 32 bytes");
+
+// A validated, memory-mapped model file.
+class ModelFile {
+private:
+  int descriptor;
+  void *mapping;
+  std::size_t length;
+  ModelHeader header;
+
+public:
+  static const uint32_t FLOAT32 = 0;
+  static const uint32_t FLOAT64 = 1;
+
+  ModelFile(): descriptor(-1), mapping(nullptr), length(0) {}
+  ~ModelFile() {
+    close();
+  }
+
+  ModelFile(const ModelFile&) = delete;
+  ModelFile& operator=(const ModelFile&) = delete;
+
+  // Map a model file, returning false if it cannot be opened or is not a valid model.
+  // Verifying the checksum reads the whole file.
+  bool open(const std::string &path, const bool verify = true);
+  void close();
+
+  bool isOpen() const {
+    return mapping != nullptr;
+  }
+
+  const ModelHeader& getHeader() const {
+    return header;
+  }
+
+  const ModelLayer* layers() const {
+    return reinterpret_cast<const ModelLayer*>(static_cast<const char*>(mapping) + header.layerOffset);
+  }
+
+  const void* parameters() const {
+    return static_cast<const char*>(mapping) + header.parameterOffset;
+  }
+};
+
+// Save a network with the precision of its weights. Fails for custom activation functions.
+template <typename Scalar>
+bool saveModel(const BasicNeuralNetwork<Scalar> &network, const std::string &path);
+
+// Load a saved model into a new network of the given precision (converting the weights if
+// the file holds the other one), or nullptr if the file is not a valid model.
+template <typename Scalar>
+std::unique_ptr<BasicNeuralNetwork<Scalar> > loadModel(const std::string &path, const bool verify = true);
+
+/*
+ * Inference on a memory-mapped model, whose file must hold weights of the given scalar
+ * type. Each layer uses the activation function saved with it.
+ */
+template <typename Scalar>
+class BasicMappedModel {
+private:
+  ModelFile file;
+  std::vector<std::unique_ptr<ActivationFunction> > activations;
+
+public:
+  typedef boost::numeric::ublas::matrix<Scalar> Matrix;
+
+  bool open(const std::string &path, const bool verify = true);
+  void close();
+
+  bool isOpen() const {
+    return file.isOpen();
+  }
+
+  Matrix feedForwardBatch(const Matrix &input) const;
+  boost::numeric::ublas::vector<double> feedForwardVector(const boost::numeric::ublas::vector<double> &input) const;
+
+  // The mapped weights, in the flat layout of NeuralNetwork::getParameters
+  Span<const Scalar> getParameters() const {
+    return Span<const Scalar>(static_cast<const Scalar*>(file.parameters()), file.getHeader().parameters);
+  }
+
+  int getLayerCount() const {
+    return file.getHeader().layers;
+  }
+
+  int getInputSize() const {
+    return file.getHeader().inputs;
+  }
+
+  int getOutputSize() const {
+    return file.getHeader().outputs;
+  }
+};
+
+typedef BasicMappedModel<double> MappedModel;
+typedef BasicMappedModel<float> FloatMappedModel;
+
+#endif
@@ -1,6 +1,73 @@
 #include "network.h"
+#include "linalg.h"
+#include "telemetry.h"
+#include <limits>
+
+namespace {
+
+// Number of samples pushed through the network at once when evaluating the cost.
+const int costBlockSize = 256;
+
+// Most runs of consecutive blocks the cost is split into. Each run is summed on its own
+// and the runs are added pairwise, so the split depends only on the number of blocks.
+const int costChunks = 64;
+
+// Scratch memory for scoring cost blocks, one per thread and reused between calls
+template <typename Scalar>
+struct CostScratch {
+  boost::numeric::ublas::matrix<Scalar> block;
+  boost::numeric::ublas::matrix<Scalar> expected;
+  std::vector<int> rows;
+  AlignedVector<Scalar> arena;
+  AlignedVector<Scalar> logits;
+  AlignedVector<Scalar> outputs;
+  std::vector<double> terms;
+};
+
+template <typename Scalar>
+CostScratch<Scalar> &costScratch() {
+  static thread_local CostScratch<Scalar> scratch;
+  return scratch;
+}
 
-boost::numeric::ublas::vector<double> NeuralNetwork::feedForwardVector(const boost::numeric::ublas::vector<double> input) {
+template <typename T>
+void weightedInput(const MatrixView<const T> w, const T *input, const int samples, T *output) {
+  /*
+   * output = input * w(:, 1:)^T + w(:, 0) for a batch of samples stored one per row.
+   * The bias column of the weights seeds every row of the output.
+   */
+  for (int i = 0; i < samples; ++i) {
+    for (int j = 0; j < w.size1(); ++j) {
+      output[i * w.size1() + j] = w(j, 0);
+    }
+  }
+
+  gemm(NoTrans, Trans, samples, w.size1(), w.size2() - 1,
+       T(1), input, w.size2() - 1, w.data() + 1, w.size2(),
+       T(1), output, w.size1());
+}
+
+// A sample in the network's scalar type: double samples are used in place, others are
+// converted into the buffer (input followed by expected values).
+void scalarSample(const boost::numeric::ublas::vector<double> &input, const boost::numeric::ublas::vector<double> &expected,
+                  AlignedVector<double> &buffer, const double *&in, const double *&out) {
+  in = &input.data()[0];
+  out = &expected.data()[0];
+}
+
+void scalarSample(const boost::numeric::ublas::vector<double> &input, const boost::numeric::ublas::vector<double> &expected,
+                  AlignedVector<float> &buffer, const float *&in, const float *&out) {
+  buffer.resize(input.size() + expected.size());
+  std::copy(input.begin(), input.end(), buffer.begin());
+  std::copy(expected.begin(), expected.end(), buffer.begin() + input.size());
+  in = buffer.data();
+  out = buffer.data() + input.size();
+}
+
+}
+
+template <typename Scalar>
+boost::numeric::ublas::vector<double> BasicNeuralNetwork<Scalar>::feedForwardVector(const boost::numeric::ublas::vector<double> &input) {
   /*
    * Given an input vector pass it through the neural network
    * returning the produced output.
@@ -11,15 +78,17 @@ boost::numeric::ublas::vector<double> NeuralNetwork::feedForwardVector(const boo
     return boost::numeric::ublas::vector<double>();
   }
 
-  boost::numeric::ublas::vector<double> current = input;
+  boost::numeric::ublas::vector<Scalar> current(input.size());
+  std::copy(input.begin(), input.end(), current.begin());
 
-  for (auto w : weights) {
-    boost::numeric::ublas::vector<double> tmp(w.size1());
+  for (int k = 0; k < layers.size(); ++k) {
+    const ConstScalarLayerView w = getLayer(k);
+    boost::numeric::ublas::vector<Scalar> tmp(w.size1());
 
     // We manually include the bias unit to avoid vector resizing.
     for (int i = 0; i < w.size1(); ++i) {
       // Add bias unit
-      tmp[i] = 1.0 * w(i, 0);
+      tmp[i] = w(i, 0);
       for (int j = 1; j < w.size2(); ++j) {
         tmp[i] += current[j-1] * w(i, j);
       }
@@ -28,94 +97,229 @@ boost::numeric::ublas::vector<double> NeuralNetwork::feedForwardVector(const boo
     current = tmp;
 
     // Apply activation function
-    std::for_each(current.begin(), current.end(), [this] (double &val) {
-      val = activation->activation(val);
-    });
+    activation->activation(&current[0], 1, current.size());
   }
 
-  return current;
+  boost::numeric::ublas::vector<double> output(current.size());
+  std::copy(current.begin(), current.end(), output.begin());
+  return output;
 }
 
-std::vector<boost::numeric::ublas::matrix<double> > NeuralNetwork::backPropogateVector(const boost::numeric::ublas::vector<double> input, const boost::numeric::ublas::vector<double> expected) {
+template <typename Scalar>
+typename BasicNeuralNetwork<Scalar>::Matrix BasicNeuralNetwork<Scalar>::feedForwardBatch(const Matrix &input) const {
+  return feedForwardBatch(ConstScalarSpan(parameters), input);
+}
+
+template <typename Scalar>
+typename BasicNeuralNetwork<Scalar>::Matrix BasicNeuralNetwork<Scalar>::feedForwardBatch(const ConstScalarSpan weights, const Matrix &input) const {
+  /*
+   * Pass a batch of samples (one sample per row) through the neural network using
+   * the given weights, returning the produced outputs (one output per row). Every layer
+   * is evaluated as a single matrix-matrix product instead of one matrix-vector product
+   * per sample. The network itself is not modified, so this may be called concurrently.
+   */
+
+  // If the input size or the weights do not match the network we return an empty matrix.
+  if (input.size2() != numberInput || weights.size() != parameters.size()) {
+    return Matrix();
+  }
+
+  Matrix output(input.size1(), numberOutput);
+  AlignedVector<Scalar> arena;
+  forward(weights, input.data().begin(), input.size1(), output.data().begin(), arena, true);
+  return output;
+}
+
+template <typename Scalar>
+void BasicNeuralNetwork<Scalar>::feedForwardBatch(const Scalar *input, const int samples, Scalar *output, Workspace &workspace) const {
+  forward(ConstScalarSpan(parameters), input, samples, output, workspace.arena, true);
+}
+
+template <typename Scalar>
+void BasicNeuralNetwork<Scalar>::forward(const ConstScalarSpan weights, const Scalar *input, const int samples, Scalar *output,
+                                         AlignedVector<Scalar> &arena, const bool activateOutput) const {
+  /*
+   * The forward pass alternating between two halves of the arena, with the last layer
+   * written straight into the output.
+   */
+  ML_TRACE_SCOPE("forward");
+
+  if (samples == 0) {
+    return;
+  }
+
+  int width = 0;
+  for (const auto &shape : layers) {
+    width = std::max(width, shape.rows);
+  }
+
+  const std::size_t required = static_cast<std::size_t>(samples) * 2 * width;
+  if (arena.size() < required) {
+    arena.resize(required);
+  }
+
+  const Scalar *current = input;
+  for (int k = 0; k < layers.size(); ++k) {
+    Scalar *next = k + 1 == layers.size() ? output : arena.data() + (k % 2) * samples * width;
+
+    weightedInput(layer(weights, k), current, samples, next);
+    if (activateOutput || k + 1 < layers.size()) {
+      activation->activation(next, samples, layers[k].rows);
+    }
+    current = next;
+  }
+}
+
+template <typename Scalar>
+std::vector<boost::numeric::ublas::matrix<double> > BasicNeuralNetwork<Scalar>::backPropogateVector(const boost::numeric::ublas::vector<double> &input, const boost::numeric::ublas::vector<double> &expected) {
   /*
    * This function calculates the gradient of the cost function w.r.t
-   * network weights using the back propogation algorithm.
+   * network weights for a single sample using the back propogation algorithm,
+   * returning one gradient matrix per layer.
    */
+  Parameters gradient(parameters.size());
+  Workspace workspace;
 
   // If the input size or output size does not match the networks return an empty vector
-  if (input.size() != numberInput ||  expected.size() != numberOutput) {
+  if (!backPropogateVector(input, expected, gradient, workspace)) {
     return std::vector<boost::numeric::ublas::matrix<double> >();
   }
 
-  std::vector<boost::numeric::ublas::vector<double> > a;
-  std::vector<boost::numeric::ublas::vector<double> > z;
+  std::vector<boost::numeric::ublas::matrix<double> > Delta;
+  for (const auto &shape : layers) {
+    boost::numeric::ublas::matrix<double> tmp(shape.rows, shape.cols);
+    std::copy(gradient.begin() + shape.offset, gradient.begin() + shape.offset + shape.rows * shape.cols, tmp.data().begin());
+    Delta.push_back(tmp);
+  }
 
-  boost::numeric::ublas::vector<double> current = input;
-  a.push_back(addBiasUnit(input));
+  return Delta;
+}
 
-  for (auto w : weights) {
-    boost::numeric::ublas::vector<double> tmp(w.size1());
+template <typename Scalar>
+bool BasicNeuralNetwork<Scalar>::backPropogateVector(const boost::numeric::ublas::vector<double> &input, const boost::numeric::ublas::vector<double> &expected, const ScalarSpan gradient, Workspace &workspace) const {
+  // A single sample is a batch of one
+  if (input.size() != numberInput || expected.size() != numberOutput || gradient.size() != parameters.size()) {
+    return false;
+  }
 
-    // We manually include the bias unit to avoid vector resizing
-    for (int i = 0; i < w.size1(); ++i) {
-      // Add bias unit
-      tmp[i] = 1.0 * w(i, 0);
-      for (int j = 1; j < w.size2(); ++j) {
-        tmp[i] += current[j-1] * w(i, j);
-      }
-    }
+  const Scalar *in;
+  const Scalar *out;
+  scalarSample(input, expected, workspace.sample, in, out);
 
-    current = tmp;
-    z.push_back(current);
+  backPropogate(in, out, 1, gradient, workspace, nullptr);
+  return true;
+}
 
-    // Apply activation function
-    std::for_each(current.begin(), current.end(), [this] (double &val) {
-      val = activation->activation(val);
-    });
+template <typename Scalar>
+bool BasicNeuralNetwork<Scalar>::backPropogateBatch(const Matrix &input, const Matrix &expected, const ScalarSpan gradient, double *batchCost) const {
+  Workspace workspace;
+  return backPropogateBatch(input, expected, gradient, workspace, batchCost);
+}
 
-    a.push_back(addBiasUnit(current));
+template <typename Scalar>
+bool BasicNeuralNetwork<Scalar>::backPropogateBatch(const Matrix &input, const Matrix &expected, const ScalarSpan gradient, Workspace &workspace, double *batchCost) const {
+  // If the input size, output size or gradient size does not match the networks (or the batch is empty) we fail
+  if (input.size2() != numberInput || expected.size2() != numberOutput || input.size1() != expected.size1() ||
+      input.size1() == 0 || gradient.size() != parameters.size()) {
+    return false;
   }
 
-  std::deque<boost::numeric::ublas::vector<double> > delta;
+  backPropogate(&input.data()[0], &expected.data()[0], input.size1(), gradient, workspace, batchCost);
+  return true;
+}
 
-  // Error from output layer and expected value
-  delta.push_front(current - expected);
+template <typename Scalar>
+void BasicNeuralNetwork<Scalar>::backPropogate(const Scalar *input, const Scalar *expected, const int samples, const ScalarSpan gradient, Workspace &workspace, double *batchCost) const {
+  /*
+   * Calculate the gradient of the cost function w.r.t network weights summed over
+   * a batch of samples (one sample per row), writing it into the flat gradient array
+   * (laid out like the parameters). Activations and deltas are kept as matrices so
+   * each layer needs one matrix product forward, one backward and a single transposed
+   * product to form its gradient. If batchCost is given it receives the cost summed
+   * over the batch, which comes almost for free as the forward pass is already done.
+   *
+   * Every intermediate result lives in the workspace, which only grows when a larger
+   * batch is seen, so repeated calls do not allocate.
+   */
 
-  // Propogate Error to other layers
-  for (int k = weights.size() - 1; k > 0; k--) {
+  // The workspace holds, for every layer, its weighted inputs (z) followed by its
+  // activations (a), then two buffers for the deltas wide enough for any layer.
+  int width = numberInput;
+  for (const auto &shape : layers) {
+    width = std::max(width, shape.rows);
+  }
+
+  const std::size_t required = static_cast<std::size_t>(samples) * (2 * layers.back().units + 2 * layers.back().rows + 2 * width);
+  if (workspace.arena.size() < required) {
+    workspace.arena.resize(required);
+  }
 
-    boost::numeric::ublas::vector<double> currA = a[k];
-    boost::numeric::ublas::vector<double> currZ = z[k-1];
+  Scalar *arena = workspace.arena.data();
+  auto weighted = [&] (const int k) { return arena + 2 * samples * layers[k].units; };
+  auto activations = [&] (const int k) -> const Scalar* { return k == 0 ? input : weighted(k - 1) + samples * layers[k - 1].rows; };
 
-    boost::numeric::ublas::vector<double> stepBack = boost::numeric::ublas::prod(boost::numeric::ublas::trans(weights[k]), delta.front());
+  Scalar *delta = arena + 2 * samples * (layers.back().units + layers.back().rows);
+  Scalar *stepBack = delta + samples * width;
 
-    // Apply the gradient of the activation function
-    std::for_each(currZ.begin(), currZ.end(), [this] (double &val) {
-      val = activation->gradient(val);
-    });
+  {
+    ML_TRACE_SCOPE("forward");
+    for (int k = 0; k < layers.size(); ++k) {
+      Scalar *z = weighted(k);
+      Scalar *a = z + samples * layers[k].rows;
 
-    // Resize tmp by removing the first element (bias unit)
-    boost::numeric::ublas::vector<double> tmp2(stepBack.size()-1);
+      weightedInput(getLayer(k), activations(k), samples, z);
 
-    for (int i = 1; i < stepBack.size(); ++i) {
-      stepBack[i] *= currZ[i-1];
-      tmp2[i-1] = stepBack[i];
+      // Apply activation function
+      std::copy(z, z + samples * layers[k].rows, a);
+      activation->activation(a, samples, layers[k].rows);
     }
-
-    // Add the calculated delta to the deque
-    delta.push_front(tmp2);
   }
 
-  // Finally we use the above deltas to calculate the gradient w.r.t weights.
-  std::vector<boost::numeric::ublas::matrix<double> > Delta;
-  for (int k=0; k < delta.size(); ++k) {
-    Delta.push_back(boost::numeric::ublas::outer_prod(delta[k], a[k]));
-  }
+  ML_TRACE_SCOPE("backprop");
 
-  return Delta;
+  const Scalar *output = activations(layers.size());
+
+  // Error from output layer and expected value, with the cost found in the same pass
+  outputLoss(loss, *activation, weighted(layers.size() - 1), output, expected, samples, numberOutput, batchCost, delta, workspace.losses);
+
+  for (int k = layers.size() - 1; k >= 0; k--) {
+    const ConstScalarLayerView w = getLayer(k);
+    const Scalar *previous = activations(k);
+    const ScalarLayerView Delta(gradient.data() + layers[k].offset, layers[k].rows, layers[k].cols);
+
+    // The bias gradient is the sum of the deltas over the batch
+    for (int j = 0; j < w.size1(); ++j) {
+      Delta(j, 0) = 0;
+    }
+    for (int i = 0; i < samples; ++i) {
+      for (int j = 0; j < w.size1(); ++j) {
+        Delta(j, 0) += delta[i * w.size1() + j];
+      }
+    }
+
+    // Remaining columns: delta^T * a, summing the outer products of all samples at once
+    gemm(Trans, NoTrans, w.size1(), w.size2() - 1, samples,
+         Scalar(1), delta, w.size1(), previous, w.size2() - 1,
+         Scalar(0), Delta.data() + 1, Delta.size2());
+
+    if (k == 0) {
+      break;
+    }
+
+    // Propogate the error back through the weights (skipping the bias column)
+    gemm(NoTrans, NoTrans, samples, w.size2() - 1, w.size1(),
+         Scalar(1), delta, w.size1(), w.data() + 1, w.size2(),
+         Scalar(0), stepBack, w.size2() - 1);
+
+    // Apply the gradient of the activation function (previous holds the activations of layer k-1)
+    activation->gradient(weighted(k - 1), previous, stepBack, samples, w.size2() - 1);
+
+    std::swap(delta, stepBack);
+  }
 }
 
-boost::numeric::ublas::vector<double> NeuralNetwork::addBiasUnit(const boost::numeric::ublas::vector<double> input) {
+template <typename Scalar>
+boost::numeric::ublas::vector<double> BasicNeuralNetwork<Scalar>::addBiasUnit(const boost::numeric::ublas::vector<double> &input) {
   /*
    * Add Bias unit to vector
    */
@@ -123,11 +327,12 @@ boost::numeric::ublas::vector<double> NeuralNetwork::addBiasUnit(const boost::nu
 
   tmp[0] = 1.0;
   std::copy(input.begin(), input.end(), tmp.begin()+1);
-  
+
   return tmp;
 }
 
-void NeuralNetwork::initializeRandomWeights(const double epsilon) {
+template <typename Scalar>
+void BasicNeuralNetwork<Scalar>::initializeRandomWeights(const double epsilon) {
   /*
    * Initialize a normal distribution generator and
    * construct a trivial random generator engine from a time-based seed:
@@ -136,26 +341,140 @@ void NeuralNetwork::initializeRandomWeights(const double epsilon) {
   std::default_random_engine generator (seed);
   std::normal_distribution<double> distribution(epsilon, 2.0 * epsilon);
 
-  for (auto &w : weights) {
-    for (int i = 0; i < w.size1(); ++i)
-        for (int j = 0; j < w.size2(); ++j)
-            w(i, j) = distribution(generator);
+  for (auto &w : parameters) {
+    w = distribution(generator);
+  }
+}
+
+template <typename Scalar>
+std::vector<boost::numeric::ublas::matrix<double> > BasicNeuralNetwork<Scalar>::getWeights() {
+  /*
+   * Copy the weights out of the parameter buffer, one matrix per layer.
+   */
+  std::vector<boost::numeric::ublas::matrix<double> > weights;
+
+  for (const auto &shape : layers) {
+    boost::numeric::ublas::matrix<double> w(shape.rows, shape.cols);
+    std::copy(parameters.begin() + shape.offset, parameters.begin() + shape.offset + shape.rows * shape.cols, w.data().begin());
+    weights.push_back(w);
+  }
+
+  return weights;
+}
+
+template <typename Scalar>
+void BasicNeuralNetwork<Scalar>::setWeights(const std::vector<boost::numeric::ublas::matrix<double> > &newWeights) {
+  /*
+   * Copy one matrix per layer into the parameter buffer. Weights which do not
+   * match the shape of the network are ignored.
+   */
+  if (newWeights.size() != layers.size()) {
+    return;
+  }
+
+  for (int k = 0; k < layers.size(); ++k) {
+    if (newWeights[k].size1() != layers[k].rows || newWeights[k].size2() != layers[k].cols) {
+      return;
+    }
+  }
+
+  for (int k = 0; k < layers.size(); ++k) {
+    std::copy(newWeights[k].data().begin(), newWeights[k].data().end(), parameters.begin() + layers[k].offset);
   }
 }
 
-double NeuralNetwork::cost(const std::vector<boost::numeric::ublas::vector<double> > input, const std::vector<boost::numeric::ublas::vector<double> > expected) {
+template <typename Scalar>
+double BasicNeuralNetwork<Scalar>::cost(const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected) const {
+    return cost(ConstScalarSpan(parameters), DatasetView(input, expected));
+}
+
+template <typename Scalar>
+double BasicNeuralNetwork<Scalar>::cost(const ConstScalarSpan weights, const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected) const {
+    return cost(weights, DatasetView(input, expected));
+}
+
+template <typename Scalar>
+double BasicNeuralNetwork<Scalar>::cost(const DatasetView &data, ThreadPool *pool) const {
+    return cost(ConstScalarSpan(parameters), data, pool);
+}
+
+template <typename Scalar>
+double BasicNeuralNetwork<Scalar>::cost(const ConstScalarSpan weights, const DatasetView &data, ThreadPool *pool) const {
     /*
-     * Calculate the unregularized cost function.
+     * Calculate the unregularized cost function for the given weights without
+     * modifying the network, so several weight sets can be scored concurrently.
+     * The dataset is only viewed: memory use is bounded by the block size.
      */
-    double J = 0.0;
+    return costSum(weights, data, 0, data.size(), pool)/data.size();
+}
+
+template <typename Scalar>
+double BasicNeuralNetwork<Scalar>::costSum(const ConstScalarSpan weights, const DatasetView &data, const int begin, const int end, ThreadPool *pool) const {
+    /*
+     * The cost of rows [begin, end) of the dataset, summed rather than averaged. Each
+     * block's cost is computed from the logits of the output layer. The blocks are split
+     * into at most costChunks runs, each run's costs are added pairwise as they come,
+     * and the run totals are added pairwise at the end.
+     */
+
+    // A dataset with a different number of features or labels (or weights of another network) cannot be scored
+    if (data.getInputSize() != numberInput || data.getOutputSize() != numberOutput || weights.size() != parameters.size()) {
+      return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    ML_TRACE_SCOPE("cost");
 
-    for (int k = 0; k < input.size(); k++) {
-      auto output = feedForwardVector(input[k]);
+    // The dataset is fed through the network in blocks of samples so every layer
+    // is a matrix-matrix product while the memory used stays bounded.
+    const int blocks = end > begin ? (end - begin + costBlockSize - 1) / costBlockSize : 0;
+    const int chunks = std::min(blocks, costChunks);
+    double chunkCost[costChunks];
 
-      for (int i = 0; i < output.size(); ++i) {
-        J += expected[k][i]*log(output[i]) +  (1 - expected[k][i])*log(1 - output[i]);
+    auto score = [&] (const int c) {
+      CostScratch<Scalar> &scratch = costScratch<Scalar>();
+      if (scratch.block.size1() != costBlockSize || scratch.block.size2() != numberInput || scratch.expected.size2() != numberOutput) {
+        scratch.block.resize(costBlockSize, numberInput, false);
+        scratch.expected.resize(costBlockSize, numberOutput, false);
+      }
+      const std::size_t outputs = static_cast<std::size_t>(costBlockSize) * numberOutput;
+      if (scratch.logits.size() < outputs) {
+        scratch.logits.resize(outputs);
+        scratch.outputs.resize(outputs);
+      }
+
+      PairwiseAccumulator sum;
+      for (int b = static_cast<long long>(c) * blocks / chunks; b < static_cast<long long>(c + 1) * blocks / chunks; ++b) {
+        const int start = begin + b * costBlockSize;
+        const int samples = std::min<int>(costBlockSize, end - start);
+
+        scratch.rows.resize(samples);
+        for (int k = 0; k < samples; ++k) {
+          scratch.rows[k] = start + k;
+        }
+        data.gather(scratch.rows.data(), samples, scratch.block, scratch.expected);
+
+        forward(weights, scratch.block.data().begin(), samples, scratch.logits.data(), scratch.arena, false);
+        std::copy(scratch.logits.begin(), scratch.logits.begin() + samples * numberOutput, scratch.outputs.begin());
+        activation->activation(scratch.outputs.data(), samples, numberOutput);
+
+        double blockCost;
+        outputLoss<Scalar>(loss, *activation, scratch.logits.data(), scratch.outputs.data(), scratch.expected.data().begin(), samples, numberOutput,
+                           &blockCost, nullptr, scratch.terms);
+        sum.add(blockCost);
+      }
+      chunkCost[c] = sum.total();
+    };
+
+    if (pool && chunks > 1) {
+      pool->run(chunks, score);
+    } else {
+      for (int c = 0; c < chunks; ++c) {
+        score(c);
       }
     }
 
-    return (-J/input.size());
+    return pairwiseSum(chunkCost, chunks);
 }
+
+template class BasicNeuralNetwork<double>;
+template class BasicNeuralNetwork<float>;
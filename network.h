@@ -2,6 +2,10 @@
 #define NETWORK_H_
 
 #include "activation.h"
+#include "dataset.h"
+#include "loss.h"
+#include "parameters.h"
+#include "threadpool.h"
 #include <boost/numeric/ublas/matrix.hpp>
 #include <boost/numeric/ublas/io.hpp>
 #include <random>
@@ -10,52 +14,184 @@
 #include <vector>
 #include <memory>
 
-class NeuralNetwork {
+template <typename Scalar>
+class BasicNeuralNetwork;
+
+/*
+ * Scratch memory for back propogation: the activations, weighted inputs and deltas of
+ * a batch are carved out of a single arena which only grows, so once it has seen the
+ * largest batch a training step allocates nothing. A workspace may be used with any
+ * network of the same scalar type, but only by one thread at a time.
+ */
+template <typename Scalar>
+class BasicTrainingWorkspace {
 private:
+  friend class BasicNeuralNetwork<Scalar>;
+  AlignedVector<Scalar> arena;
+  AlignedVector<Scalar> sample; // A single sample converted to the network's scalar type
+  std::vector<double> losses; // Loss terms of the batch, before they are summed
+};
+
+/*
+ * A feedforward network whose weights and arithmetic use the given scalar type
+ * (double or float). Single precision halves the memory traffic and doubles the SIMD
+ * width of every kernel. Samples are always given in double precision (or read from a
+ * dataset) and converted as they are gathered, and costs are accumulated in double.
+ */
+template <typename Scalar>
+class BasicNeuralNetwork {
+public:
+  typedef Scalar value_type;
+  typedef AlignedVector<Scalar> Parameters;
+  typedef Span<Scalar> ScalarSpan;
+  typedef Span<const Scalar> ConstScalarSpan;
+  typedef MatrixView<Scalar> ScalarLayerView;
+  typedef MatrixView<const Scalar> ConstScalarLayerView;
+  typedef boost::numeric::ublas::matrix<Scalar> Matrix;
+  typedef BasicTrainingWorkspace<Scalar> Workspace;
+
+private:
+  // Position of a layer's weight matrix (rows x cols, bias in column 0) in the parameter buffer
+  struct LayerShape {
+    int rows;
+    int cols;
+    int offset;
+    int units; // Number of neurons in the layers before this one
+  };
+
   int numberInput; // Number of input neurons
   int numberOutput; // Number of output neurons
-  std::vector<boost::numeric::ublas::matrix <double> > weights;
+  std::vector<LayerShape> layers;
+  Parameters parameters; // Weights of every layer stored contiguously
   std::unique_ptr<ActivationFunction> activation;
+  LossFunction loss;
+
+  void addLayer(const int rows, const int cols) {
+    LayerShape shape = {rows, cols, layers.empty() ? 0 : layers.back().offset + layers.back().rows * layers.back().cols,
+                        layers.empty() ? 0 : layers.back().units + layers.back().rows};
+    layers.push_back(shape);
+  }
+
+  ConstScalarLayerView layer(const ConstScalarSpan weights, const int k) const {
+    return ConstScalarLayerView(weights.data() + layers[k].offset, layers[k].rows, layers[k].cols);
+  }
+
+  // Forward pass of samples rows of input into output with the given weights, through
+  // the arena (which only grows). Without activateOutput the last layer's weighted inputs
+  // (the logits) are left without the activation.
+  void forward(const ConstScalarSpan weights, const Scalar *input, const int samples, Scalar *output,
+               AlignedVector<Scalar> &arena, const bool activateOutput) const;
+
+  void backPropogate(const Scalar *input, const Scalar *expected, const int samples, const ScalarSpan gradient, Workspace &workspace, double *batchCost) const;
 
 public:
-  NeuralNetwork(const std::vector<int> layerSize, const int input, const int output, ActivationFunction* active):
-    numberInput(input), numberOutput(output), activation(std::unique_ptr<ActivationFunction>(active)) {
+  BasicNeuralNetwork(const std::vector<int> layerSize, const int input, const int output, ActivationFunction* active):
+    numberInput(input), numberOutput(output), activation(std::unique_ptr<ActivationFunction>(active)), loss(CROSS_ENTROPY) {
     // Add input weights
-    weights.push_back(boost::numeric::ublas::matrix<double>(layerSize[0], input + 1));
+    addLayer(layerSize[0], input + 1);
 
     // Add weights for hidden layers
     for (int i = 1; i < layerSize.size(); ++i) {
-        weights.push_back(boost::numeric::ublas::matrix<double>(layerSize[i], layerSize[i - 1] + 1));
+        addLayer(layerSize[i], layerSize[i - 1] + 1);
     }
 
     // Add output weights
-    weights.push_back(boost::numeric::ublas::matrix<double>(output, layerSize[layerSize.size() - 1] + 1));
+    addLayer(output, layerSize[layerSize.size() - 1] + 1);
+
+    parameters.resize(layers.back().offset + layers.back().rows * layers.back().cols, 0.0);
   }
 
-  boost::numeric::ublas::vector<double> feedForwardVector(const boost::numeric::ublas::vector<double> input);
-  std::vector<boost::numeric::ublas::matrix<double> > backPropogateVector(const boost::numeric::ublas::vector<double> input, boost::numeric::ublas::vector<double> expected);
-  boost::numeric::ublas::vector<double> addBiasUnit(const boost::numeric::ublas::vector<double> input);
+  boost::numeric::ublas::vector<double> feedForwardVector(const boost::numeric::ublas::vector<double> &input);
+  Matrix feedForwardBatch(const Matrix &input) const;
+  Matrix feedForwardBatch(const ConstScalarSpan weights, const Matrix &input) const;
+
+  // Forward pass of samples rows of input into output (samples x output size) through the
+  // workspace, so repeated calls with batches no larger than before do not allocate.
+  void feedForwardBatch(const Scalar *input, const int samples, Scalar *output, Workspace &workspace) const;
+  std::vector<boost::numeric::ublas::matrix<double> > backPropogateVector(const boost::numeric::ublas::vector<double> &input, const boost::numeric::ublas::vector<double> &expected);
+  bool backPropogateBatch(const Matrix &input, const Matrix &expected, const ScalarSpan gradient, double *batchCost = nullptr) const;
+
+  // Back propogation into caller-owned buffers, reusing the workspace between calls
+  bool backPropogateVector(const boost::numeric::ublas::vector<double> &input, const boost::numeric::ublas::vector<double> &expected, const ScalarSpan gradient, Workspace &workspace) const;
+  bool backPropogateBatch(const Matrix &input, const Matrix &expected, const ScalarSpan gradient, Workspace &workspace, double *batchCost = nullptr) const;
+  boost::numeric::ublas::vector<double> addBiasUnit(const boost::numeric::ublas::vector<double> &input);
 
   void initializeRandomWeights(const double epsilon = 0.12);
-  double cost(const std::vector<boost::numeric::ublas::vector<double> > input, const std::vector<boost::numeric::ublas::vector<double> > expected);
+  double cost(const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected) const;
+  double cost(const ConstScalarSpan weights, const std::vector<boost::numeric::ublas::vector<double> > &input, const std::vector<boost::numeric::ublas::vector<double> > &expected) const;
+  // The cost of a dataset, computed in blocks of samples; with a pool the blocks are
+  // scored in parallel. The block costs are added pairwise in a fixed order, so the
+  // result does not depend on the number of threads. Each thread keeps its own scratch
+  // between calls, so scoring allocates nothing once it has seen the network.
+  double cost(const DatasetView &data, ThreadPool *pool = nullptr) const;
+  double cost(const ConstScalarSpan weights, const DatasetView &data, ThreadPool *pool = nullptr) const;
+
+  // The cost summed (not averaged) over rows [begin, end) of the dataset, for scoring on
+  // part of it. Every sample adds a non-negative amount when the labels lie in [0, 1].
+  double costSum(const ConstScalarSpan weights, const DatasetView &data, const int begin, const int end, ThreadPool *pool = nullptr) const;
+
+  // The loss minimized by training and reported by the cost (cross entropy by default)
+  void setLoss(const LossFunction _loss) {
+    loss = _loss;
+  }
+
+  LossFunction getLoss() const {
+    return loss;
+  }
+
+  // Copies of the weights as one matrix per layer (prefer the views below on hot paths)
+  std::vector<boost::numeric::ublas::matrix<double> > getWeights();
+  void setWeights(const std::vector<boost::numeric::ublas::matrix<double> > &newWeights);
+
+  // All weights as a single flat array, laid out layer by layer in row-major order
+  ScalarSpan getParameters() {
+    return ScalarSpan(parameters);
+  }
+
+  ConstScalarSpan getParameters() const {
+    return ConstScalarSpan(parameters);
+  }
+
+  void setParameters(const ConstScalarSpan newParameters) {
+    if (newParameters.size() != parameters.size()) {
+      return;
+    }
+    std::copy(newParameters.begin(), newParameters.end(), parameters.begin());
+  }
 
-  std::vector<boost::numeric::ublas::matrix<double> > getWeights() {
-    return weights;
+  int getParameterSize() const {
+    return parameters.size();
   }
 
-  void setWeights(const std::vector<boost::numeric::ublas::matrix<double> > newWeights) {
-    weights = newWeights;
+  // The weight matrix of layer k viewed in place
+  ScalarLayerView getLayer(const int k) {
+    return ScalarLayerView(parameters.data() + layers[k].offset, layers[k].rows, layers[k].cols);
   }
 
-  int getInputSize() {
+  ConstScalarLayerView getLayer(const int k) const {
+    return layer(ConstScalarSpan(parameters), k);
+  }
+
+  int getLayerCount() const {
+    return layers.size();
+  }
+
+  int getInputSize() const {
     return numberInput;
   }
 
-  int getOutputSize() {
+  int getOutputSize() const {
     return numberOutput;
   }
 
-
+  const ActivationFunction& getActivation() const {
+    return *activation;
+  }
 };
 
+typedef BasicNeuralNetwork<double> NeuralNetwork;
+typedef BasicNeuralNetwork<float> FloatNeuralNetwork;
+typedef BasicTrainingWorkspace<double> TrainingWorkspace;
+typedef BasicTrainingWorkspace<float> FloatTrainingWorkspace;
+
 #endif
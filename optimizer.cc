@@ -0,0 +1,305 @@
+#include "optimizer.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OPTIMIZER_X86
+#endif
+
+namespace {
+
+/*
+ * The update rules, one weight at a time. Every rule is applied by a plain loop which
+ * the compiler vectorizes for each instruction set the loop is compiled for.
+ */
+
+template <typename T, typename G>
+struct PlainRule {
+  T *w;
+  const G *g;
+  T step;
+
+  __attribute__((always_inline)) void operator()(const int i) const {
+    w[i] -= step * g[i];
+  }
+};
+
+template <typename T, typename G>
+struct MomentumRule {
+  T *w;
+  T *v;
+  const G *g;
+  T step;
+  T momentum;
+
+  __attribute__((always_inline)) void operator()(const int i) const {
+    const T velocity = momentum * v[i] + step * g[i];
+    v[i] = velocity;
+    w[i] -= velocity;
+  }
+};
+
+template <typename T, typename G>
+struct NesterovRule {
+  T *w;
+  T *v;
+  const G *g;
+  T step;
+  T momentum;
+
+  __attribute__((always_inline)) void operator()(const int i) const {
+    const T x = step * g[i];
+    const T velocity = momentum * v[i] + x;
+    v[i] = velocity;
+    w[i] -= momentum * velocity + x;
+  }
+};
+
+template <typename T, typename G>
+struct AdaGradRule {
+  T *w;
+  T *squares;
+  const G *g;
+  T rate;
+  T scale;
+  T epsilon;
+
+  __attribute__((always_inline)) void operator()(const int i) const {
+    const T x = scale * g[i];
+    const T sum = squares[i] + x * x;
+    squares[i] = sum;
+    w[i] -= rate * x / (std::sqrt(sum) + epsilon);
+  }
+};
+
+template <typename T, typename G>
+struct RMSPropRule {
+  T *w;
+  T *squares;
+  const G *g;
+  T rate;
+  T scale;
+  T decay;
+  T epsilon;
+
+  __attribute__((always_inline)) void operator()(const int i) const {
+    const T x = scale * g[i];
+    const T mean = decay * squares[i] + (1 - decay) * x * x;
+    squares[i] = mean;
+    w[i] -= rate * x / (std::sqrt(mean) + epsilon);
+  }
+};
+
+template <typename T, typename G>
+struct AdamRule {
+  T *w;
+  T *m;
+  T *v;
+  const G *g;
+  T rate; // Includes the bias correction of the first moment
+  T scale;
+  T beta1;
+  T beta2;
+  T correction; // 1/sqrt of the bias correction of the second moment
+  T epsilon;
+
+  __attribute__((always_inline)) void operator()(const int i) const {
+    const T x = scale * g[i];
+    const T first = beta1 * m[i] + (1 - beta1) * x;
+    const T second = beta2 * v[i] + (1 - beta2) * x * x;
+    m[i] = first;
+    v[i] = second;
+    w[i] -= rate * first / (std::sqrt(second) * correction + epsilon);
+  }
+};
+
+template <typename Rule>
+__attribute__((always_inline)) inline void runRule(const Rule &rule, const int n) {
+  for (int i = 0; i < n; ++i) {
+    rule(i);
+  }
+}
+
+#ifdef OPTIMIZER_X86
+template <typename Rule>
+__attribute__((target("avx2,fma"))) void avx2Run(const Rule &rule, const int n) {
+  runRule(rule, n);
+}
+
+template <typename Rule>
+__attribute__((target("avx512f"))) void avx512Run(const Rule &rule, const int n) {
+  runRule(rule, n);
+}
+#endif
+
+enum InstructionSet { SCALAR, AVX2, AVX512 };
+
+InstructionSet instructionSet() {
+  // Follow the choice of the activation kernels (including ML_KERNELS)
+  static const InstructionSet chosen = std::strcmp(kernelInstructionSet(), "avx512") == 0 ? AVX512 :
+                                       std::strcmp(kernelInstructionSet(), "avx2") == 0 ? AVX2 : SCALAR;
+  return chosen;
+}
+
+template <typename Rule>
+void run(const Rule &rule, const int n) {
+#ifdef OPTIMIZER_X86
+  switch (instructionSet()) {
+  case AVX512:
+    avx512Run(rule, n);
+    return;
+  case AVX2:
+    avx2Run(rule, n);
+    return;
+  default:
+    break;
+  }
+#endif
+  runRule(rule, n);
+}
+
+template <typename T>
+class FusedOptimizer : public BasicOptimizer<T> {
+private:
+  OptimizerSettings settings;
+  int64_t steps;
+  AlignedVector<T> first; // Velocity, sum or mean of the squared gradients, or Adam's first moment
+  AlignedVector<T> second; // Adam's second moment
+
+  template <typename G>
+  void apply(T *weights, const G *gradient, const int n, const double rate, const double scale);
+
+public:
+  explicit FusedOptimizer(const OptimizerSettings &_settings): settings(_settings), steps(0) {}
+
+  void update(T *weights, const double *gradient, const int n, const double rate, const double scale) override {
+    apply(weights, gradient, n, rate, scale);
+  }
+
+  void update(T *weights, const float *gradient, const int n, const double rate, const double scale) override {
+    apply(weights, gradient, n, rate, scale);
+  }
+
+  void reset() override {
+    steps = 0;
+    first.clear();
+    second.clear();
+  }
+
+  const OptimizerSettings& getSettings() const override {
+    return settings;
+  }
+
+  void save(SnapshotWriter &out) const override {
+    out.value(static_cast<uint32_t>(settings.type));
+    out.value(steps);
+    out.array(first.data(), first.size());
+    out.array(second.data(), second.size());
+  }
+
+  bool load(SnapshotReader &in) override {
+    uint32_t type = 0;
+    int64_t savedSteps = 0;
+    AlignedVector<T> savedFirst;
+    AlignedVector<T> savedSecond;
+
+    in.value(type);
+    in.value(savedSteps);
+    in.array(savedFirst);
+    in.array(savedSecond);
+
+    if (!in.good() || type != settings.type || (!savedSecond.empty() && savedSecond.size() != savedFirst.size())) {
+      return false;
+    }
+
+    steps = savedSteps;
+    first.swap(savedFirst);
+    second.swap(savedSecond);
+    return true;
+  }
+};
+
+template <typename T>
+template <typename G>
+void FusedOptimizer<T>::apply(T *weights, const G *gradient, const int n, const double rate, const double scale) {
+  /*
+   * Size the state on the first step, then run the rule over every weight.
+   */
+  const bool plain = settings.type == MOMENTUM && settings.momentum == 0.0;
+  if (!plain && first.size() != n) {
+    first.assign(n, T(0));
+  }
+  if (settings.type == ADAM && second.size() != n) {
+    second.assign(n, T(0));
+  }
+
+  steps++;
+
+  switch (settings.type) {
+  case MOMENTUM:
+    if (plain) {
+      run(PlainRule<T, G>{weights, gradient, T(rate * scale)}, n);
+    } else {
+      run(MomentumRule<T, G>{weights, first.data(), gradient, T(rate * scale), T(settings.momentum)}, n);
+    }
+    break;
+
+  case NESTEROV:
+    run(NesterovRule<T, G>{weights, first.data(), gradient, T(rate * scale), T(settings.momentum)}, n);
+    break;
+
+  case ADAGRAD:
+    run(AdaGradRule<T, G>{weights, first.data(), gradient, T(rate), T(scale), T(settings.epsilon)}, n);
+    break;
+
+  case RMSPROP:
+    run(RMSPropRule<T, G>{weights, first.data(), gradient, T(rate), T(scale), T(settings.decay), T(settings.epsilon)}, n);
+    break;
+
+  case ADAM: {
+    const double firstCorrection = 1.0 - std::pow(settings.momentum, static_cast<double>(steps));
+    const double secondCorrection = 1.0 - std::pow(settings.decay, static_cast<double>(steps));
+    run(AdamRule<T, G>{weights, first.data(), second.data(), gradient, T(rate / firstCorrection), T(scale),
+                       T(settings.momentum), T(settings.decay), T(1.0 / std::sqrt(secondCorrection)), T(settings.epsilon)}, n);
+    break;
+  }
+  }
+}
+
+}
+
+template <typename T>
+std::unique_ptr<BasicOptimizer<T> > createOptimizer(const OptimizerSettings &settings) {
+  return std::unique_ptr<BasicOptimizer<T> >(new FusedOptimizer<T>(settings));
+}
+
+template std::unique_ptr<BasicOptimizer<double> > createOptimizer<double>(const OptimizerSettings&);
+template std::unique_ptr<BasicOptimizer<float> > createOptimizer<float>(const OptimizerSettings&);
+
+double LearningRateSchedule::multiplier(const int step, const int total) const {
+  double value = 1.0;
+
+  switch (type) {
+  case CONSTANT:
+    break;
+  case STEP:
+    value = std::pow(factor, step / period);
+    break;
+  case EXPONENTIAL:
+    value = std::pow(factor, step);
+    break;
+  case COSINE: {
+    const double progress = total > 1 ? std::min(static_cast<double>(step) / (total - 1), 1.0) : 0.0;
+    value = minimum + (1.0 - minimum) * 0.5 * (1.0 + std::cos(M_PI * progress));
+    break;
+  }
+  }
+
+  if (step < warmup) {
+    value *= static_cast<double>(step + 1) / warmup;
+  }
+
+  return value;
+}
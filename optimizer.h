@@ -0,0 +1,143 @@
+#ifndef OPTIMIZER_H_
+#define OPTIMIZER_H_
+
+/*
+ * Update rules for gradient based training. An optimizer takes the gradient of a step
+ * and moves the weights, keeping whatever per-weight state its rule needs (velocity,
+ * mean squares, moments):
+ * - MOMENTUM: classical momentum (plain SGD with a momentum of 0),
+ * - NESTEROV: Nesterov accelerated gradient,
+ * - ADAGRAD:  per-weight rates scaled by the accumulated squared gradients,
+ * - RMSPROP:  per-weight rates scaled by a moving mean of the squared gradients,
+ * - ADAM:     bias corrected moving means of the gradient and its square.
+ * Every rule is a single fused loop which reads the gradient and the state and writes
+ * the state and the weights in one pass over memory. The loops are compiled for AVX-512
+ * and AVX2 as well and dispatched like the activation kernels (see kernels.h).
+ *
+ * A LearningRateSchedule scales the base learning rate over the course of a run.
+ */
+
+#include "checkpoint.h"
+#include "parameters.h"
+#include <cstdint>
+#include <memory>
+
+enum OptimizerType { MOMENTUM = 0, NESTEROV = 1, ADAGRAD = 2, RMSPROP = 3, ADAM = 4 };
+
+struct OptimizerSettings {
+  OptimizerType type;
+  double momentum; // Velocity decay of MOMENTUM and NESTEROV, beta1 of ADAM
+  double decay; // Decay of the mean square of RMSPROP, beta2 of ADAM
+  double epsilon; // Added to the root mean square of ADAGRAD, RMSPROP and ADAM
+
+  OptimizerSettings(const OptimizerType _type = MOMENTUM, const double _momentum = 0.9, const double _decay = 0.999, const double _epsilon = 1e-8):
+    type(_type), momentum(_momentum), decay(_decay), epsilon(_epsilon) {}
+
+  static OptimizerSettings sgd(const double momentum = 0.9) {
+    return OptimizerSettings(MOMENTUM, momentum);
+  }
+
+  static OptimizerSettings nesterov(const double momentum = 0.9) {
+    return OptimizerSettings(NESTEROV, momentum);
+  }
+
+  static OptimizerSettings adagrad(const double epsilon = 1e-8) {
+    return OptimizerSettings(ADAGRAD, 0.0, 0.0, epsilon);
+  }
+
+  static OptimizerSettings rmsprop(const double decay = 0.9, const double epsilon = 1e-8) {
+    return OptimizerSettings(RMSPROP, 0.0, decay, epsilon);
+  }
+
+  static OptimizerSettings adam(const double beta1 = 0.9, const double beta2 = 0.999, const double epsilon = 1e-8) {
+    return OptimizerSettings(ADAM, beta1, beta2, epsilon);
+  }
+};
+
+/*
+ * The optimizer interface, for weights (and optimizer state) of type T. The gradient
+ * may be in either precision, so a double master copy of the weights can be trained
+ * from single precision gradients.
+ */
+template <typename T>
+class BasicOptimizer {
+public:
+  virtual ~BasicOptimizer() {}
+
+  // Take one step of learning rate rate against scale*gradient (scale turns a gradient
+  // summed over a mini-batch into its mean).
+  virtual void update(T *weights, const double *gradient, const int n, const double rate, const double scale) = 0;
+  virtual void update(T *weights, const float *gradient, const int n, const double rate, const double scale) = 0;
+
+  // Forget the state, as at the start of a new run.
+  virtual void reset() = 0;
+
+  virtual const OptimizerSettings& getSettings() const = 0;
+
+  // Save or restore the state. load returns false, changing nothing, if the snapshot
+  // does not hold the state of an optimizer with the same rule.
+  virtual void save(SnapshotWriter &out) const = 0;
+  virtual bool load(SnapshotReader &in) = 0;
+};
+
+// One of the built in optimizers.
+template <typename T>
+std::unique_ptr<BasicOptimizer<T> > createOptimizer(const OptimizerSettings &settings);
+
+/*
+ * A multiplier of the base learning rate for every step of a run, with an optional
+ * linear warmup over the first steps:
+ * - CONSTANT:    1,
+ * - STEP:        factor^(step/period), dropping every period steps,
+ * - EXPONENTIAL: factor^step,
+ * - COSINE:      from 1 down to minimum along half a cosine over the run.
+ */
+struct LearningRateSchedule {
+  enum Type { CONSTANT = 0, STEP = 1, EXPONENTIAL = 2, COSINE = 3 };
+
+  Type type;
+  double factor;
+  int period;
+  double minimum;
+  int warmup;
+
+  LearningRateSchedule(): type(CONSTANT), factor(1.0), period(1), minimum(0.0), warmup(0) {}
+
+  static LearningRateSchedule constant() {
+    return LearningRateSchedule();
+  }
+
+  static LearningRateSchedule step(const int period, const double factor) {
+    LearningRateSchedule schedule;
+    schedule.type = STEP;
+    schedule.period = period > 0 ? period : 1;
+    schedule.factor = factor;
+    return schedule;
+  }
+
+  static LearningRateSchedule exponential(const double factor) {
+    LearningRateSchedule schedule;
+    schedule.type = EXPONENTIAL;
+    schedule.factor = factor;
+    return schedule;
+  }
+
+  static LearningRateSchedule cosine(const double minimum = 0.0) {
+    LearningRateSchedule schedule;
+    schedule.type = COSINE;
+    schedule.minimum = minimum;
+    return schedule;
+  }
+
+  // The same schedule, ramped up linearly over the first steps
+  LearningRateSchedule withWarmup(const int steps) const {
+    LearningRateSchedule schedule = *this;
+    schedule.warmup = steps > 0 ? steps : 0;
+    return schedule;
+  }
+
+  // Multiplier for step (counting from 0) of a run of total steps
+  double multiplier(const int step, const int total) const;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef PARAMETERS_H_
+#define PARAMETERS_H_
+
+/*
+ * Contiguous storage for network parameters together with non-owning views into it.
+ * All weights of a network live in a single aligned buffer; layers are exposed as
+ * row-major matrix views and the whole parameter set as a span, so optimizers and
+ * mutation operators work on one flat array instead of copying matrices around.
+ */
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Allocator returning memory aligned to a cache line (and so to any SIMD register width).
+template <typename T, std::size_t Alignment = 64>
+struct AlignedAllocator {
+  typedef T value_type;
+
+  template <typename U>
+  struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() {}
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+  T* allocate(const std::size_t n) {
+    void *memory = nullptr;
+    if (posix_memalign(&memory, Alignment, n * sizeof(T) > 0 ? n * sizeof(T) : Alignment) != 0) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(memory);
+  }
+
+  void deallocate(T *memory, const std::size_t) {
+    free(memory);
+  }
+};
+
+template <typename T, typename U, std::size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) {
+  return true;
+}
+
+template <typename T, typename U, std::size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) {
+  return false;
+}
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T> >;
+
+typedef AlignedVector<double> ParameterVector;
+
+// A non-owning view of a contiguous range of elements.
+template <typename T>
+class Span {
+private:
+  T *first;
+  std::size_t length;
+
+public:
+  Span(): first(nullptr), length(0) {}
+  Span(T *data, const std::size_t size): first(data), length(size) {}
+
+  // Any contiguous container (or span) providing data() and size() can be viewed.
+  template <typename Container>
+  Span(Container &container): first(container.data()), length(container.size()) {}
+
+  template <typename Container>
+  Span(const Container &container): first(container.data()), length(container.size()) {}
+
+  T* data() const {
+    return first;
+  }
+
+  std::size_t size() const {
+    return length;
+  }
+
+  T* begin() const {
+    return first;
+  }
+
+  T* end() const {
+    return first + length;
+  }
+
+  T& operator[](const std::size_t i) const {
+    return first[i];
+  }
+};
+
+typedef Span<double> ParameterSpan;
+typedef Span<const double> ConstParameterSpan;
+
+// A non-owning row-major matrix view, indexed like boost::numeric::ublas::matrix.
+template <typename T>
+class MatrixView {
+private:
+  T *first;
+  int rows;
+  int cols;
+
+public:
+  MatrixView(T *data, const int _rows, const int _cols): first(data), rows(_rows), cols(_cols) {}
+
+  template <typename U>
+  MatrixView(const MatrixView<U> &other): first(other.data()), rows(other.size1()), cols(other.size2()) {}
+
+  T* data() const {
+    return first;
+  }
+
+  int size1() const {
+    return rows;
+  }
+
+  int size2() const {
+    return cols;
+  }
+
+  T& operator()(const int i, const int j) const {
+    return first[i * cols + j];
+  }
+};
+
+typedef MatrixView<double> LayerView;
+typedef MatrixView<const double> ConstLayerView;
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef PHILOX_H_
+#define PHILOX_H_
+
+/*
+ * Philox4x32-10, a counter-based random number generator (Salmon et al., "Parallel random
+ * numbers: as easy as 1, 2, 3"). Every 128 bit counter is mapped to four independent
+ * 32 bit random numbers under a 64 bit key, without any state between calls. Any range
+ * of numbers can be generated on any thread in any order with the same result, and a
+ * loop over counters has no dependency from one iteration to the next, so it vectorizes.
+ */
+
+#include <cstdint>
+
+struct Philox {
+  uint32_t key[2];
+
+  explicit Philox(const uint64_t _key = 0) {
+    key[0] = static_cast<uint32_t>(_key);
+    key[1] = static_cast<uint32_t>(_key >> 32);
+  }
+
+  // The four random numbers of counter c0..c3
+  void operator()(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t out[4]) const {
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+
+    for (int round = 0; round < 10; ++round) {
+      const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+      const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+      c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+      c1 = static_cast<uint32_t>(p1);
+      c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+      c3 = static_cast<uint32_t>(p0);
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+  }
+
+  // A random number in (0, 1), never exactly 0 or 1, from 32 random bits
+  static double uniform(const uint32_t x) {
+    return (x + 0.5) * (1.0 / 4294967296.0);
+  }
+};
+
+#endif
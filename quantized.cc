@@ -0,0 +1,202 @@
+#include "quantized.h"
+#include "linalg.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Number of samples compared at once
+const int compareBlockSize = 256;
+
+// Quantized inputs are stored as q + zeroPoint so they fit in an unsigned byte
+const int zeroPoint = 128;
+
+}
+
+QuantizedNetwork::QuantizedNetwork(const NeuralNetwork &network, const DatasetView &calibration,
+                                   const int calibrationSamples, const bool perRowScales):
+  numberInput(network.getInputSize()), numberOutput(network.getOutputSize()),
+  activation(std::unique_ptr<ActivationFunction>(createActivation(network.getActivation().type(), network.getActivation().parameter()))) {
+  /*
+   * Weights are quantized symmetrically, w ~ scale * q with q in [-127, 127] and the
+   * scale set by the largest weight of the row (or layer). Each layer's input range is
+   * calibrated on the calibration batch before it is pushed through the layer in double.
+   */
+  if (!activation) {
+    return;
+  }
+
+  const int count = std::max(std::min(calibrationSamples, calibration.size()), 0);
+  std::vector<int> rows(count);
+  for (int i = 0; i < count; ++i) {
+    rows[i] = static_cast<long>(i) * calibration.size() / count;
+  }
+
+  boost::numeric::ublas::matrix<double> current(count, numberInput);
+  boost::numeric::ublas::matrix<double> expected(count, numberOutput);
+  if (count > 0) {
+    calibration.gather(rows.data(), count, current, expected);
+  }
+
+  for (int k = 0; k < network.getLayerCount(); ++k) {
+    const ConstLayerView w = network.getLayer(k);
+
+    QuantizedLayer layer;
+    layer.rows = w.size1();
+    layer.cols = w.size2() - 1;
+    layer.stride = (layer.cols + 63) / 64 * 64;
+    layer.offset = weights.size();
+    layer.first = biases.size();
+
+    double inputRange = 0.0;
+    for (const double x : current.data()) {
+      inputRange = std::max(inputRange, std::abs(x));
+    }
+    layer.inputScale = inputRange > 0.0 ? inputRange / 127.0 : 1.0;
+    layers.push_back(layer);
+
+    double layerRange = 0.0;
+    for (int i = 0; i < layer.rows; ++i) {
+      for (int j = 1; j <= layer.cols; ++j) {
+        layerRange = std::max(layerRange, std::abs(w(i, j)));
+      }
+    }
+
+    // Rows are padded with zero weights, which add nothing to the dot products
+    weights.resize(layer.offset + layer.rows * layer.stride, 0);
+    for (int i = 0; i < layer.rows; ++i) {
+      double range = layerRange;
+      if (perRowScales) {
+        range = 0.0;
+        for (int j = 1; j <= layer.cols; ++j) {
+          range = std::max(range, std::abs(w(i, j)));
+        }
+      }
+      const double scale = range > 0.0 ? range / 127.0 : 1.0;
+
+      int32_t sum = 0;
+      for (int j = 1; j <= layer.cols; ++j) {
+        const int q = std::min(std::max(static_cast<int>(std::lround(w(i, j) / scale)), -127), 127);
+        weights[layer.offset + i * layer.stride + j - 1] = q;
+        sum += q;
+      }
+
+      weightScales.push_back(scale);
+      biases.push_back(w(i, 0));
+      rowSums.push_back(sum);
+    }
+
+    // The calibration batch's input to the next layer
+    if (k + 1 < network.getLayerCount()) {
+      boost::numeric::ublas::matrix<double> next(count, layer.rows);
+      for (int i = 0; i < count; ++i) {
+        for (int j = 0; j < layer.rows; ++j) {
+          next(i, j) = w(j, 0);
+        }
+      }
+      gemm(NoTrans, Trans, count, layer.rows, layer.cols, 1.0, current.data().begin(), layer.cols,
+           w.data() + 1, w.size2(), 1.0, next.data().begin(), layer.rows);
+      activation->activation(next.data().begin(), count, layer.rows);
+      current.swap(next);
+    }
+  }
+}
+
+boost::numeric::ublas::vector<double> QuantizedNetwork::feedForwardVector(const boost::numeric::ublas::vector<double> &input) const {
+  /*
+   * The forward pass of a single sample.
+   */
+  boost::numeric::ublas::matrix<double> batch(1, input.size());
+  std::copy(input.begin(), input.end(), batch.data().begin());
+
+  const boost::numeric::ublas::matrix<double> output = feedForwardBatch(batch);
+  boost::numeric::ublas::vector<double> result(output.size2());
+  std::copy(output.data().begin(), output.data().end(), result.begin());
+  return result;
+}
+
+boost::numeric::ublas::matrix<double> QuantizedNetwork::feedForwardBatch(const boost::numeric::ublas::matrix<double> &input) const {
+  /*
+   * Each layer quantizes its input a sample at a time and takes the integer dot products
+   * with every weight row; the sums are then rescaled, the bias added and the activation
+   * applied to the whole batch in single precision.
+   */
+  const int samples = input.size1();
+  if (input.size2() != numberInput || !activation) {
+    return boost::numeric::ublas::matrix<double>(0, 0);
+  }
+
+  int widest = 0;
+  int longest = 0;
+  for (const QuantizedLayer &layer : layers) {
+    widest = std::max(widest, layer.rows);
+    longest = std::max(longest, layer.stride);
+  }
+
+  AlignedVector<float> current(input.data().begin(), input.data().end());
+  AlignedVector<float> next;
+  AlignedVector<uint8_t> quantized(longest, 0);
+  std::vector<int32_t> sums(widest);
+
+  for (const QuantizedLayer &layer : layers) {
+    next.resize(samples * layer.rows);
+    const float inverse = 1.0f / layer.inputScale;
+
+    for (int i = 0; i < samples; ++i) {
+      // Round to the nearest step (v + 128.5 is positive, so truncating rounds it)
+      const float *x = current.data() + i * layer.cols;
+      for (int j = 0; j < layer.cols; ++j) {
+        const float v = std::min(std::max(x[j] * inverse, -127.0f), 127.0f);
+        quantized[j] = static_cast<uint8_t>(static_cast<int>(v + zeroPoint + 0.5f));
+      }
+
+      vectorDotInt8(quantized.data(), weights.data() + layer.offset, layer.cols, layer.rows, layer.stride, sums.data());
+
+      float *y = next.data() + i * layer.rows;
+      for (int r = 0; r < layer.rows; ++r) {
+        const int n = layer.first + r;
+        y[r] = (sums[r] - zeroPoint * rowSums[n]) * (layer.inputScale * weightScales[n]) + biases[n];
+      }
+    }
+
+    activation->activation(next.data(), samples, layer.rows);
+    current.swap(next);
+  }
+
+  boost::numeric::ublas::matrix<double> output(samples, numberOutput);
+  std::copy(current.begin(), current.begin() + samples * numberOutput, output.data().begin());
+  return output;
+}
+
+QuantizationError QuantizedNetwork::compare(const NeuralNetwork &network, const DatasetView &data) const {
+  /*
+   * Both networks are run over the data in blocks and every output is compared.
+   */
+  QuantizationError error = {0.0, 0.0};
+  std::vector<int> rows;
+
+  for (int start = 0; start < data.size(); start += compareBlockSize) {
+    const int count = std::min(compareBlockSize, data.size() - start);
+    rows.resize(count);
+    for (int i = 0; i < count; ++i) {
+      rows[i] = start + i;
+    }
+
+    boost::numeric::ublas::matrix<double> batch(count, data.getInputSize());
+    boost::numeric::ublas::matrix<double> expected(count, data.getOutputSize());
+    data.gather(rows.data(), count, batch, expected);
+
+    const boost::numeric::ublas::matrix<double> reference = network.feedForwardBatch(batch);
+    const boost::numeric::ublas::matrix<double> output = feedForwardBatch(batch);
+    for (int i = 0; i < output.data().size(); ++i) {
+      const double difference = std::abs(output.data()[i] - reference.data()[i]);
+      error.maxAbsolute = std::max(error.maxAbsolute, difference);
+      error.meanAbsolute += difference;
+    }
+  }
+
+  if (data.size() > 0) {
+    error.meanAbsolute /= static_cast<double>(data.size()) * numberOutput;
+  }
+  return error;
+}
@@ -0,0 +1,75 @@
+#ifndef QUANTIZED_H_
+#define QUANTIZED_H_
+
+/*
+ * Int8 post-training quantization of a trained network, for inference only.
+ *
+ * Weights are stored as signed 8-bit integers with a float scale per row (or one per
+ * layer), so they take a quarter of the memory of single precision weights and an
+ * eighth of double. The input of every layer is quantized to 8 bits with a scale chosen
+ * by calibration: the double precision forward pass is run over a sample of inputs and
+ * the largest magnitude seen at each layer's input sets its range. Dot products are
+ * accumulated exactly in 32-bit integers by the vectorized kernels (AVX-512 VNNI or
+ * AVX2 where available) and only the bias, scaling and activation are done in float.
+ *
+ * Quantized inputs are stored unsigned with a zero point of 128, as VNNI requires; the
+ * zero point's contribution is removed with the precomputed sum of each weight row.
+ */
+
+#include "network.h"
+#include <cstdint>
+
+// Difference between the outputs of a quantized network and the network it was built from
+struct QuantizationError {
+  double maxAbsolute;
+  double meanAbsolute;
+};
+
+class QuantizedNetwork {
+private:
+  struct QuantizedLayer {
+    int rows;
+    int cols; // Number of inputs, excluding the bias
+    int stride; // Length of each weight row, padded to a multiple of 64 bytes
+    int offset; // Position of the first weight in the weight buffer
+    int first; // Index of the first row's scale, bias and sum
+    float inputScale; // Value of one step of the quantized input
+  };
+
+  int numberInput;
+  int numberOutput;
+  std::vector<QuantizedLayer> layers;
+  AlignedVector<int8_t> weights;
+  std::vector<float> weightScales; // One per row
+  std::vector<float> biases;
+  std::vector<int32_t> rowSums; // Sum of the quantized weights of each row
+  std::unique_ptr<ActivationFunction> activation;
+
+public:
+  // Quantize the network, calibrating activation ranges on up to calibrationSamples samples
+  // spread evenly over the data. The activation is a copy of the network's; a network with
+  // a custom activation cannot be quantized, and gives empty outputs.
+  QuantizedNetwork(const NeuralNetwork &network, const DatasetView &calibration,
+                   const int calibrationSamples = 1024, const bool perRowScales = true);
+
+  boost::numeric::ublas::vector<double> feedForwardVector(const boost::numeric::ublas::vector<double> &input) const;
+  boost::numeric::ublas::matrix<double> feedForwardBatch(const boost::numeric::ublas::matrix<double> &input) const;
+
+  // Compare the outputs against the double precision network over a dataset
+  QuantizationError compare(const NeuralNetwork &network, const DatasetView &data) const;
+
+  // Memory used by the weights, scales, biases and row sums
+  std::size_t getWeightBytes() const {
+    return weights.size() * sizeof(int8_t) + (weightScales.size() + biases.size()) * sizeof(float) + rowSums.size() * sizeof(int32_t);
+  }
+
+  int getInputSize() const {
+    return numberInput;
+  }
+
+  int getOutputSize() const {
+    return numberOutput;
+  }
+};
+
+#endif
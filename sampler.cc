@@ -0,0 +1,324 @@
+#include "sampler.h"
+#include <algorithm>
+#include <cmath>
+
+void BatchSampler::setStrata(const std::vector<int> &_strata) {
+  strata = _strata;
+  aliasProbability.clear();
+  alias.clear();
+}
+
+bool BatchSampler::setWeights(const std::vector<double> &weights) {
+  /*
+   * Build the alias table with Vose's method: every row gets a column of height one,
+   * filled up to its scaled weight by itself and topped up by a row with a surplus.
+   */
+  const int n = weights.size();
+  double total = 0.0;
+  for (const double w : weights) {
+    total += std::max(w, 0.0);
+  }
+  if (n == 0 || !(total > 0.0)) {
+    return false;
+  }
+
+  strata.clear();
+  aliasProbability.assign(n, 1.0);
+  alias.resize(n);
+
+  std::vector<double> scaled(n);
+  std::vector<int> small;
+  std::vector<int> large;
+  for (int i = 0; i < n; ++i) {
+    scaled[i] = std::max(weights[i], 0.0) * n / total;
+    alias[i] = i;
+    (scaled[i] < 1.0 ? small : large).push_back(i);
+  }
+
+  while (!small.empty() && !large.empty()) {
+    const int s = small.back();
+    const int l = large.back();
+    small.pop_back();
+
+    aliasProbability[s] = scaled[s];
+    alias[s] = l;
+    scaled[l] -= 1.0 - scaled[s];
+
+    if (scaled[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+
+  // Whatever is left is full up to rounding
+  for (const int i : small) {
+    aliasProbability[i] = 1.0;
+  }
+  for (const int i : large) {
+    aliasProbability[i] = 1.0;
+  }
+
+  return true;
+}
+
+void BatchSampler::setUniform() {
+  strata.clear();
+  aliasProbability.clear();
+  alias.clear();
+}
+
+bool BatchSampler::reset(const int size) {
+  /*
+   * Group the rows by class in row order. Every cursor starts at the end of its group,
+   * so each group is shuffled when it is first drawn from.
+   */
+  if (size <= 0 || (!strata.empty() && strata.size() != size) || (!alias.empty() && alias.size() != size)) {
+    return false;
+  }
+
+  samples = size;
+  drawn = 0;
+  order.resize(size);
+  groupBegin.assign(1, 0);
+
+  if (strata.empty()) {
+    for (int i = 0; i < size; ++i) {
+      order[i] = i;
+    }
+    groupBegin.push_back(size);
+  } else {
+    std::vector<int> classes(strata);
+    std::sort(classes.begin(), classes.end());
+    classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+
+    std::vector<int> count(classes.size() + 1, 0);
+    for (const int c : strata) {
+      count[std::lower_bound(classes.begin(), classes.end(), c) - classes.begin() + 1]++;
+    }
+    for (int g = 0; g < classes.size(); ++g) {
+      count[g + 1] += count[g];
+    }
+    groupBegin.assign(count.begin(), count.end());
+
+    for (int i = 0; i < size; ++i) {
+      order[count[std::lower_bound(classes.begin(), classes.end(), strata[i]) - classes.begin()]++] = i;
+    }
+  }
+
+  const int groups = groupBegin.size() - 1;
+  cursor.assign(groupBegin.begin() + 1, groupBegin.end());
+  credit.assign(groups, 0.0);
+  return true;
+}
+
+int BatchSampler::draw(std::default_random_engine &generator, const int group) {
+  /*
+   * Take the next row of a group, reshuffling the group (Fisher-Yates) once it is used up.
+   */
+  const int begin = groupBegin[group];
+  const int end = groupBegin[group + 1];
+
+  if (cursor[group] == end) {
+    for (int i = end - 1; i > begin; --i) {
+      std::uniform_int_distribution<int> pick(begin, i);
+      std::swap(order[i], order[pick(generator)]);
+    }
+    cursor[group] = begin;
+  }
+
+  return order[cursor[group]++];
+}
+
+void BatchSampler::next(std::default_random_engine &generator, const int count, std::vector<int> &rows) {
+  rows.clear();
+
+  if (!alias.empty()) {
+    std::uniform_int_distribution<int> column(0, samples - 1);
+    std::uniform_real_distribution<double> height(0.0, 1.0);
+    for (int k = 0; k < count; ++k) {
+      const int i = column(generator);
+      rows.push_back(height(generator) < aliasProbability[i] ? i : alias[i]);
+    }
+  } else if (groupBegin.size() == 2) {
+    for (int k = 0; k < count; ++k) {
+      rows.push_back(draw(generator, 0));
+    }
+  } else {
+    // Each group is owed its share of the batch; the whole rows are taken now and the
+    // rows still missing go to the groups owed the largest fractions
+    const int groups = groupBegin.size() - 1;
+    std::vector<int> take(groups);
+    int total = 0;
+    for (int g = 0; g < groups; ++g) {
+      credit[g] += static_cast<double>(count) * (groupBegin[g + 1] - groupBegin[g]) / samples;
+      take[g] = static_cast<int>(std::floor(credit[g]));
+      total += take[g];
+    }
+
+    while (total < count) {
+      int most = 0;
+      for (int g = 1; g < groups; ++g) {
+        if (credit[g] - take[g] > credit[most] - take[most]) {
+          most = g;
+        }
+      }
+      take[most]++;
+      total++;
+    }
+
+    for (int g = 0; g < groups; ++g) {
+      credit[g] -= take[g];
+      for (int k = 0; k < take[g]; ++k) {
+        rows.push_back(draw(generator, g));
+      }
+    }
+  }
+
+  drawn += count;
+  std::sort(rows.begin(), rows.end());
+}
+
+void BatchSampler::save(SnapshotWriter &out) const {
+  out.value(samples);
+  out.value(drawn);
+  out.array(order.data(), order.size());
+  out.array(groupBegin.data(), groupBegin.size());
+  out.array(cursor.data(), cursor.size());
+  out.array(credit.data(), credit.size());
+}
+
+bool BatchSampler::load(SnapshotReader &in) {
+  int savedSamples = 0;
+  int64_t savedDrawn = 0;
+  std::vector<int> savedOrder;
+  std::vector<int> savedBegin;
+  std::vector<int> savedCursor;
+  std::vector<double> savedCredit;
+
+  in.value(savedSamples);
+  in.value(savedDrawn);
+  in.array(savedOrder);
+  in.array(savedBegin);
+  in.array(savedCursor);
+  in.array(savedCredit);
+
+  if (!in.good() || savedOrder.size() != savedSamples || savedBegin.size() < 2 || savedBegin.back() != savedSamples ||
+      savedCursor.size() + 1 != savedBegin.size() || savedCredit.size() != savedCursor.size() ||
+      (!strata.empty() && strata.size() != savedSamples) || (!alias.empty() && alias.size() != savedSamples)) {
+    return false;
+  }
+
+  samples = savedSamples;
+  drawn = savedDrawn;
+  order.swap(savedOrder);
+  groupBegin.swap(savedBegin);
+  cursor.swap(savedCursor);
+  credit.swap(savedCredit);
+  return true;
+}
+
+std::vector<int> BatchSampler::labelClasses(const DatasetView &data) {
+  std::vector<int> classes(data.size());
+  boost::numeric::ublas::matrix<double> input(1, data.getInputSize());
+  boost::numeric::ublas::matrix<double> expected(1, data.getOutputSize());
+
+  for (int i = 0; i < data.size(); ++i) {
+    data.gather(&i, 1, input, expected);
+
+    if (data.getOutputSize() == 1) {
+      classes[i] = expected(0, 0) >= 0.5;
+    } else {
+      int best = 0;
+      for (int j = 1; j < data.getOutputSize(); ++j) {
+        if (expected(0, j) > expected(0, best)) {
+          best = j;
+        }
+      }
+      classes[i] = best;
+    }
+  }
+
+  return classes;
+}
+
+template <typename Scalar>
+BasicBatchPrefetcher<Scalar>::BasicBatchPrefetcher(): data(nullptr), slices(1), back(0), requested(false), stopping(false) {
+  worker = std::thread(&BasicBatchPrefetcher<Scalar>::workerLoop, this);
+}
+
+template <typename Scalar>
+BasicBatchPrefetcher<Scalar>::~BasicBatchPrefetcher() {
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    stopping = true;
+  }
+  changed.notify_all();
+  worker.join();
+}
+
+template <typename Scalar>
+void BasicBatchPrefetcher<Scalar>::submit(const DatasetView &_data, const std::vector<int> &_rows, const int _slices) {
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this] { return !requested; });
+    data = &_data;
+    rows.assign(_rows.begin(), _rows.end());
+    slices = std::max(_slices, 1);
+    requested = true;
+  }
+  changed.notify_all();
+}
+
+template <typename Scalar>
+const typename BasicBatchPrefetcher<Scalar>::Batch& BasicBatchPrefetcher<Scalar>::take() {
+  std::unique_lock<std::mutex> guard(lock);
+  changed.wait(guard, [this] { return !requested; });
+  const Batch &batch = buffers[back];
+  back = 1 - back;
+  return batch;
+}
+
+template <typename Scalar>
+void BasicBatchPrefetcher<Scalar>::wait() {
+  std::unique_lock<std::mutex> guard(lock);
+  changed.wait(guard, [this] { return !requested; });
+}
+
+template <typename Scalar>
+void BasicBatchPrefetcher<Scalar>::workerLoop() {
+  /*
+   * Gather each requested batch into the back buffer. The buffer being trained on is
+   * never touched, and the matrices are only resized when the slice sizes change.
+   */
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    changed.wait(guard, [this] { return requested || stopping; });
+    if (!requested) {
+      return;
+    }
+
+    Batch &batch = buffers[back];
+    guard.unlock();
+
+    const int n = rows.size();
+    batch.input.resize(slices);
+    batch.expected.resize(slices);
+    for (int t = 0; t < slices; ++t) {
+      const int begin = t * n / slices;
+      const int end = (t + 1) * n / slices;
+      if (batch.input[t].size1() != end - begin || batch.input[t].size2() != data->getInputSize() ||
+          batch.expected[t].size2() != data->getOutputSize()) {
+        batch.input[t].resize(end - begin, data->getInputSize(), false);
+        batch.expected[t].resize(end - begin, data->getOutputSize(), false);
+      }
+      data->gather(&rows[begin], end - begin, batch.input[t], batch.expected[t]);
+    }
+
+    guard.lock();
+    requested = false;
+    changed.notify_all();
+  }
+}
+
+template class BasicBatchPrefetcher<double>;
+template class BasicBatchPrefetcher<float>;
@@ -0,0 +1,130 @@
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+/*
+ * Mini-batch selection for SGD. BatchSampler draws the rows of each mini-batch:
+ * - uniformly without replacement within an epoch: the rows are shuffled (Fisher-Yates)
+ *   at the start of every epoch and batches are taken from the permutation in turn,
+ * - stratified: the rows are grouped by class and every batch takes from each group in
+ *   proportion to its size, so rare classes appear at a steady rate,
+ * - weighted: rows are drawn with replacement with probability proportional to a weight
+ *   (Walker's alias method, so a draw costs O(1) whatever the weights).
+ * Batches larger than the dataset simply run on into the next epoch.
+ *
+ * BatchPrefetcher gathers the next mini-batch into a second set of matrices on a
+ * background thread while the current one is trained on.
+ */
+
+#include "checkpoint.h"
+#include "dataset.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+class BatchSampler {
+private:
+  int samples;
+  std::vector<int> strata; // Class of every row (empty when not stratified)
+  std::vector<double> aliasProbability; // Alias table of the row weights (empty when not weighted)
+  std::vector<int> alias;
+
+  // Rows grouped by class (one group when not stratified), each group shuffled whenever
+  // its cursor reaches its end
+  std::vector<int> order;
+  std::vector<int> groupBegin; // Group g holds order[groupBegin[g]] to order[groupBegin[g + 1] - 1]
+  std::vector<int> cursor;
+  std::vector<double> credit; // Rows owed to each group by the stratified batches so far
+  int64_t drawn;
+
+  int draw(std::default_random_engine &generator, const int group);
+
+public:
+  BatchSampler(): samples(0), drawn(0) {}
+
+  // Stratify batches by the given class of every row. Clears any weights.
+  void setStrata(const std::vector<int> &_strata);
+
+  // Draw rows with replacement, with probability proportional to their (non-negative)
+  // weights. Clears any strata. Returns false (and keeps uniform sampling) if no weight is positive.
+  bool setWeights(const std::vector<double> &weights);
+
+  // Back to uniform sampling.
+  void setUniform();
+
+  // Start sampling from a dataset of the given size, returning false if it does not match
+  // the strata or weights.
+  bool reset(const int size);
+
+  // Replace rows with the next count rows, in increasing order (so a mapped dataset is
+  // read sequentially).
+  void next(std::default_random_engine &generator, const int count, std::vector<int> &rows);
+
+  int size() const {
+    return samples;
+  }
+
+  // Number of passes over the dataset so far
+  double getEpoch() const {
+    return samples > 0 ? static_cast<double>(drawn) / samples : 0.0;
+  }
+
+  // Save or restore the sampling position (the strata and weights are configuration and
+  // must be set again before restoring). load returns false, changing nothing, on a bad snapshot.
+  void save(SnapshotWriter &out) const;
+  bool load(SnapshotReader &in);
+
+  // The class of every row of a dataset: the largest output for several outputs, or
+  // whether the output is at least 0.5 for a single one.
+  static std::vector<int> labelClasses(const DatasetView &data);
+};
+
+template <typename Scalar>
+class BasicBatchPrefetcher {
+public:
+  typedef boost::numeric::ublas::matrix<Scalar> Matrix;
+
+  // A mini-batch gathered into one pair of matrices per slice, split into contiguous
+  // slices as for the data-parallel gradient (slice t holds rows t*n/slices to (t+1)*n/slices - 1)
+  struct Batch {
+    std::vector<Matrix> input;
+    std::vector<Matrix> expected;
+  };
+
+private:
+  std::thread worker;
+  std::mutex lock;
+  std::condition_variable changed; // Signalled when a batch is requested or gathered, or the prefetcher stops
+  const DatasetView *data;
+  std::vector<int> rows;
+  int slices;
+  Batch buffers[2];
+  int back; // The buffer the worker gathers into
+  bool requested;
+  bool stopping;
+
+  void workerLoop();
+
+public:
+  BasicBatchPrefetcher();
+  ~BasicBatchPrefetcher();
+
+  BasicBatchPrefetcher(const BasicBatchPrefetcher&) = delete;
+  BasicBatchPrefetcher& operator=(const BasicBatchPrefetcher&) = delete;
+
+  // Start gathering the given rows of data (which must outlive the gather) in the background.
+  void submit(const DatasetView &_data, const std::vector<int> &_rows, const int _slices);
+
+  // Wait for the submitted batch and return it. It stays valid while the next one is gathered.
+  const Batch& take();
+
+  // Wait for any submitted batch without taking it.
+  void wait();
+};
+
+typedef BasicBatchPrefetcher<double> BatchPrefetcher;
+typedef BasicBatchPrefetcher<float> FloatBatchPrefetcher;
+
+#endif
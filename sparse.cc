@@ -0,0 +1,268 @@
+#include "sparse.h"
+#include "linalg.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Number of samples compared at once
+const int compareBlockSize = 256;
+
+// Number of samples pushed through a sparse row at once, so the rows of inputs it reads
+// stay in cache while every row of the layer is done
+const int sparseBlockSize = 256;
+
+// Copy a rows x cols row-major block into its cols x rows transpose
+template <typename Scalar>
+void transpose(const Scalar *from, const int rows, const int cols, Scalar *to) {
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      to[j * rows + i] = from[i * cols + j];
+    }
+  }
+}
+
+}
+
+template <typename Scalar>
+PruningMask magnitudePrune(BasicNeuralNetwork<Scalar> &network, const double sparsity, const bool perLayer) {
+  /*
+   * The weights to cut are the first of the candidates once they are partially ordered
+   * by magnitude (ties broken by position), so exactly the requested number are cut even
+   * when many magnitudes are equal, as the zeros of an earlier pruning are.
+   */
+  PruningMask mask(network.getParameterSize(), 1);
+  const Span<Scalar> parameters = network.getParameters();
+  const double fraction = std::min(std::max(sparsity, 0.0), 1.0);
+
+  // Positions in the parameter buffer of the weights which may be cut
+  std::vector<int> candidates;
+
+  auto cut = [&] () {
+    const std::size_t count = std::llround(fraction * candidates.size());
+    if (count < candidates.size()) {
+      std::nth_element(candidates.begin(), candidates.begin() + count, candidates.end(), [&] (const int i, const int j) {
+        const Scalar a = std::abs(parameters[i]);
+        const Scalar b = std::abs(parameters[j]);
+        return a < b || (a == b && i < j);
+      });
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+      parameters[candidates[i]] = 0;
+      mask[candidates[i]] = 0;
+    }
+    candidates.clear();
+  };
+
+  for (int k = 0; k < network.getLayerCount(); ++k) {
+    const typename BasicNeuralNetwork<Scalar>::ScalarLayerView w = network.getLayer(k);
+    const int offset = w.data() - parameters.data();
+    for (int i = 0; i < w.size1(); ++i) {
+      for (int j = 1; j < w.size2(); ++j) {
+        candidates.push_back(offset + i * w.size2() + j);
+      }
+    }
+    if (perLayer) {
+      cut();
+    }
+  }
+  cut();
+
+  return mask;
+}
+
+template <typename Scalar>
+PruningMask pruneAndRetrain(BasicNeuralNetwork<Scalar> &network, BasicStochasticGradientDescent<Scalar> &sgd, const DatasetView &data,
+                            const double sparsity, const int rounds, const double minCost, const int batchSize, const bool perLayer) {
+  /*
+   * Every round prunes the network further and retrains the weights left. Weights pruned
+   * in an earlier round are zero, so they are the first to be cut again and the masks of
+   * the rounds are nested.
+   */
+  const int count = std::max(rounds, 1);
+  PruningMask mask;
+  for (int r = 1; r <= count; ++r) {
+    const double remaining = 1.0 - static_cast<double>(r) / count;
+    mask = magnitudePrune(network, sparsity * (1.0 - remaining * remaining * remaining), perLayer);
+    sgd.setPruningMask(mask);
+    sgd.train(data, minCost, batchSize);
+  }
+  return mask;
+}
+
+template <typename Scalar>
+BasicSparseNetwork<Scalar>::BasicSparseNetwork(const BasicNeuralNetwork<Scalar> &network, const double crossover):
+  numberInput(network.getInputSize()), numberOutput(network.getOutputSize()), kept(0), total(0),
+  activation(std::unique_ptr<ActivationFunction>(createActivation(network.getActivation().type(), network.getActivation().parameter()))) {
+  /*
+   * Each layer's nonzero weights are counted to choose its storage, then copied into the
+   * dense or CSR arrays. The biases of every layer are kept dense.
+   */
+  for (int k = 0; k < network.getLayerCount(); ++k) {
+    const typename BasicNeuralNetwork<Scalar>::ConstScalarLayerView w = network.getLayer(k);
+
+    SparseLayer layer;
+    layer.rows = w.size1();
+    layer.cols = w.size2() - 1;
+    layer.first = biases.size();
+
+    std::size_t nonzero = 0;
+    for (int i = 0; i < layer.rows; ++i) {
+      biases.push_back(w(i, 0));
+      for (int j = 1; j <= layer.cols; ++j) {
+        nonzero += w(i, j) != 0;
+      }
+    }
+    const std::size_t size = static_cast<std::size_t>(layer.rows) * layer.cols;
+    kept += nonzero;
+    total += size;
+
+    layer.sparse = size > 0 && nonzero <= crossover * size;
+    if (layer.sparse) {
+      layer.offset = rowStart.size();
+      for (int i = 0; i < layer.rows; ++i) {
+        rowStart.push_back(values.size());
+        for (int j = 1; j <= layer.cols; ++j) {
+          if (w(i, j) != 0) {
+            values.push_back(w(i, j));
+            columns.push_back(j - 1);
+          }
+        }
+      }
+      rowStart.push_back(values.size());
+    } else {
+      layer.offset = values.size();
+      for (int i = 0; i < layer.rows; ++i) {
+        values.insert(values.end(), w.data() + i * w.size2() + 1, w.data() + (i + 1) * w.size2());
+      }
+    }
+
+    layers.push_back(layer);
+  }
+}
+
+template <typename Scalar>
+boost::numeric::ublas::vector<double> BasicSparseNetwork<Scalar>::feedForwardVector(const boost::numeric::ublas::vector<double> &input) const {
+  /*
+   * The forward pass of a single sample.
+   */
+  boost::numeric::ublas::matrix<double> batch(1, input.size());
+  std::copy(input.begin(), input.end(), batch.data().begin());
+
+  const boost::numeric::ublas::matrix<double> output = feedForwardBatch(batch);
+  boost::numeric::ublas::vector<double> result(output.size2());
+  std::copy(output.data().begin(), output.data().end(), result.begin());
+  return result;
+}
+
+template <typename Scalar>
+boost::numeric::ublas::matrix<double> BasicSparseNetwork<Scalar>::feedForwardBatch(const boost::numeric::ublas::matrix<double> &input) const {
+  /*
+   * The batch is transposed so each neuron's values over the samples are contiguous.
+   * Every output row starts from its bias; a sparse row then adds each nonzero weight
+   * times the row of its input, a block of samples at a time, and a dense layer is a
+   * single gemm. Activations work on each value alone, except softmax which needs the
+   * outputs of a sample together, so it is applied to the batch transposed back.
+   */
+  const int samples = input.size1();
+  if (input.size2() != numberInput || !activation) {
+    return boost::numeric::ublas::matrix<double>(0, 0);
+  }
+
+  AlignedVector<Scalar> current(static_cast<std::size_t>(numberInput) * samples);
+  for (int i = 0; i < samples; ++i) {
+    for (int j = 0; j < numberInput; ++j) {
+      current[static_cast<std::size_t>(j) * samples + i] = input(i, j);
+    }
+  }
+  AlignedVector<Scalar> next;
+  AlignedVector<Scalar> transposed;
+
+  for (const SparseLayer &layer : layers) {
+    next.resize(static_cast<std::size_t>(layer.rows) * samples);
+    for (int r = 0; r < layer.rows; ++r) {
+      std::fill(next.begin() + static_cast<std::size_t>(r) * samples, next.begin() + static_cast<std::size_t>(r + 1) * samples, biases[layer.first + r]);
+    }
+
+    if (layer.sparse) {
+      for (int start = 0; start < samples; start += sparseBlockSize) {
+        const int count = std::min(sparseBlockSize, samples - start);
+        for (int r = 0; r < layer.rows; ++r) {
+          Scalar *y = next.data() + static_cast<std::size_t>(r) * samples + start;
+          for (int n = rowStart[layer.offset + r]; n < rowStart[layer.offset + r + 1]; ++n) {
+            const Scalar v = values[n];
+            const Scalar *x = current.data() + static_cast<std::size_t>(columns[n]) * samples + start;
+            for (int i = 0; i < count; ++i) {
+              y[i] += v * x[i];
+            }
+          }
+        }
+      }
+    } else if (samples > 0) {
+      gemm(NoTrans, NoTrans, layer.rows, samples, layer.cols, static_cast<Scalar>(1), values.data() + layer.offset, layer.cols,
+           current.data(), samples, static_cast<Scalar>(1), next.data(), samples);
+    }
+
+    if (activation->type() == ActivationFunction::SOFTMAX) {
+      transposed.resize(next.size());
+      transpose(next.data(), layer.rows, samples, transposed.data());
+      activation->activation(transposed.data(), samples, layer.rows);
+      transpose(transposed.data(), samples, layer.rows, next.data());
+    } else {
+      activation->activation(next.data(), layer.rows, samples);
+    }
+    current.swap(next);
+  }
+
+  boost::numeric::ublas::matrix<double> output(samples, numberOutput);
+  for (int i = 0; i < samples; ++i) {
+    for (int j = 0; j < numberOutput; ++j) {
+      output(i, j) = current[static_cast<std::size_t>(j) * samples + i];
+    }
+  }
+  return output;
+}
+
+template <typename Scalar>
+SparseError BasicSparseNetwork<Scalar>::compare(const BasicNeuralNetwork<Scalar> &network, const DatasetView &data) const {
+  /*
+   * Both networks are run over the data in blocks and every output is compared.
+   */
+  SparseError error = {0.0, 0.0};
+  std::vector<int> rows;
+
+  for (int start = 0; start < data.size(); start += compareBlockSize) {
+    const int count = std::min(compareBlockSize, data.size() - start);
+    rows.resize(count);
+    for (int i = 0; i < count; ++i) {
+      rows[i] = start + i;
+    }
+
+    boost::numeric::ublas::matrix<double> batch(count, data.getInputSize());
+    boost::numeric::ublas::matrix<double> expected(count, data.getOutputSize());
+    data.gather(rows.data(), count, batch, expected);
+
+    const typename BasicNeuralNetwork<Scalar>::Matrix reference = network.feedForwardBatch(typename BasicNeuralNetwork<Scalar>::Matrix(batch));
+    const boost::numeric::ublas::matrix<double> output = feedForwardBatch(batch);
+    for (int i = 0; i < output.data().size(); ++i) {
+      const double difference = std::abs(output.data()[i] - reference.data()[i]);
+      error.maxAbsolute = std::max(error.maxAbsolute, difference);
+      error.meanAbsolute += difference;
+    }
+  }
+
+  if (data.size() > 0) {
+    error.meanAbsolute /= static_cast<double>(data.size()) * numberOutput;
+  }
+  return error;
+}
+
+template PruningMask magnitudePrune(BasicNeuralNetwork<double> &network, const double sparsity, const bool perLayer);
+template PruningMask magnitudePrune(BasicNeuralNetwork<float> &network, const double sparsity, const bool perLayer);
+template PruningMask pruneAndRetrain(BasicNeuralNetwork<double> &network, BasicStochasticGradientDescent<double> &sgd, const DatasetView &data,
+                                     const double sparsity, const int rounds, const double minCost, const int batchSize, const bool perLayer);
+template PruningMask pruneAndRetrain(BasicNeuralNetwork<float> &network, BasicStochasticGradientDescent<float> &sgd, const DatasetView &data,
+                                     const double sparsity, const int rounds, const double minCost, const int batchSize, const bool perLayer);
+
+template class BasicSparseNetwork<double>;
+template class BasicSparseNetwork<float>;
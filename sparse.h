@@ -0,0 +1,112 @@
+#ifndef SPARSE_H_
+#define SPARSE_H_
+
+/*
+ * Magnitude pruning of a trained network, and sparse inference with the pruned weights.
+ *
+ * Pruning zeroes the weights of smallest magnitude, over the whole network or layer by
+ * layer, and returns a mask of the weights kept; biases are never pruned. Passing the
+ * mask to SGD (setPruningMask) keeps the pruned weights at zero while the rest are
+ * retrained, and pruneAndRetrain alternates the two, raising the sparsity a little each
+ * round so the network can recover from every cut.
+ *
+ * A sparse network stores each layer in compressed sparse row (CSR) form: the nonzero
+ * weights of each row with their column indices. Activations are kept feature-major
+ * (one row of samples per neuron), so each nonzero weight adds a scaled contiguous row
+ * of inputs to a contiguous row of outputs, which vectorizes. Layers denser than the
+ * crossover density are kept dense and use the gemm kernel instead, which is faster
+ * when few weights are zero.
+ */
+
+#include "network.h"
+#include "gradient.h"
+#include <cstdint>
+
+// One entry per parameter of a network: 1 if the weight is kept, 0 if it was pruned
+typedef std::vector<char> PruningMask;
+
+// Zero the non-bias weights of smallest magnitude, the given fraction of all of them
+// (perLayer = false) or of each layer's, and return the mask of weights kept. Weights
+// already zero are pruned first.
+template <typename Scalar>
+PruningMask magnitudePrune(BasicNeuralNetwork<Scalar> &network, const double sparsity, const bool perLayer = false);
+
+// Prune to the given sparsity over several rounds, retraining with sgd after each. The
+// sparsity of round r of n is sparsity * (1 - (1 - r/n)^3), so most weights are cut in
+// the early rounds, while the network still has plenty to spare. The mask of sgd is
+// replaced by the mask of each round, and the final mask is returned.
+template <typename Scalar>
+PruningMask pruneAndRetrain(BasicNeuralNetwork<Scalar> &network, BasicStochasticGradientDescent<Scalar> &sgd, const DatasetView &data,
+                            const double sparsity, const int rounds, const double minCost, const int batchSize = 0, const bool perLayer = false);
+
+// Difference between the outputs of a sparse network and the network it was built from
+struct SparseError {
+  double maxAbsolute;
+  double meanAbsolute;
+};
+
+template <typename Scalar>
+class BasicSparseNetwork {
+private:
+  struct SparseLayer {
+    int rows;
+    int cols; // Number of inputs, excluding the bias
+    bool sparse;
+    int offset; // Position of the layer's first weight in values (dense) or first row in rowStart (sparse)
+    int first; // Index of the first row's bias
+  };
+
+  int numberInput;
+  int numberOutput;
+  std::vector<SparseLayer> layers;
+  AlignedVector<Scalar> values; // Dense weights (row-major, without biases) and CSR nonzeros
+  std::vector<int32_t> columns; // Column of each CSR nonzero
+  std::vector<int32_t> rowStart; // Position of each sparse row's first nonzero, plus one past the last
+  std::vector<Scalar> biases;
+  std::size_t kept; // Nonzero non-bias weights of the network
+  std::size_t total; // Non-bias weights of the network
+  std::unique_ptr<ActivationFunction> activation;
+
+public:
+  // Layers whose share of nonzero weights is at most crossover are stored sparse. The
+  // activation is a copy of the network's; a network with a custom activation cannot be
+  // copied, and gives empty outputs.
+  BasicSparseNetwork(const BasicNeuralNetwork<Scalar> &network, const double crossover = 0.4);
+
+  boost::numeric::ublas::vector<double> feedForwardVector(const boost::numeric::ublas::vector<double> &input) const;
+  boost::numeric::ublas::matrix<double> feedForwardBatch(const boost::numeric::ublas::matrix<double> &input) const;
+
+  // Compare the outputs against the network it was built from over a dataset
+  SparseError compare(const BasicNeuralNetwork<Scalar> &network, const DatasetView &data) const;
+
+  // Memory used by the weights, column indices, row starts and biases
+  std::size_t getWeightBytes() const {
+    return (values.size() + biases.size()) * sizeof(Scalar) + (columns.size() + rowStart.size()) * sizeof(int32_t);
+  }
+
+  // Share of the non-bias weights which are nonzero
+  double getDensity() const {
+    return total > 0 ? static_cast<double>(kept) / total : 0.0;
+  }
+
+  bool isSparse(const int k) const {
+    return layers[k].sparse;
+  }
+
+  int getLayerCount() const {
+    return layers.size();
+  }
+
+  int getInputSize() const {
+    return numberInput;
+  }
+
+  int getOutputSize() const {
+    return numberOutput;
+  }
+};
+
+typedef BasicSparseNetwork<double> SparseNetwork;
+typedef BasicSparseNetwork<float> FloatSparseNetwork;
+
+#endif
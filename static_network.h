@@ -0,0 +1,241 @@
+#ifndef STATIC_NETWORK_H_
+#define STATIC_NETWORK_H_
+
+/*
+ * A feedforward network whose layer sizes and activation functions are fixed at
+ * compile time, e.g.
+ *
+ *   Network<Input<64>, Layer<Dense, ReLU, 128>, Layer<Dense, Softmax, 10> > network;
+ *
+ * Every layer may use its own activation function. The weights are held in fixed
+ * size arrays inside the network object (so a network on the stack allocates nothing)
+ * and every loop bound is a constant, letting the compiler inline and unroll the whole
+ * forward pass. This network only does inference: its weights are set from a flat array
+ * laid out like NeuralNetwork's (row-major per layer, bias in column 0). NeuralNetwork
+ * trains a single activation shared by all its layers, so its weights can only be
+ * loaded into a static network of the same shape using that activation in every layer;
+ * under other activations the same weights compute a different function. NeuralNetwork
+ * remains the choice when the shape is only known at runtime.
+ */
+
+#include "network.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <type_traits>
+
+// Layer kinds
+struct Dense {};
+
+// Activation functions applied by a layer to all of its outputs. The type and parameter
+// identify the ActivationFunction computing the same function.
+template <typename F>
+struct ElementWise {
+  static double parameter() {
+    return 0.0;
+  }
+
+  template <std::size_t N>
+  static void apply(std::array<double, N> &values) {
+    for (double &value : values) {
+      value = F::activation(value);
+    }
+  }
+};
+
+struct Sigmoid: ElementWise<Sigmoid> {
+  static const ActivationFunction::Type type = ActivationFunction::SIGMOID;
+
+  static double activation(const double input) {
+    return 1.0/(1.0 + std::exp(-input));
+  }
+};
+
+struct Tanh: ElementWise<Tanh> {
+  static const ActivationFunction::Type type = ActivationFunction::TANH;
+
+  static double activation(const double input) {
+    return std::tanh(input);
+  }
+};
+
+// Leaky ReLU with a slope of Numerator/Denominator for negative inputs
+template <int Numerator = 1, int Denominator = 100>
+struct LeakyReLU: ElementWise<LeakyReLU<Numerator, Denominator> > {
+  static const ActivationFunction::Type type = ActivationFunction::LEAKY_RELU;
+
+  static double parameter() {
+    return static_cast<double>(Numerator)/Denominator;
+  }
+
+  static double activation(const double input) {
+    return input > 0.0 ? input : parameter()*input;
+  }
+};
+
+typedef LeakyReLU<0, 1> ReLU;
+
+struct Linear: ElementWise<Linear> {
+  static const ActivationFunction::Type type = ActivationFunction::LINEAR;
+
+  static double activation(const double input) {
+    return input;
+  }
+};
+
+// Normalizes the outputs of the layer to sum to one
+struct Softmax {
+  static const ActivationFunction::Type type = ActivationFunction::SOFTMAX;
+
+  static double parameter() {
+    return 0.0;
+  }
+
+  template <std::size_t N>
+  static void apply(std::array<double, N> &values) {
+    // Shifting by the maximum keeps the exponentials from overflowing
+    const double largest = *std::max_element(values.begin(), values.end());
+    double sum = 0.0;
+    for (double &value : values) {
+      value = std::exp(value - largest);
+      sum += value;
+    }
+    for (double &value : values) {
+      value /= sum;
+    }
+  }
+};
+
+template <int N>
+struct Input {
+  static const int size = N;
+};
+
+template <typename Kind, typename Activation, int N>
+struct Layer {
+  typedef Kind kind;
+  typedef Activation activation;
+  static const int size = N;
+};
+
+// The weights of a single layer with the given number of inputs.
+template <int Inputs, typename L>
+class StaticLayer {
+  static_assert(std::is_same<typename L::kind, Dense>::value, "Only dense layers are supported");
+
+public:
+  static const int parameters = L::size * (Inputs + 1);
+  std::array<double, parameters> weights;
+
+  void forward(const std::array<double, Inputs> &input, std::array<double, L::size> &output) const {
+    for (int i = 0; i < L::size; ++i) {
+      const double *w = &weights[i * (Inputs + 1)];
+
+      // Add bias unit
+      double sum = w[0];
+      for (int j = 0; j < Inputs; ++j) {
+        sum += w[j + 1] * input[j];
+      }
+
+      output[i] = sum;
+    }
+
+    L::activation::apply(output);
+  }
+};
+
+// A chain of layers, the first of which takes Inputs values.
+template <int Inputs, typename... Layers>
+class LayerChain;
+
+template <int Inputs>
+class LayerChain<Inputs> {
+public:
+  static const int outputs = Inputs;
+  static const int parameters = 0;
+
+  const std::array<double, Inputs>& forward(const std::array<double, Inputs> &input) const {
+    return input;
+  }
+
+  void setParameters(const double *) {}
+
+  static bool matches(const NeuralNetwork &network, const int k) {
+    return k == network.getLayerCount();
+  }
+};
+
+template <int Inputs, typename First, typename... Rest>
+class LayerChain<Inputs, First, Rest...> {
+  StaticLayer<Inputs, First> layer;
+  LayerChain<First::size, Rest...> rest;
+
+public:
+  static const int outputs = LayerChain<First::size, Rest...>::outputs;
+  static const int parameters = StaticLayer<Inputs, First>::parameters + LayerChain<First::size, Rest...>::parameters;
+
+  std::array<double, outputs> forward(const std::array<double, Inputs> &input) const {
+    std::array<double, First::size> output;
+    layer.forward(input, output);
+    return rest.forward(output);
+  }
+
+  void setParameters(const double *values) {
+    std::copy(values, values + StaticLayer<Inputs, First>::parameters, layer.weights.begin());
+    rest.setParameters(values + StaticLayer<Inputs, First>::parameters);
+  }
+
+  // Whether layers k onwards of the network have the shapes and activation of this chain
+  static bool matches(const NeuralNetwork &network, const int k) {
+    if (k >= network.getLayerCount()) {
+      return false;
+    }
+
+    const NeuralNetwork::ConstScalarLayerView w = network.getLayer(k);
+    const ActivationFunction &activation = network.getActivation();
+    return w.size1() == First::size && w.size2() == Inputs + 1 &&
+           activation.type() == First::activation::type && activation.parameter() == First::activation::parameter() &&
+           LayerChain<First::size, Rest...>::matches(network, k + 1);
+  }
+};
+
+template <typename In, typename... Layers>
+class Network {
+  static_assert(sizeof...(Layers) > 0, "A network needs at least one layer");
+
+  LayerChain<In::size, Layers...> layers;
+
+public:
+  static const int numberInput = In::size;
+  static const int numberOutput = LayerChain<In::size, Layers...>::outputs;
+  static const int numberParameters = LayerChain<In::size, Layers...>::parameters;
+
+  typedef std::array<double, numberInput> InputVector;
+  typedef std::array<double, numberOutput> OutputVector;
+
+  OutputVector feedForward(const InputVector &input) const {
+    return layers.forward(input);
+  }
+
+  // Load weights laid out like NeuralNetwork::getParameters(), returning false on a size mismatch.
+  bool setParameters(const ConstParameterSpan parameters) {
+    if (parameters.size() != numberParameters) {
+      return false;
+    }
+
+    layers.setParameters(parameters.data());
+    return true;
+  }
+
+  // Load the weights of a network with the same layer shapes, whose activation is the one
+  // of every layer here, returning false otherwise.
+  bool setParameters(const NeuralNetwork &network) {
+    if (!LayerChain<In::size, Layers...>::matches(network, 0)) {
+      return false;
+    }
+
+    return setParameters(network.getParameters());
+  }
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "telemetry.h"
+#include <cstdio>
+
+namespace {
+
+std::atomic<uint32_t> threadCount(0);
+
+uint32_t threadNumber() {
+  thread_local const uint32_t number = threadCount++;
+  return number;
+}
+
+}
+
+TraceBuffer::TraceBuffer(const std::size_t capacity): head(0), epoch(std::chrono::steady_clock::now()) {
+  std::size_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+
+  slots.reset(new Slot[size]);
+  mask = size - 1;
+  for (std::size_t i = 0; i < size; ++i) {
+    slots[i].sequence.store(0, std::memory_order_relaxed);
+  }
+}
+
+TraceBuffer& TraceBuffer::global() {
+  static TraceBuffer buffer;
+  return buffer;
+}
+
+void TraceBuffer::record(const char *name, const uint32_t kind, const uint64_t start, const uint64_t duration, const double value) {
+  /*
+   * Claim the next slot and write the event between two updates of its sequence (a
+   * seqlock), so a concurrent reader can tell a complete event from one being written.
+   */
+  const uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = slots[index & mask];
+
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot.event.name = name;
+  slot.event.start = start;
+  slot.event.duration = duration;
+  slot.event.value = value;
+  slot.event.thread = threadNumber();
+  slot.event.kind = kind;
+
+  slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+std::vector<TraceEvent> TraceBuffer::events() const {
+  const uint64_t end = head.load(std::memory_order_acquire);
+  const uint64_t begin = end > capacity() ? end - capacity() : 0;
+
+  std::vector<TraceEvent> result;
+  result.reserve(end - begin);
+
+  for (uint64_t i = begin; i < end; ++i) {
+    const Slot &slot = slots[i & mask];
+    if (slot.sequence.load(std::memory_order_acquire) != i + 1) {
+      continue;
+    }
+
+    const TraceEvent event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == i + 1) {
+      result.push_back(event);
+    }
+  }
+
+  return result;
+}
+
+void TraceBuffer::clear() {
+  for (std::size_t i = 0; i < capacity(); ++i) {
+    slots[i].sequence.store(0, std::memory_order_relaxed);
+  }
+  head.store(0, std::memory_order_release);
+}
+
+bool TraceBuffer::writeChromeTrace(const std::string &path) const {
+  /*
+   * Spans become complete ("X") events and counters become counter ("C") events, with
+   * timestamps in microseconds as the format expects.
+   */
+  std::FILE *file = std::fopen(path.c_str(), "w");
+  if (!file) {
+    return false;
+  }
+
+  std::fprintf(file, "{\"traceEvents\":[\n");
+  const std::vector<TraceEvent> held = events();
+  for (std::size_t i = 0; i < held.size(); ++i) {
+    const TraceEvent &e = held[i];
+    if (e.kind == TraceEvent::SPAN) {
+      std::fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                   e.name, e.start / 1e3, e.duration / 1e3, e.thread);
+    } else {
+      std::fprintf(file, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"value\":%.17g}}",
+                   e.name, e.start / 1e3, e.thread, e.value);
+    }
+    std::fprintf(file, i + 1 < held.size() ? ",\n" : "\n");
+  }
+  std::fprintf(file, "]}\n");
+
+  const bool valid = !std::ferror(file);
+  return std::fclose(file) == 0 && valid;
+}
+
+bool TraceBuffer::writeCsv(const std::string &path) const {
+  std::FILE *file = std::fopen(path.c_str(), "w");
+  if (!file) {
+    return false;
+  }
+
+  std::fprintf(file, "kind,name,thread,start_ns,duration_ns,value\n");
+  for (const TraceEvent &e : events()) {
+    std::fprintf(file, "%s,%s,%u,%llu,%llu,%.17g\n", e.kind == TraceEvent::SPAN ? "span" : "counter", e.name, e.thread,
+                 static_cast<unsigned long long>(e.start), static_cast<unsigned long long>(e.duration), e.value);
+  }
+
+  const bool valid = !std::ferror(file);
+  return std::fclose(file) == 0 && valid;
+}
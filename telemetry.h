@@ -0,0 +1,144 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+/*
+ * Training telemetry. Scoped timers (ML_TRACE_SCOPE) and counters (ML_TRACE_COUNTER)
+ * around the hot paths of the network and the optimizers record events into a lock-free
+ * ring buffer, which keeps the most recent events and can be written out as a Chrome
+ * trace (chrome://tracing or Perfetto) or as CSV.
+ *
+ * The macros are compiled out unless ML_TELEMETRY is defined (e.g. CFLAGS += -DML_TELEMETRY),
+ * so a normal build pays nothing for them. An event costs two clock reads and an atomic
+ * increment, well under 1% of a training step once it takes tens of microseconds.
+ *
+ * The optimizers also report per-itteration progress (SGDProgress, FEPProgress) to an
+ * optional callback; this does not depend on ML_TELEMETRY.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef ML_TELEMETRY
+const bool telemetryEnabled = true;
+#else
+const bool telemetryEnabled = false;
+#endif
+
+struct TraceEvent {
+  enum Kind { SPAN = 0, COUNTER = 1 };
+
+  const char *name; // Must be a string literal (or otherwise outlive the buffer)
+  uint64_t start; // Nanoseconds since the buffer was created
+  uint64_t duration; // Nanoseconds (spans only)
+  double value; // Counters only
+  uint32_t thread; // Small per-thread number, in order of each thread's first event
+  uint32_t kind;
+};
+
+class TraceBuffer {
+private:
+  // A slot's sequence is one more than the index of the event it holds, or zero while it is being written
+  struct Slot {
+    std::atomic<uint64_t> sequence;
+    TraceEvent event;
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  uint64_t mask;
+  std::atomic<uint64_t> head; // Index of the next event
+  const std::chrono::steady_clock::time_point epoch;
+
+public:
+  // The capacity is rounded up to a power of two
+  explicit TraceBuffer(const std::size_t capacity = 1 << 16);
+
+  // The buffer the trace macros record into
+  static TraceBuffer& global();
+
+  uint64_t now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+  }
+
+  // Record an event, overwriting the oldest one when the buffer is full. Safe to call from any thread.
+  void record(const char *name, const uint32_t kind, const uint64_t start, const uint64_t duration, const double value);
+
+  void span(const char *name, const uint64_t start) {
+    record(name, TraceEvent::SPAN, start, now() - start, 0.0);
+  }
+
+  void counter(const char *name, const double value) {
+    record(name, TraceEvent::COUNTER, now(), 0, value);
+  }
+
+  // Copy out the events still held, oldest first. Events being written meanwhile are skipped.
+  std::vector<TraceEvent> events() const;
+
+  // Forget all events. Not safe while other threads are recording.
+  void clear();
+
+  std::size_t capacity() const {
+    return mask + 1;
+  }
+
+  // Number of events recorded since the buffer was created or cleared (including overwritten ones)
+  uint64_t recorded() const {
+    return head.load(std::memory_order_relaxed);
+  }
+
+  // Write the held events as Chrome trace JSON or as CSV, returning false if the file cannot be written.
+  bool writeChromeTrace(const std::string &path) const;
+  bool writeCsv(const std::string &path) const;
+};
+
+// Records the time from its construction to its destruction as a span.
+class ScopedTimer {
+private:
+  const char *name;
+  uint64_t start;
+
+public:
+  explicit ScopedTimer(const char *_name): name(_name), start(TraceBuffer::global().now()) {}
+  ~ScopedTimer() {
+    TraceBuffer::global().span(name, start);
+  }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+#define ML_TRACE_CONCAT_(a, b) a##b
+#define ML_TRACE_CONCAT(a, b) ML_TRACE_CONCAT_(a, b)
+
+#ifdef ML_TELEMETRY
+#define ML_TRACE_SCOPE(name) ScopedTimer ML_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define ML_TRACE_COUNTER(name, value) TraceBuffer::global().counter(name, value)
+#else
+#define ML_TRACE_SCOPE(name) do {} while (0)
+#define ML_TRACE_COUNTER(name, value) do {} while (0)
+#endif
+
+// Progress of an SGD run, reported after every itteration
+struct SGDProgress {
+  int itteration;
+  double cost; // The cost used for the convergence check
+  double batchLoss; // Mean cost of the mini-batch (only found with loss smoothing, otherwise NaN)
+  double gradientNorm; // Euclidean norm of the mean gradient of the mini-batch
+};
+
+// Progress of an FEP run, reported after every generation
+struct FEPProgress {
+  int generation;
+  int fitnessEvaluations;
+  double bestFitness; // Lowest cost in the population
+  double meanFitness;
+  double minStepSize; // Over every weight of every individual
+  double meanStepSize;
+  double maxStepSize;
+  int64_t samplesSaved; // Sample evaluations racing skipped by dropping candidates so far
+};
+
+#endif
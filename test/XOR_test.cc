@@ -4,7 +4,54 @@
 #include "../network.h"
 #include "../gradient.h"
 #include "../evolution.h"
+#include "../static_network.h"
+#include "../quantized.h"
+#include "../inference.h"
+#include "../model.h"
+#include "../telemetry.h"
+#include "../sampler.h"
+#include "../optimizer.h"
+#include "../philox.h"
+#include "../island.h"
+#include "../sparse.h"
+#include "../loss.h"
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <memory>
+#include <new>
+
+// Count heap allocations so tests can check that training steps do not allocate. Aligned
+// buffers (AlignedVector) come from posix_memalign rather than operator new, so it is
+// replaced as well.
+std::atomic<long> allocations(0);
+
+extern "C" int posix_memalign(void **memory, std::size_t alignment, std::size_t size) noexcept {
+  allocations++;
+  *memory = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+  return *memory ? 0 : ENOMEM;
+}
+
+void* operator new(std::size_t size) {
+  allocations++;
+  void *memory = std::malloc(size ? size : 1);
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+  std::free(memory);
+}
 
 // Setup the test parameters
 struct XORdata {
@@ -87,6 +134,368 @@ BOOST_AUTO_TEST_CASE(XOR_test_feed_forward)
   }
 }
 
+BOOST_AUTO_TEST_CASE(XOR_test_parameter_views)
+{
+  /*
+  * We test that the layer views and the flat parameter span refer to the same
+  * contiguous storage, laid out layer by layer in row-major order.
+  */
+
+  std::vector<int> size;
+  size.push_back(3);
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+
+  BOOST_REQUIRE_EQUAL(network.getLayerCount(), 2);
+  BOOST_REQUIRE_EQUAL(network.getParameterSize(), 3*3 + 1*4);
+
+  ParameterSpan parameters = network.getParameters();
+  LayerView output = network.getLayer(1);
+  output(0, 2) = 42.0;
+  BOOST_CHECK_EQUAL(parameters[3*3 + 2], 42.0);
+
+  auto weights = network.getWeights();
+  BOOST_CHECK_EQUAL(weights[1](0, 2), 42.0);
+  BOOST_CHECK_EQUAL(weights[0](1, 0), parameters[3]);
+
+  weights[0](2, 1) = -7.0;
+  network.setWeights(weights);
+  BOOST_CHECK_EQUAL(parameters[2*3 + 1], -7.0);
+  BOOST_CHECK_EQUAL(network.getLayer(0).data(), parameters.data());
+}
+
+BOOST_AUTO_TEST_CASE(activation_kernels_match_scalar)
+{
+  /*
+  * We test that the vectorized array forms of the activation functions agree with
+  * the scalar forms (odd lengths exercise the scalar tails of the vector loops).
+  */
+
+  std::vector<std::unique_ptr<ActivationFunction> > functions;
+  functions.push_back(std::unique_ptr<ActivationFunction>(new SigmoidFunction()));
+  functions.push_back(std::unique_ptr<ActivationFunction>(new TanhFunction()));
+  functions.push_back(std::unique_ptr<ActivationFunction>(new ReLUFunction()));
+  functions.push_back(std::unique_ptr<ActivationFunction>(new LeakyReLUFunction(0.1)));
+  functions.push_back(std::unique_ptr<ActivationFunction>(new LinearFunction()));
+
+  std::vector<double> input(37);
+  for (int i = 0; i < input.size(); ++i) {
+    input[i] = -40.0 + 80.0*i/(input.size() - 1);
+  }
+
+  for (auto &f : functions) {
+    std::vector<double> output = input;
+    f->activation(output.data(), 1, output.size());
+
+    std::vector<double> delta(input.size(), 2.0);
+    f->gradient(input.data(), output.data(), delta.data(), 1, delta.size());
+
+    for (int i = 0; i < input.size(); ++i) {
+      BOOST_CHECK_SMALL(output[i] - f->activation(input[i]), 1e-12);
+      BOOST_CHECK_SMALL(delta[i] - 2.0*f->gradient(input[i]), 1e-12);
+    }
+  }
+
+  // Every row of a softmax block sums to one, even for very large inputs
+  std::vector<double> block(input);
+  SoftmaxFunction softmax;
+  softmax.activation(block.data(), 1, block.size());
+  double sum = 0.0;
+  for (double value : block) {
+    sum += value;
+  }
+  BOOST_CHECK_CLOSE(sum, 1.0, 1e-9);
+
+  BOOST_CHECK_CLOSE(fastExp(1.0), exp(1.0), 1e-13);
+  BOOST_CHECK_CLOSE(fastExp(-700.0), exp(-700.0), 1e-13);
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_static_network)
+{
+  /*
+  * We test that a network with a compile time shape loads the weights of a
+  * runtime network and produces the same outputs.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(2);
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+
+  Network<Input<2>, Layer<Dense, Sigmoid, 2>, Layer<Dense, Sigmoid, 1> > fixed;
+  static_assert(decltype(fixed)::numberParameters == 2*3 + 1*3, "Unexpected parameter count");
+  BOOST_REQUIRE(fixed.setParameters(network));
+
+  for (int i = 0; i < test.input.size(); ++i) {
+    std::array<double, 2> input = {{test.input[i][0], test.input[i][1]}};
+    BOOST_CHECK_CLOSE(fixed.feedForward(input)[0], network.feedForwardVector(test.input[i])[0], 1e-9);
+  }
+
+  // Layers may use different activation functions
+  Network<Input<2>, Layer<Dense, ReLU, 3>, Layer<Dense, Linear, 1> > mixed;
+  std::vector<double> weights(3*3 + 1*4, 1.0);
+  weights[3] = -5.0; // Bias of the second hidden neuron keeps it inactive
+  BOOST_REQUIRE(mixed.setParameters(weights));
+
+  std::array<double, 2> input = {{1.0, 2.0}};
+  BOOST_CHECK_CLOSE(mixed.feedForward(input)[0], 1.0 + 4.0 + 0.0 + 4.0, 1e-12);
+  BOOST_CHECK(!mixed.setParameters(network));
+
+  // Weights are only loaded into layers of the same shapes and activation, not merely the
+  // same parameter count (one hidden layer of 6 and hidden layers of 1 and 7 both have 25)
+  std::vector<int> wide(1, 6);
+  NeuralNetwork single(wide, 2, 1, new SigmoidFunction());
+  Network<Input<2>, Layer<Dense, Sigmoid, 1>, Layer<Dense, Sigmoid, 7>, Layer<Dense, Sigmoid, 1> > deep;
+  static_assert(decltype(deep)::numberParameters == 6*3 + 1*7, "Unexpected parameter count");
+  BOOST_CHECK(!deep.setParameters(single));
+
+  Network<Input<2>, Layer<Dense, Tanh, 2>, Layer<Dense, Tanh, 1> > other;
+  BOOST_CHECK(!other.setParameters(network));
+
+  // Softmax layers normalize their outputs like the runtime softmax
+  NeuralNetwork softmax(size, 2, 3, new SoftmaxFunction());
+  softmax.initializeRandomWeights(1.0);
+  Network<Input<2>, Layer<Dense, Softmax, 2>, Layer<Dense, Softmax, 3> > classifier;
+  BOOST_REQUIRE(classifier.setParameters(softmax));
+  const std::array<double, 3> classes = classifier.feedForward(input);
+  boost::numeric::ublas::vector<double> sample(2);
+  sample[0] = input[0];
+  sample[1] = input[1];
+  const boost::numeric::ublas::vector<double> expected = softmax.feedForwardVector(sample);
+  BOOST_CHECK_CLOSE(classes[0] + classes[1] + classes[2], 1.0, 1e-9);
+  for (int j = 0; j < 3; ++j) {
+    BOOST_CHECK_CLOSE(classes[j], expected[j], 1e-9);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_feed_forward_batch)
+{
+  /*
+  * We test that the batched feed forward produces the same outputs as passing
+  * each sample through the network individually.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(3);
+  size.push_back(2);
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+
+  boost::numeric::ublas::matrix<double> batch(test.input.size(), 2);
+  for (int i = 0; i < test.input.size(); ++i) {
+    batch(i, 0) = test.input[i][0];
+    batch(i, 1) = test.input[i][1];
+  }
+
+  auto output = network.feedForwardBatch(batch);
+  BOOST_REQUIRE_EQUAL(output.size1(), test.input.size());
+  BOOST_REQUIRE_EQUAL(output.size2(), 1);
+
+  for (int i = 0; i < test.input.size(); ++i) {
+    BOOST_CHECK_CLOSE(output(i, 0), network.feedForwardVector(test.input[i])[0], 1e-9);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_back_propogate_batch)
+{
+  /*
+  * We test that the batched back propogation produces the sum of the gradients
+  * calculated for each sample individually.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(3);
+  size.push_back(2);
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+
+  boost::numeric::ublas::matrix<double> batch(test.input.size(), 2);
+  boost::numeric::ublas::matrix<double> expected(test.input.size(), 1);
+  for (int i = 0; i < test.input.size(); ++i) {
+    batch(i, 0) = test.input[i][0];
+    batch(i, 1) = test.input[i][1];
+    expected(i, 0) = test.expected[i][0];
+  }
+
+  ParameterVector gradient(network.getParameterSize());
+  double batchCost;
+  BOOST_REQUIRE(network.backPropogateBatch(batch, expected, gradient, &batchCost));
+  BOOST_CHECK_CLOSE(batchCost, network.cost(test.input, test.expected) * test.input.size(), 1e-9);
+
+  auto sum = network.backPropogateVector(test.input[0], test.expected[0]);
+  for (int i = 1; i < test.input.size(); ++i) {
+    auto derivative = network.backPropogateVector(test.input[i], test.expected[i]);
+    for (int k = 0; k < sum.size(); ++k) {
+      sum[k] += derivative[k];
+    }
+  }
+
+  // The flat gradient is laid out layer by layer like the parameters
+  int offset = 0;
+  BOOST_REQUIRE_EQUAL(network.getLayerCount(), sum.size());
+  for (int k = 0; k < sum.size(); ++k) {
+    for (int i = 0; i < sum[k].size1(); ++i) {
+      for (int j = 0; j < sum[k].size2(); ++j) {
+        BOOST_CHECK_SMALL(gradient[offset++] - sum[k](i, j), 1e-12);
+      }
+    }
+  }
+  BOOST_CHECK_EQUAL(offset, gradient.size());
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_single_precision)
+{
+  /*
+  * We test that a single precision network with the same weights agrees with the
+  * double precision one, for the activation kernels, feed forward and back propogation.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(3);
+  size.push_back(2);
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights(0.5);
+
+  FloatNeuralNetwork single(size, 2, 1, new SigmoidFunction());
+  single.setWeights(network.getWeights());
+
+  std::vector<float> input(37);
+  for (int i = 0; i < input.size(); ++i) {
+    input[i] = -40.0f + 80.0f*i/(input.size() - 1);
+  }
+  SigmoidFunction sigmoid;
+  std::vector<float> output = input;
+  sigmoid.activation(output.data(), 1, output.size());
+  for (int i = 0; i < input.size(); ++i) {
+    BOOST_CHECK_SMALL(output[i] - sigmoid.activation(input[i]), 1e-6);
+  }
+  BOOST_CHECK_CLOSE(fastExp(1.0f), exp(1.0), 1e-5);
+
+  boost::numeric::ublas::matrix<double> batch(test.input.size(), 2);
+  boost::numeric::ublas::matrix<double> expected(test.input.size(), 1);
+  boost::numeric::ublas::matrix<float> singleBatch(test.input.size(), 2);
+  boost::numeric::ublas::matrix<float> singleExpected(test.input.size(), 1);
+  DatasetView(test.input, test.expected).gather(std::vector<int>{0, 1, 2, 3}.data(), 4, batch, expected);
+  DatasetView(test.input, test.expected).gather(std::vector<int>{0, 1, 2, 3}.data(), 4, singleBatch, singleExpected);
+
+  auto output64 = network.feedForwardBatch(batch);
+  auto output32 = single.feedForwardBatch(singleBatch);
+  for (int i = 0; i < test.input.size(); ++i) {
+    BOOST_CHECK_SMALL(output32(i, 0) - output64(i, 0), 1e-5);
+  }
+
+  ParameterVector gradient(network.getParameterSize());
+  AlignedVector<float> singleGradient(single.getParameterSize());
+  BOOST_REQUIRE(network.backPropogateBatch(batch, expected, gradient));
+  BOOST_REQUIRE(single.backPropogateBatch(singleBatch, singleExpected, singleGradient));
+  for (int i = 0; i < gradient.size(); ++i) {
+    BOOST_CHECK_SMALL(singleGradient[i] - gradient[i], 1e-5);
+  }
+  BOOST_CHECK_SMALL(single.cost(test.input, test.expected) - network.cost(test.input, test.expected), 1e-5);
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_train_SGD_single_precision)
+{
+  /*
+  * We test that training in single and mixed precision follows the double precision
+  * trajectory closely for the same initial weights and mini-batches.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(2);
+
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+  const double before = network.cost(test.input, test.expected);
+
+  FloatNeuralNetwork single(size, 2, 1, new SigmoidFunction());
+  single.setWeights(network.getWeights());
+  FloatNeuralNetwork mixed(size, 2, 1, new SigmoidFunction());
+  mixed.setWeights(network.getWeights());
+
+  StochasticGradientDescent SGD(&network, 0.5, 300);
+  SGD.setSeed(5);
+  SGD.train(test.input, test.expected, 0.0, 4);
+
+  FloatStochasticGradientDescent singleSGD(&single, 0.5, 300);
+  singleSGD.setSeed(5);
+  singleSGD.train(test.input, test.expected, 0.0, 4);
+
+  FloatStochasticGradientDescent mixedSGD(&mixed, 0.5, 300);
+  mixedSGD.setSeed(5);
+  mixedSGD.setMixedPrecision(true);
+  mixedSGD.train(test.input, test.expected, 0.0, 4);
+
+  const double after = network.cost(test.input, test.expected);
+  BOOST_CHECK(after < before);
+  BOOST_CHECK_SMALL(single.cost(test.input, test.expected) - after, 1e-3);
+  BOOST_CHECK_SMALL(mixed.cost(test.input, test.expected) - after, 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_training_step_allocations)
+{
+  /*
+  * We test that once the training buffers have been sized, back propogation and
+  * SGD steps make no heap allocations.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(4);
+  size.push_back(3);
+
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+
+  boost::numeric::ublas::matrix<double> batch(test.input.size(), 2);
+  boost::numeric::ublas::matrix<double> expected(test.input.size(), 1);
+  int all[] = {0, 1, 2, 3};
+  DatasetView(test.input, test.expected).gather(all, 4, batch, expected);
+
+  ParameterVector gradient(network.getParameterSize());
+  TrainingWorkspace workspace;
+  BOOST_REQUIRE(network.backPropogateBatch(batch, expected, gradient, workspace));
+
+  // Aligned buffers are counted too
+  long before = allocations;
+  {
+    ParameterVector probe(16);
+  }
+  BOOST_CHECK_EQUAL(allocations - before, 1);
+
+  before = allocations;
+  network.backPropogateBatch(batch, expected, gradient, workspace);
+  network.backPropogateVector(test.input[1], test.expected[1], gradient, workspace);
+  BOOST_CHECK_EQUAL(allocations - before, 0);
+
+  // Training for more steps must not allocate more (the moving average check needs no cost pass)
+  StochasticGradientDescent shortRun(&network, 0.1, 10);
+  StochasticGradientDescent longRun(&network, 0.1, 100);
+  shortRun.setLossSmoothing(0.1);
+  longRun.setLossSmoothing(0.1);
+  shortRun.train(test.input, test.expected, 0.0, 3);
+  longRun.train(test.input, test.expected, 0.0, 3);
+
+  before = allocations;
+  shortRun.train(test.input, test.expected, 0.0, 3);
+  const long shortAllocations = allocations - before;
+
+  before = allocations;
+  longRun.train(test.input, test.expected, 0.0, 3);
+  BOOST_CHECK_EQUAL(allocations - before, shortAllocations);
+}
+
 BOOST_AUTO_TEST_CASE(XOR_test_train_SGD)
 {
   /*
@@ -118,6 +527,1090 @@ BOOST_AUTO_TEST_CASE(XOR_test_train_SGD)
   }
 }
 
+BOOST_AUTO_TEST_CASE(XOR_test_train_SGD_parallel_deterministic)
+{
+  /*
+  * We test that data-parallel SGD in deterministic mode gives bit-identical
+  * weights for a fixed seed and thread count.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(2);
+
+  NeuralNetwork first(size, 2, 1, new SigmoidFunction());
+  first.initializeRandomWeights();
+
+  NeuralNetwork second(size, 2, 1, new SigmoidFunction());
+  second.setWeights(first.getWeights());
+
+  StochasticGradientDescent firstSGD(&first, 0.1, 200);
+  firstSGD.setSeed(7);
+  firstSGD.setThreads(3, true);
+  firstSGD.train(test.input, test.expected, 0.0, 4);
+
+  StochasticGradientDescent secondSGD(&second, 0.1, 200);
+  secondSGD.setSeed(7);
+  secondSGD.setThreads(3, true);
+  secondSGD.train(test.input, test.expected, 0.0, 4);
+
+  auto firstWeights = first.getWeights();
+  auto secondWeights = second.getWeights();
+  for (int k = 0; k < firstWeights.size(); ++k) {
+    for (int i = 0; i < firstWeights[k].size1(); ++i) {
+      for (int j = 0; j < firstWeights[k].size2(); ++j) {
+        BOOST_CHECK_EQUAL(firstWeights[k](i, j), secondWeights[k](i, j));
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_checkpoint_resume)
+{
+  /*
+  * We test that a run interrupted after a checkpoint and resumed in a fresh
+  * optimizer ends with exactly the weights of an uninterrupted run, for both
+  * SGD and FEP with fixed seeds.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(2);
+
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+  const AlignedVector<double> initial(network.getParameters().begin(), network.getParameters().end());
+
+  StochasticGradientDescent uninterrupted(&network, 0.1, 200);
+  uninterrupted.setSeed(11);
+  uninterrupted.train(test.input, test.expected, 0.0, 2);
+  const AlignedVector<double> expected(network.getParameters().begin(), network.getParameters().end());
+
+  network.setParameters(initial);
+  StochasticGradientDescent interrupted(&network, 0.1, 100);
+  interrupted.setSeed(11);
+  interrupted.setCheckpoint("XOR_sgd.ckpt", 50);
+  interrupted.train(test.input, test.expected, 0.0, 2);
+
+  NeuralNetwork restored(size, 2, 1, new SigmoidFunction());
+  StochasticGradientDescent resumed(&restored, 0.1, 200);
+  BOOST_CHECK(resumed.resume("XOR_sgd.ckpt"));
+  resumed.train(test.input, test.expected, 0.0, 2);
+
+  for (int i = 0; i < expected.size(); ++i) {
+    BOOST_CHECK_EQUAL(restored.getParameters()[i], expected[i]);
+  }
+
+  // A checkpoint of the other optimizer is rejected
+  EvolutionaryProgramming wrongKind(&restored, -20.0, 20.0, 20);
+  BOOST_CHECK(!wrongKind.resume("XOR_sgd.ckpt"));
+
+  EvolutionaryProgramming uninterruptedFEP(&network, -20.0, 20.0, 20);
+  uninterruptedFEP.setSeed(13);
+  uninterruptedFEP.train(test.input, test.expected, 2000);
+  const AlignedVector<double> expectedFEP(network.getParameters().begin(), network.getParameters().end());
+
+  EvolutionaryProgramming interruptedFEP(&network, -20.0, 20.0, 20);
+  interruptedFEP.setSeed(13);
+  interruptedFEP.setCheckpoint("XOR_fep.ckpt", 1);
+  interruptedFEP.train(test.input, test.expected, 1000);
+
+  EvolutionaryProgramming resumedFEP(&restored, -20.0, 20.0, 20);
+  BOOST_CHECK(resumedFEP.resume("XOR_fep.ckpt"));
+  resumedFEP.train(test.input, test.expected, 2000);
+
+  for (int i = 0; i < expectedFEP.size(); ++i) {
+    BOOST_CHECK_EQUAL(restored.getParameters()[i], expectedFEP[i]);
+  }
+
+  std::remove("XOR_sgd.ckpt");
+  std::remove("XOR_fep.ckpt");
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_telemetry)
+{
+  /*
+  * We test that the trace buffer keeps the latest events in order and writes
+  * them out, and that the optimizers report their progress every step.
+  */
+
+  TraceBuffer trace(6);
+  BOOST_CHECK_EQUAL(trace.capacity(), 8);
+
+  static const char *names[] = {"e0", "e1", "e2", "e3", "e4", "e5", "e6", "e7", "e8", "e9"};
+  for (int i = 0; i < 10; ++i) {
+    trace.record(names[i], i % 2 ? TraceEvent::COUNTER : TraceEvent::SPAN, i, 1, i);
+  }
+
+  const std::vector<TraceEvent> events = trace.events();
+  BOOST_REQUIRE_EQUAL(events.size(), 8);
+  for (int i = 0; i < 8; ++i) {
+    BOOST_CHECK_EQUAL(events[i].name, names[i + 2]);
+    BOOST_CHECK_EQUAL(events[i].start, i + 2);
+  }
+
+  BOOST_CHECK(trace.writeChromeTrace("XOR_trace.json"));
+  BOOST_CHECK(trace.writeCsv("XOR_trace.csv"));
+  std::ifstream json("XOR_trace.json");
+  std::string line;
+  std::getline(json, line);
+  BOOST_CHECK_EQUAL(line, "{\"traceEvents\":[");
+  std::ifstream csv("XOR_trace.csv");
+  int lines = 0;
+  while (std::getline(csv, line)) {
+    lines++;
+  }
+  BOOST_CHECK_EQUAL(lines, 9);
+  std::remove("XOR_trace.json");
+  std::remove("XOR_trace.csv");
+
+  trace.clear();
+  BOOST_CHECK(trace.events().empty());
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(2);
+
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+
+  std::vector<SGDProgress> steps;
+  StochasticGradientDescent SGD(&network, 0.1, 50);
+  SGD.setSeed(3);
+  SGD.setProgress([&] (const SGDProgress &p) { steps.push_back(p); });
+  SGD.train(test.input, test.expected, 0.0, 2);
+
+  BOOST_REQUIRE_EQUAL(steps.size(), 50);
+  BOOST_CHECK_EQUAL(steps.back().itteration, 50);
+  BOOST_CHECK_SMALL(steps.back().cost - network.cost(test.input, test.expected), 1e-12);
+  BOOST_CHECK(steps.back().gradientNorm > 0.0);
+
+  int generations = 0;
+  FEPProgress last;
+  EvolutionaryProgramming FEP(&network, -20.0, 20.0, 20);
+  FEP.setSeed(3);
+  FEP.setProgress([&] (const FEPProgress &p) { generations++; last = p; });
+  FEP.train(test.input, test.expected, 400);
+
+  BOOST_CHECK_EQUAL(generations, 10);
+  BOOST_CHECK_EQUAL(last.fitnessEvaluations, 400);
+  BOOST_CHECK(last.bestFitness <= last.meanFitness);
+  BOOST_CHECK(last.minStepSize <= last.meanStepSize && last.meanStepSize <= last.maxStepSize);
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_batch_sampler)
+{
+  /*
+  * We test that uniform batches visit every sample once per epoch, stratified
+  * batches keep the class proportions, weighted batches follow the weights and
+  * prefetching does not change the training result.
+  */
+
+  std::default_random_engine generator(1);
+  std::vector<int> rows;
+  std::vector<int> seen(10, 0);
+
+  BatchSampler uniform;
+  BOOST_REQUIRE(uniform.reset(10));
+  for (int k = 0; k < 10; ++k) {
+    uniform.next(generator, 3, rows);
+    BOOST_CHECK(std::is_sorted(rows.begin(), rows.end()));
+    for (const int i : rows) {
+      seen[i]++;
+    }
+  }
+  BOOST_CHECK_EQUAL(uniform.getEpoch(), 3.0);
+  for (const int count : seen) {
+    BOOST_CHECK_EQUAL(count, 3);
+  }
+
+  // A batch larger than the dataset runs into the next epoch
+  uniform.next(generator, 25, rows);
+  BOOST_CHECK_EQUAL(rows.size(), 25);
+
+  std::vector<int> strata(100, 0);
+  for (int i = 0; i < 10; ++i) {
+    strata[7 * i + 3] = 1;
+  }
+  BatchSampler stratified;
+  stratified.setStrata(strata);
+  BOOST_CHECK(!stratified.reset(50));
+  BOOST_REQUIRE(stratified.reset(100));
+  for (int k = 0; k < 20; ++k) {
+    stratified.next(generator, 10, rows);
+    int rare = 0;
+    for (const int i : rows) {
+      rare += strata[i];
+    }
+    BOOST_CHECK_EQUAL(rare, 1);
+  }
+
+  std::vector<double> weights(4, 1.0);
+  weights[0] = 0.0;
+  weights[3] = 3.0;
+  BatchSampler weighted;
+  BOOST_REQUIRE(weighted.setWeights(weights));
+  BOOST_REQUIRE(weighted.reset(4));
+  std::vector<int> draws(4, 0);
+  weighted.next(generator, 10000, rows);
+  for (const int i : rows) {
+    draws[i]++;
+  }
+  BOOST_CHECK_EQUAL(draws[0], 0);
+  BOOST_CHECK_CLOSE(draws[3] / 10000.0, 0.6, 5.0);
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(2);
+
+  NeuralNetwork first(size, 2, 1, new SigmoidFunction());
+  first.initializeRandomWeights();
+  NeuralNetwork second(size, 2, 1, new SigmoidFunction());
+  second.setParameters(first.getParameters());
+
+  StochasticGradientDescent plain(&first, 0.1, 100);
+  plain.setSeed(5);
+  plain.setThreads(2, true);
+  plain.train(test.input, test.expected, 0.0, 6);
+  // The batch after the last one is drawn ahead
+  BOOST_CHECK_EQUAL(plain.getEpoch(), 101 * 6 / 4.0);
+
+  StochasticGradientDescent prefetched(&second, 0.1, 100);
+  prefetched.setSeed(5);
+  prefetched.setThreads(2, true);
+  prefetched.setPrefetch(true);
+  prefetched.train(test.input, test.expected, 0.0, 6);
+
+  for (int i = 0; i < first.getParameterSize(); ++i) {
+    BOOST_CHECK_EQUAL(first.getParameters()[i], second.getParameters()[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_optimizers)
+{
+  /*
+  * We test that each fused update rule matches a step by step reference, in double
+  * and single precision, that the learning rate schedules give the expected
+  * multipliers, and that Adam resumes exactly from a checkpoint and trains XOR.
+  */
+
+  const int n = 37; // Not a multiple of any vector width
+  const double rate = 0.05;
+  const double scale = 0.5;
+
+  const OptimizerSettings rules[] = {OptimizerSettings::sgd(0.0), OptimizerSettings::sgd(0.9), OptimizerSettings::nesterov(0.9),
+                                     OptimizerSettings::adagrad(), OptimizerSettings::rmsprop(0.9), OptimizerSettings::adam()};
+
+  for (const OptimizerSettings &settings : rules) {
+    std::vector<double> reference(n);
+    std::vector<double> first(n, 0.0);
+    std::vector<double> second(n, 0.0);
+    AlignedVector<double> weights(n);
+    AlignedVector<float> singleWeights(n);
+    std::vector<double> gradient(n);
+    std::vector<float> singleGradient(n);
+    for (int i = 0; i < n; ++i) {
+      reference[i] = weights[i] = singleWeights[i] = 0.1 * (i % 7) - 0.3;
+    }
+
+    std::unique_ptr<BasicOptimizer<double> > optimizer = createOptimizer<double>(settings);
+    std::unique_ptr<BasicOptimizer<float> > singleOptimizer = createOptimizer<float>(settings);
+
+    for (int step = 1; step <= 5; ++step) {
+      for (int i = 0; i < n; ++i) {
+        singleGradient[i] = gradient[i] = std::sin(0.3 * i + step);
+      }
+      optimizer->update(weights.data(), gradient.data(), n, rate, scale);
+      singleOptimizer->update(singleWeights.data(), singleGradient.data(), n, rate, scale);
+
+      for (int i = 0; i < n; ++i) {
+        const double g = scale * gradient[i];
+        switch (settings.type) {
+        case MOMENTUM:
+          first[i] = settings.momentum * first[i] + rate * g;
+          reference[i] -= first[i];
+          break;
+        case NESTEROV:
+          first[i] = settings.momentum * first[i] + rate * g;
+          reference[i] -= settings.momentum * first[i] + rate * g;
+          break;
+        case ADAGRAD:
+          first[i] += g * g;
+          reference[i] -= rate * g / (std::sqrt(first[i]) + settings.epsilon);
+          break;
+        case RMSPROP:
+          first[i] = settings.decay * first[i] + (1 - settings.decay) * g * g;
+          reference[i] -= rate * g / (std::sqrt(first[i]) + settings.epsilon);
+          break;
+        case ADAM: {
+          first[i] = settings.momentum * first[i] + (1 - settings.momentum) * g;
+          second[i] = settings.decay * second[i] + (1 - settings.decay) * g * g;
+          const double m = first[i] / (1 - std::pow(settings.momentum, step));
+          const double v = second[i] / (1 - std::pow(settings.decay, step));
+          reference[i] -= rate * m / (std::sqrt(v) + settings.epsilon);
+          break;
+        }
+        }
+      }
+    }
+
+    for (int i = 0; i < n; ++i) {
+      BOOST_CHECK_CLOSE(weights[i], reference[i], 1e-9);
+      BOOST_CHECK_CLOSE(singleWeights[i], reference[i], 0.05);
+    }
+  }
+
+  BOOST_CHECK_EQUAL(LearningRateSchedule::constant().multiplier(50, 100), 1.0);
+  BOOST_CHECK_CLOSE(LearningRateSchedule::step(10, 0.5).multiplier(25, 100), 0.25, 1e-9);
+  BOOST_CHECK_CLOSE(LearningRateSchedule::exponential(0.9).multiplier(2, 100), 0.81, 1e-9);
+  BOOST_CHECK_CLOSE(LearningRateSchedule::cosine(0.1).multiplier(0, 101), 1.0, 1e-9);
+  BOOST_CHECK_CLOSE(LearningRateSchedule::cosine(0.1).multiplier(50, 101), 0.55, 1e-9);
+  BOOST_CHECK_CLOSE(LearningRateSchedule::cosine(0.1).multiplier(100, 101), 0.1, 1e-9);
+  BOOST_CHECK_CLOSE(LearningRateSchedule::constant().withWarmup(4).multiplier(1, 100), 0.5, 1e-9);
+  BOOST_CHECK_EQUAL(LearningRateSchedule::constant().withWarmup(4).multiplier(4, 100), 1.0);
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(2);
+
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+  const AlignedVector<double> initial(network.getParameters().begin(), network.getParameters().end());
+
+  // The schedule must not depend on the length of the run, which the interrupted run shortens
+  StochasticGradientDescent uninterrupted(&network, 0.01, 200);
+  uninterrupted.setOptimizer(OptimizerSettings::adam());
+  uninterrupted.setSchedule(LearningRateSchedule::step(40, 0.5));
+  uninterrupted.setSeed(17);
+  uninterrupted.train(test.input, test.expected, 0.0, 2);
+  const AlignedVector<double> expected(network.getParameters().begin(), network.getParameters().end());
+
+  network.setParameters(initial);
+  StochasticGradientDescent interrupted(&network, 0.01, 100);
+  interrupted.setOptimizer(OptimizerSettings::adam());
+  interrupted.setSchedule(LearningRateSchedule::step(40, 0.5));
+  interrupted.setSeed(17);
+  interrupted.setCheckpoint("XOR_adam.ckpt", 50);
+  interrupted.train(test.input, test.expected, 0.0, 2);
+
+  // The checkpoint only resumes into the same update rule
+  NeuralNetwork restored(size, 2, 1, new SigmoidFunction());
+  StochasticGradientDescent wrongRule(&restored, 0.01, 200);
+  BOOST_CHECK(!wrongRule.resume("XOR_adam.ckpt"));
+
+  StochasticGradientDescent resumed(&restored, 0.01, 200);
+  resumed.setOptimizer(OptimizerSettings::adam());
+  resumed.setSchedule(LearningRateSchedule::step(40, 0.5));
+  BOOST_CHECK(resumed.resume("XOR_adam.ckpt"));
+  resumed.train(test.input, test.expected, 0.0, 2);
+
+  for (int i = 0; i < expected.size(); ++i) {
+    BOOST_CHECK_EQUAL(restored.getParameters()[i], expected[i]);
+  }
+  std::remove("XOR_adam.ckpt");
+
+  // Adam trains XOR, in single precision with a double master copy too
+  FloatNeuralNetwork mixed(size, 2, 1, new SigmoidFunction());
+  mixed.initializeRandomWeights();
+  const double before = mixed.cost(test.input, test.expected);
+  FloatStochasticGradientDescent adam(&mixed, 0.05, 2000);
+  adam.setOptimizer(OptimizerSettings::adam());
+  adam.setMixedPrecision(true);
+  adam.train(test.input, test.expected, 0.0, 4);
+  BOOST_CHECK_LT(mixed.cost(test.input, test.expected), before);
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_convergence_checks)
+{
+  /*
+  * We test that training with the sampled convergence checks still reduces the cost,
+  * and that the moving average of mini-batch costs stops training once it is reached.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(2);
+
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+  const double before = network.cost(test.input, test.expected);
+
+  StochasticGradientDescent interval(&network, 0.5, 500);
+  interval.setSeed(3);
+  interval.setCheckInterval(50);
+  interval.setCheckSubsample(2);
+  interval.train(test.input, test.expected, 0.0, 2);
+  const double afterInterval = network.cost(test.input, test.expected);
+  BOOST_CHECK(afterInterval < before);
+
+  // A target above the initial cost stops training before the first step
+  StochasticGradientDescent smoothed(&network, 0.5, 500);
+  smoothed.setSeed(3);
+  smoothed.setLossSmoothing(0.1);
+  smoothed.train(test.input, test.expected, afterInterval + 1.0, 4);
+  BOOST_CHECK_EQUAL(network.cost(test.input, test.expected), afterInterval);
+
+  smoothed.train(test.input, test.expected, 0.0, 4);
+  BOOST_CHECK(network.cost(test.input, test.expected) < afterInterval);
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_cost_given_weights)
+{
+  /*
+  * We test that scoring a weight set through the stateless cost function matches
+  * the cost of a network holding those weights, and leaves the network unchanged.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(2);
+
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+  auto original = network.getWeights();
+
+  NeuralNetwork other(size, 2, 1, new SigmoidFunction());
+  other.initializeRandomWeights();
+  ConstParameterSpan candidate = other.getParameters();
+
+  // Score every candidate concurrently as FEP does
+  ThreadPool pool(3);
+  std::vector<double> costs(8);
+  pool.run(costs.size(), [&] (int i) {
+    costs[i] = network.cost(candidate, test.input, test.expected);
+  });
+
+  for (double J : costs) {
+    BOOST_CHECK_CLOSE(J, other.cost(test.input, test.expected), 1e-9);
+  }
+
+  auto weights = network.getWeights();
+  for (int k = 0; k < weights.size(); ++k) {
+    for (int i = 0; i < weights[k].size1(); ++i) {
+      for (int j = 0; j < weights[k].size2(); ++j) {
+        BOOST_CHECK_EQUAL(weights[k](i, j), original[k](i, j));
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_mapped_dataset)
+{
+  /*
+  * We test that a CSV converted to the binary format and memory-mapped gives the
+  * same samples and cost as the in-memory vectors, and can be trained on, and that
+  * crafted headers and ragged vectors are rejected.
+  */
+
+  XORdata test;
+  const std::string csvPath = "XOR_dataset.csv";
+  const std::string datasetPath = "XOR_dataset.bin";
+
+  std::ofstream csv(csvPath.c_str());
+  csv << "a,b,xor\n";
+  for (int k = 0; k < test.input.size(); ++k) {
+    csv << test.input[k][0] << "," << test.input[k][1] << "," << test.expected[k][0] << "\n";
+  }
+  csv.close();
+
+  BOOST_CHECK(!convertCSV(csvPath, datasetPath, 1));
+  BOOST_REQUIRE(convertCSV(csvPath, datasetPath, 1, true, true));
+
+  MappedDataset data;
+  BOOST_REQUIRE(data.open(datasetPath));
+  BOOST_CHECK_EQUAL(data.size(), 4);
+  BOOST_CHECK_EQUAL(data.getInputSize(), 2);
+  BOOST_CHECK_EQUAL(data.getOutputSize(), 1);
+
+  int rows[] = {3, 1};
+  boost::numeric::ublas::matrix<double> in(2, 2), out(2, 1);
+  DatasetView(data).gather(rows, 2, in, out);
+  for (int k = 0; k < 2; ++k) {
+    BOOST_CHECK_EQUAL(in(k, 0), test.input[rows[k]][0]);
+    BOOST_CHECK_EQUAL(in(k, 1), test.input[rows[k]][1]);
+    BOOST_CHECK_EQUAL(out(k, 0), test.expected[rows[k]][0]);
+  }
+
+  std::vector<int> size;
+  size.push_back(2);
+
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+  BOOST_CHECK_CLOSE(network.cost(data), network.cost(test.input, test.expected), 1e-9);
+
+  // The same samples viewed as a pair of row-major matrices
+  boost::numeric::ublas::matrix<double> inputMatrix(4, 2), expectedMatrix(4, 1);
+  int all[] = {0, 1, 2, 3};
+  DatasetView(test.input, test.expected).gather(all, 4, inputMatrix, expectedMatrix);
+  BOOST_CHECK_CLOSE(network.cost(DatasetView(inputMatrix, expectedMatrix)), network.cost(test.input, test.expected), 1e-9);
+
+  StochasticGradientDescent sgd(&network, 0.5, 200);
+  sgd.setSeed(7);
+  const double before = network.cost(data);
+  sgd.train(data, 0.0, 4);
+  BOOST_CHECK(network.cost(data) < before);
+
+  // A dataset with the wrong shape cannot be scored
+  NeuralNetwork wide(size, 3, 1, new SigmoidFunction());
+  BOOST_CHECK(std::isnan(wide.cost(data)));
+  data.close();
+
+  // Neither can vectors of different sizes, which would not fit the rows of a batch
+  std::vector<boost::numeric::ublas::vector<double> > ragged(test.input);
+  ragged[2].resize(3);
+  const DatasetView raggedData(ragged, test.expected);
+  BOOST_CHECK_EQUAL(raggedData.size(), 0);
+  BOOST_CHECK(std::isnan(network.cost(raggedData)));
+
+  // Crafted headers: a row count whose size wraps around, one beyond the range of int,
+  // and labels overlapping the header
+  const uint64_t wrapping = static_cast<uint64_t>(1) << 62;
+  const uint64_t tooMany = static_cast<uint64_t>(INT_MAX) + 1;
+  const uint64_t inHeader = 0;
+  const std::pair<std::size_t, uint64_t> crafted[] = {
+    std::make_pair(offsetof(DatasetHeader, rows), wrapping),
+    std::make_pair(offsetof(DatasetHeader, rows), tooMany),
+    std::make_pair(offsetof(DatasetHeader, labelOffset), inHeader)
+  };
+  for (const auto &field : crafted) {
+    BOOST_REQUIRE(convertCSV(csvPath, datasetPath, 1, true, true));
+    std::fstream file(datasetPath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(field.first);
+    file.write(reinterpret_cast<const char*>(&field.second), sizeof(field.second));
+    file.close();
+    BOOST_CHECK(!data.open(datasetPath));
+  }
+
+  std::remove(csvPath.c_str());
+  std::remove(datasetPath.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_model_file)
+{
+  /*
+  * We test that a saved model loads back into an identical network, that a mapped
+  * model gives the same outputs, and that a corrupted or crafted file is rejected.
+  */
+
+  XORdata test;
+  const std::string modelPath = "XOR_model.bin";
+
+  std::vector<int> size;
+  size.push_back(3);
+  size.push_back(2);
+  NeuralNetwork network(size, 2, 1, new LeakyReLUFunction(0.2));
+  network.initializeRandomWeights();
+  BOOST_REQUIRE(saveModel(network, modelPath));
+
+  auto loaded = loadModel<double>(modelPath);
+  BOOST_REQUIRE(loaded);
+  BOOST_CHECK_EQUAL(loaded->getActivation().type(), ActivationFunction::LEAKY_RELU);
+  BOOST_CHECK_EQUAL(loaded->getActivation().parameter(), 0.2);
+  BOOST_REQUIRE_EQUAL(loaded->getParameterSize(), network.getParameterSize());
+  for (int i = 0; i < network.getParameterSize(); ++i) {
+    BOOST_CHECK_EQUAL(loaded->getParameters()[i], network.getParameters()[i]);
+  }
+
+  auto single = loadModel<float>(modelPath);
+  BOOST_REQUIRE(single);
+
+  MappedModel mapped;
+  BOOST_REQUIRE(mapped.open(modelPath));
+  BOOST_CHECK(!FloatMappedModel().open(modelPath));
+  for (const auto &input : test.input) {
+    const double expected = network.feedForwardVector(input)[0];
+    BOOST_CHECK_SMALL(mapped.feedForwardVector(input)[0] - expected, 1e-12);
+    BOOST_CHECK_SMALL(single->feedForwardVector(input)[0] - expected, 1e-6);
+  }
+  mapped.close();
+
+  // Flip a bit in the last weight
+  std::fstream file(modelPath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+  file.seekg(-1, std::ios::end);
+  const char last = file.get();
+  file.seekp(-1, std::ios::end);
+  file.put(last ^ 1);
+  file.close();
+
+  BOOST_CHECK(!loadModel<double>(modelPath));
+  BOOST_CHECK(!mapped.open(modelPath));
+  BOOST_CHECK(mapped.open(modelPath, false));
+
+  // A layer table offset so large that its end wraps around past zero
+  const uint64_t layerOffset = ~static_cast<uint64_t>(0) - 7;
+  file.open(modelPath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+  file.seekp(offsetof(ModelHeader, layerOffset));
+  file.write(reinterpret_cast<const char*>(&layerOffset), sizeof(layerOffset));
+  file.close();
+  BOOST_CHECK(!mapped.open(modelPath, false));
+
+  std::remove(modelPath.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_quantized_network)
+{
+  /*
+  * We test that the int8 dot products are exact, and that the quantized network stays
+  * close to the double precision one while using far less memory for its weights.
+  */
+
+  std::mt19937 generator(11);
+  std::uniform_int_distribution<int> bytes(-127, 127);
+
+  // Lengths that are not a multiple of the vector width exercise the tails
+  const int n = 100, rows = 7, stride = 128;
+  std::vector<uint8_t> x(n);
+  std::vector<int8_t> w(rows * stride);
+  for (auto &v : x) v = bytes(generator) + 128;
+  for (auto &v : w) v = bytes(generator);
+
+  std::vector<int32_t> sums(rows);
+  vectorDotInt8(x.data(), w.data(), n, rows, stride, sums.data());
+  for (int r = 0; r < rows; ++r) {
+    int32_t expected = 0;
+    for (int j = 0; j < n; ++j) {
+      expected += x[j] * w[r * stride + j];
+    }
+    BOOST_CHECK_EQUAL(sums[r], expected);
+  }
+
+  std::vector<int> size;
+  size.push_back(64);
+  size.push_back(64);
+  NeuralNetwork network(size, 64, 4, new SigmoidFunction());
+  network.initializeRandomWeights(0.3);
+
+  std::uniform_real_distribution<double> features(-1.0, 1.0);
+  boost::numeric::ublas::matrix<double> input(200, 64);
+  boost::numeric::ublas::matrix<double> expected(200, 4, 0.0);
+  for (auto &v : input.data()) v = features(generator);
+  const DatasetView data(input, expected);
+
+  QuantizedNetwork quantized(network, data, 100);
+  const QuantizationError error = quantized.compare(network, data);
+  BOOST_CHECK(error.maxAbsolute < 0.02);
+  BOOST_CHECK(error.meanAbsolute < 0.005);
+  BOOST_CHECK(quantized.getWeightBytes() < network.getParameterSize() * sizeof(float) / 3);
+
+  boost::numeric::ublas::vector<double> sample(64);
+  std::copy(&input(5, 0), &input(5, 0) + 64, sample.begin());
+  const auto single = quantized.feedForwardVector(sample);
+  const auto batch = quantized.feedForwardBatch(input);
+  for (int j = 0; j < 4; ++j) {
+    BOOST_CHECK_EQUAL(single[j], batch(5, j));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_inference_server)
+{
+  /*
+  * We test that requests submitted concurrently to the inference server are grouped
+  * into batches and each answered with the network's output for its own input.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(3);
+  size.push_back(2);
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+
+  std::vector<double> reference;
+  for (const auto &input : test.input) {
+    reference.push_back(network.feedForwardVector(input)[0]);
+  }
+
+  const int clients = 4;
+  const int perClient = 50;
+  std::vector<std::vector<double> > answers(clients, std::vector<double>(perClient));
+  {
+    InferenceServer server(network, 4, 1000, 2);
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; ++c) {
+      threads.push_back(std::thread([&, c] {
+        std::vector<std::future<InferenceServer::Vector> > futures;
+        for (int i = 0; i < perClient; ++i) {
+          futures.push_back(server.submit(test.input[(c + i) % test.input.size()]));
+        }
+        for (int i = 0; i < perClient; ++i) {
+          answers[c][i] = futures[i].get()[0];
+        }
+      }));
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(server.getServed(), clients * perClient);
+    BOOST_CHECK(server.getBatches() < clients * perClient);
+
+    // Inputs of the wrong size are answered with an empty output
+    BOOST_CHECK_EQUAL(server.submit(boost::numeric::ublas::vector<double>(3)).get().size(), 0);
+  }
+
+  for (int c = 0; c < clients; ++c) {
+    for (int i = 0; i < perClient; ++i) {
+      BOOST_CHECK_SMALL(answers[c][i] - reference[(c + i) % test.input.size()], 1e-12);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_sparse_network)
+{
+  /*
+  * We test that magnitude pruning cuts exactly the requested share of the weights,
+  * that retraining keeps the pruned weights at zero, and that the sparse network
+  * (CSR layers, or dense ones above the crossover) matches the pruned network.
+  */
+
+  std::mt19937 generator(13);
+  std::uniform_real_distribution<double> features(-1.0, 1.0);
+
+  std::vector<int> size;
+  size.push_back(64);
+  size.push_back(64);
+  NeuralNetwork network(size, 64, 4, new SigmoidFunction());
+  network.initializeRandomWeights(0.3);
+
+  boost::numeric::ublas::matrix<double> input(300, 64);
+  boost::numeric::ublas::matrix<double> expected(300, 4, 0.0);
+  for (auto &v : input.data()) v = features(generator);
+  const DatasetView data(input, expected);
+
+  // Unpruned, every layer is above the crossover and stays dense
+  SparseNetwork dense(network);
+  for (int k = 0; k < dense.getLayerCount(); ++k) {
+    BOOST_CHECK(!dense.isSparse(k));
+  }
+  BOOST_CHECK_SMALL(dense.compare(network, data).maxAbsolute, 1e-12);
+
+  // Each layer loses 80% of its weights, and no bias
+  NeuralNetwork layered(size, 64, 4, new SigmoidFunction());
+  layered.setParameters(network.getParameters());
+  const PruningMask layerMask = magnitudePrune(layered, 0.8, true);
+  for (int k = 0; k < layered.getLayerCount(); ++k) {
+    const ConstLayerView w = layered.getLayer(k);
+    int zeros = 0;
+    for (int i = 0; i < w.size1(); ++i) {
+      BOOST_CHECK(w(i, 0) != 0.0);
+      for (int j = 1; j < w.size2(); ++j) {
+        zeros += w(i, j) == 0.0;
+      }
+    }
+    BOOST_CHECK_EQUAL(zeros, std::lround(0.8 * w.size1() * (w.size2() - 1)));
+  }
+
+  // Over the whole network, 90% of the weights are cut
+  const PruningMask mask = magnitudePrune(network, 0.9);
+  int weights = 0, cut = 0;
+  for (int k = 0; k < network.getLayerCount(); ++k) {
+    weights += network.getLayer(k).size1() * (network.getLayer(k).size2() - 1);
+  }
+  for (int i = 0; i < network.getParameterSize(); ++i) {
+    cut += !mask[i];
+    BOOST_CHECK(mask[i] || network.getParameters()[i] == 0.0);
+  }
+  BOOST_CHECK_EQUAL(cut, std::lround(0.9 * weights));
+
+  SparseNetwork sparse(network);
+  BOOST_CHECK_CLOSE(sparse.getDensity(), 1.0 - static_cast<double>(cut) / weights, 1e-9);
+  BOOST_CHECK(sparse.getWeightBytes() < network.getParameterSize() * sizeof(double) / 3);
+  const SparseError error = sparse.compare(network, data);
+  BOOST_CHECK_SMALL(error.maxAbsolute, 1e-12);
+
+  boost::numeric::ublas::vector<double> sample(64);
+  std::copy(&input(5, 0), &input(5, 0) + 64, sample.begin());
+  const auto single = sparse.feedForwardVector(sample);
+  const auto batch = sparse.feedForwardBatch(input);
+  for (int j = 0; j < 4; ++j) {
+    BOOST_CHECK_EQUAL(single[j], batch(5, j));
+  }
+
+  // Softmax normalizes the outputs of each sample, across the feature-major layout
+  FloatNeuralNetwork softmax(size, 64, 4, new SoftmaxFunction());
+  softmax.initializeRandomWeights(0.3);
+  magnitudePrune(softmax, 0.95);
+  FloatSparseNetwork floatSparse(softmax);
+  BOOST_CHECK(floatSparse.isSparse(0));
+  BOOST_CHECK_SMALL(floatSparse.compare(softmax, data).maxAbsolute, 1e-5);
+
+  // Retraining with momentum leaves the pruned weights of XOR at zero
+  XORdata test;
+  std::vector<int> hidden;
+  hidden.push_back(4);
+  NeuralNetwork pruned(hidden, 2, 1, new SigmoidFunction());
+  pruned.initializeRandomWeights(1.0);
+  StochasticGradientDescent SGD(&pruned, 0.5, 300);
+  SGD.setSeed(7);
+  const PruningMask retrained = pruneAndRetrain(pruned, SGD, DatasetView(test.input, test.expected), 0.5, 3, 0.0, 4);
+  int zeros = 0;
+  for (int i = 0; i < pruned.getParameterSize(); ++i) {
+    BOOST_CHECK(retrained[i] || pruned.getParameters()[i] == 0.0);
+    zeros += pruned.getParameters()[i] == 0.0;
+  }
+  BOOST_CHECK_EQUAL(zeros, 6);
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_stable_loss)
+{
+  /*
+  * We test that the cost stays exact for saturated outputs, that the fused output
+  * delta is the gradient of each loss, and that the pairwise and parallel reductions
+  * are accurate and independent of the number of threads.
+  */
+
+  // A sigmoid output driven to z = -800 for a label of 1 costs softplus(800) = 800
+  std::vector<int> size;
+  size.push_back(2);
+  NeuralNetwork saturated(size, 2, 1, new SigmoidFunction());
+  const LayerView output = saturated.getLayer(1);
+  output(0, 0) = -800.0;
+  std::vector<boost::numeric::ublas::vector<double> > in(1, boost::numeric::ublas::vector<double>(2, 0.0));
+  std::vector<boost::numeric::ublas::vector<double> > label(1, boost::numeric::ublas::vector<double>(1, 1.0));
+  BOOST_CHECK_CLOSE(saturated.cost(in, label), 800.0, 1e-9);
+
+  FloatNeuralNetwork saturatedFloat(size, 2, 1, new SigmoidFunction());
+  saturatedFloat.getLayer(1)(0, 0) = 100.0f;
+  label[0][0] = 0.0;
+  BOOST_CHECK_CLOSE(saturatedFloat.cost(in, label), 100.0, 1e-4);
+
+  // Softmax cross entropy is -log of the output of the labelled class, from the logits
+  NeuralNetwork softmax(size, 2, 3, new SoftmaxFunction());
+  const LayerView classes = softmax.getLayer(1);
+  classes(0, 0) = 0.0;
+  classes(1, 0) = -1000.0;
+  classes(2, 0) = 1.0;
+  label.assign(1, boost::numeric::ublas::vector<double>(3, 0.0));
+  label[0][1] = 1.0;
+  BOOST_CHECK_CLOSE(softmax.cost(in, label), 1000.0 + std::log(1.0 + std::exp(1.0) + std::exp(-1000.0)), 1e-9);
+
+  // The delta of every loss back propogates to the gradient of the summed cost
+  std::mt19937 generator(17);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  boost::numeric::ublas::matrix<double> input(10, 3);
+  boost::numeric::ublas::matrix<double> expected(10, 2);
+  for (auto &v : input.data()) v = uniform(generator);
+  for (auto &v : expected.data()) v = uniform(generator);
+  const DatasetView data(input, expected);
+
+  std::vector<int> hidden;
+  hidden.push_back(4);
+  const LossFunction losses[] = {CROSS_ENTROPY, MEAN_SQUARED_ERROR, CROSS_ENTROPY, MEAN_SQUARED_ERROR};
+  for (int l = 0; l < 4; ++l) {
+    NeuralNetwork network(hidden, 3, 2, l < 2 ? static_cast<ActivationFunction*>(new SigmoidFunction()) : new SoftmaxFunction());
+    network.initializeRandomWeights(1.0);
+    network.setLoss(losses[l]);
+
+    ParameterVector gradient(network.getParameterSize());
+    double batchCost = 0.0;
+    BOOST_CHECK(network.backPropogateBatch(input, expected, gradient, &batchCost));
+    BOOST_CHECK_CLOSE(batchCost, network.costSum(network.getParameters(), data, 0, data.size()), 1e-9);
+
+    // Softmax hidden layers back propogate through the full Jacobian, so every weight is checked
+    ParameterVector weights(network.getParameters().begin(), network.getParameters().end());
+    for (int i = 0; i < weights.size(); ++i) {
+      const double step = 1e-6;
+      weights[i] += step;
+      const double above = network.costSum(ConstParameterSpan(weights), data, 0, data.size());
+      weights[i] -= 2 * step;
+      const double below = network.costSum(ConstParameterSpan(weights), data, 0, data.size());
+      weights[i] += step;
+      BOOST_CHECK_SMALL((above - below) / (2 * step) - gradient[i], 1e-6);
+    }
+  }
+
+  // A million tenths summed pairwise are off by a few ulp, not by a million roundings
+  std::vector<double> tenths(1000000, 0.1);
+  BOOST_CHECK_SMALL(pairwiseSum(tenths.data(), tenths.size()) - 100000.0, 1e-8);
+  BOOST_CHECK_EQUAL(pairwiseSum(tenths.data(), 0), 0.0);
+
+  boost::numeric::ublas::matrix<double> large(5000, 3);
+  boost::numeric::ublas::matrix<double> largeExpected(5000, 2);
+  for (auto &v : large.data()) v = uniform(generator);
+  for (auto &v : largeExpected.data()) v = uniform(generator) < 0.5 ? 0.0 : 1.0;
+  const DatasetView largeData(large, largeExpected);
+
+  NeuralNetwork network(hidden, 3, 2, new SigmoidFunction());
+  network.initializeRandomWeights(1.0);
+  ThreadPool pool(4);
+  BOOST_CHECK_EQUAL(network.cost(largeData, &pool), network.cost(largeData));
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_fep_mutation)
+{
+  /*
+  * We test the counter-based generator against the published Philox4x32-10 answers,
+  * that FEP mutation gives the same population on any number of threads, and
+  * that mutated weights stay within the bounds.
+  */
+
+  uint32_t r[4];
+  Philox(0)(0, 0, 0, 0, r);
+  BOOST_CHECK_EQUAL(r[0], 0x6627e8d5u);
+  BOOST_CHECK_EQUAL(r[1], 0xe169c58du);
+  BOOST_CHECK_EQUAL(r[2], 0xbc57ac4cu);
+  BOOST_CHECK_EQUAL(r[3], 0x9b00dbd8u);
+  Philox(0x299f31d0a4093822ull)(0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344, r);
+  BOOST_CHECK_EQUAL(r[0], 0xd16cfe09u);
+  BOOST_CHECK_EQUAL(r[1], 0x94fdccebu);
+  BOOST_CHECK_EQUAL(r[2], 0x5001e420u);
+  BOOST_CHECK_EQUAL(r[3], 0x24126ea1u);
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(2);
+
+  NeuralNetwork serial(size, 2, 1, new SigmoidFunction());
+  NeuralNetwork parallel(size, 2, 1, new SigmoidFunction());
+
+  EvolutionaryProgramming one(&serial, -2.0, 2.0, 30);
+  one.setSeed(21);
+  one.train(test.input, test.expected, 3000);
+
+  EvolutionaryProgramming several(&parallel, -2.0, 2.0, 30);
+  several.setSeed(21);
+  several.setThreads(3);
+  several.train(test.input, test.expected, 3000);
+
+  for (int i = 0; i < serial.getParameterSize(); ++i) {
+    BOOST_CHECK_EQUAL(serial.getParameters()[i], parallel.getParameters()[i]);
+    BOOST_CHECK(serial.getParameters()[i] >= -2.0 && serial.getParameters()[i] <= 2.0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_fep_racing)
+{
+  /*
+  * We test that racing FEP skips sample evaluations while still training, that the
+  * partial cost of a block range adds up to the full cost, and that a raced run
+  * resumes exactly from a checkpoint.
+  */
+
+  std::default_random_engine generator(9);
+  std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+  std::vector<boost::numeric::ublas::vector<double> > input(2000, boost::numeric::ublas::vector<double>(2));
+  std::vector<boost::numeric::ublas::vector<double> > expected(2000, boost::numeric::ublas::vector<double>(1));
+  for (int i = 0; i < input.size(); ++i) {
+    input[i](0) = distribution(generator);
+    input[i](1) = distribution(generator);
+    expected[i](0) = input[i](0) * input[i](1) > 0.0 ? 1.0 : 0.0;
+  }
+  const DatasetView data(input, expected);
+
+  std::vector<int> size;
+  size.push_back(3);
+
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  network.initializeRandomWeights();
+  const AlignedVector<double> initial(network.getParameters().begin(), network.getParameters().end());
+  const double before = network.cost(data);
+
+  const double head = network.costSum(network.getParameters(), data, 0, 700);
+  const double tail = network.costSum(network.getParameters(), data, 700, 2000);
+  BOOST_CHECK_GT(head, 0.0);
+  BOOST_CHECK_CLOSE((head + tail) / 2000, before, 1e-9);
+
+  EvolutionaryProgramming raced(&network, -20.0, 20.0, 20);
+  raced.setSeed(4);
+  raced.setRacing(true, 0.125);
+  int64_t reported = -1;
+  raced.setProgress([&reported](const FEPProgress &progress) { reported = progress.samplesSaved; });
+  raced.train(data, 2000);
+  BOOST_CHECK_GT(raced.getSamplesSaved(), 0);
+  BOOST_CHECK_EQUAL(reported, raced.getSamplesSaved());
+  BOOST_CHECK_LT(network.cost(data), before);
+  const AlignedVector<double> expectedWeights(network.getParameters().begin(), network.getParameters().end());
+
+  network.setParameters(initial);
+  EvolutionaryProgramming interrupted(&network, -20.0, 20.0, 20);
+  interrupted.setSeed(4);
+  interrupted.setRacing(true, 0.125);
+  interrupted.setCheckpoint("XOR_race.ckpt", 1);
+  interrupted.train(data, 1000);
+
+  NeuralNetwork restored(size, 2, 1, new SigmoidFunction());
+  EvolutionaryProgramming resumed(&restored, -20.0, 20.0, 20);
+  resumed.setRacing(true, 0.125);
+  BOOST_CHECK(resumed.resume("XOR_race.ckpt"));
+  resumed.train(data, 2000);
+  BOOST_CHECK_EQUAL(resumed.getSamplesSaved(), raced.getSamplesSaved());
+
+  for (int i = 0; i < expectedWeights.size(); ++i) {
+    BOOST_CHECK_EQUAL(restored.getParameters()[i], expectedWeights[i]);
+  }
+  std::remove("XOR_race.ckpt");
+}
+
+BOOST_AUTO_TEST_CASE(XOR_test_island_model)
+{
+  /*
+  * We test that migrants replace the least fit members of a population, that
+  * islands in worker processes train XOR along each topology, and that a run
+  * with a fixed seed is reproducible.
+  */
+
+  XORdata test;
+
+  std::vector<int> size;
+  size.push_back(2);
+
+  NeuralNetwork network(size, 2, 1, new SigmoidFunction());
+  const int dim = network.getParameterSize();
+
+  EvolutionaryProgramming population(&network, -20.0, 20.0, 10);
+  population.setSeed(3);
+  population.train(test.input, test.expected, 200);
+
+  AlignedVector<double> best(dim);
+  ParameterVector steps(dim);
+  double fitness = 0.0;
+  population.emigrate(1, best.data(), steps.data(), &fitness);
+  BOOST_CHECK_CLOSE(fitness, network.cost(test.input, test.expected), 1e-9);
+
+  // A perfect immigrant becomes the fittest member
+  AlignedVector<double> migrant(dim, 0.0);
+  const double perfect = 0.0;
+  population.immigrate(1, migrant.data(), steps.data(), &perfect);
+  population.emigrate(1, best.data(), steps.data(), &fitness);
+  BOOST_CHECK_EQUAL(fitness, 0.0);
+  BOOST_CHECK_EQUAL(best[0], 0.0);
+
+  const MigrationTopology topologies[] = {RING, FULLY_CONNECTED, RANDOM};
+  for (const MigrationTopology topology : topologies) {
+    network.initializeRandomWeights();
+    const double before = network.cost(test.input, test.expected);
+
+    IslandEvolution islands(&network, -20.0, 20.0, 20, 3);
+    islands.setSeed(5);
+    islands.setMigration(topology, 5, 2);
+    BOOST_CHECK(islands.train(test.input, test.expected, 20000));
+    BOOST_CHECK_LT(network.cost(test.input, test.expected), before);
+  }
+
+  NeuralNetwork again(size, 2, 1, new SigmoidFunction());
+  IslandEvolution repeat(&again, -20.0, 20.0, 20, 3);
+  repeat.setSeed(5);
+  repeat.setMigration(RANDOM, 5, 2);
+  BOOST_CHECK(repeat.train(test.input, test.expected, 20000));
+  for (int i = 0; i < dim; ++i) {
+    BOOST_CHECK_EQUAL(again.getParameters()[i], network.getParameters()[i]);
+  }
+
+  // A dataset of the wrong shape is rejected without starting any workers
+  std::vector<boost::numeric::ublas::vector<double> > wrong(1, boost::numeric::ublas::vector<double>(3));
+  BOOST_CHECK(!repeat.train(wrong, test.expected, 100));
+}
+
 BOOST_AUTO_TEST_CASE(XOR_test_train_evo)
 {
   /*
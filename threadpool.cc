@@ -0,0 +1,136 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(const int threads): current(nullptr), queued(0), outstanding(0), stopping(false) {
+  for (int i = 0; i < threads; ++i) {
+    queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+  }
+
+  for (int i = 0; i < threads; ++i) {
+    workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    stopping = true;
+  }
+  available.notify_all();
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+bool ThreadPool::takeTask(const int worker, int &task) {
+  /*
+   * Take the next task from the worker's own queue, or failing that steal the
+   * most recently queued task of another worker. A negative worker index (the
+   * calling thread) only steals.
+   */
+  if (worker >= 0) {
+    TaskQueue &own = *queues[worker];
+    std::unique_lock<std::mutex> guard(own.lock);
+
+    if (own.head < own.tasks.size()) {
+      task = own.tasks[own.head++];
+      if (own.head == own.tasks.size()) {
+        own.tasks.clear();
+        own.head = 0;
+      }
+      queued--;
+      return true;
+    }
+  }
+
+  for (int i = 1; i <= queues.size(); ++i) {
+    TaskQueue &victim = *queues[(worker + i + queues.size()) % queues.size()];
+    std::unique_lock<std::mutex> guard(victim.lock);
+
+    if (victim.head < victim.tasks.size()) {
+      task = victim.tasks.back();
+      victim.tasks.pop_back();
+      if (victim.head == victim.tasks.size()) {
+        victim.tasks.clear();
+        victim.head = 0;
+      }
+      queued--;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::complete() {
+  std::unique_lock<std::mutex> guard(lock);
+  if (--outstanding == 0) {
+    finished.notify_all();
+  }
+}
+
+void ThreadPool::workerLoop(const int worker) {
+  /*
+   * Workers keep taking (or stealing) tasks, sleeping whenever every queue is empty,
+   * until the pool is destroyed.
+   */
+  while (true) {
+    int task;
+
+    if (takeTask(worker, task)) {
+      (*current)(task);
+      complete();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    available.wait(guard, [this] { return stopping || queued > 0; });
+
+    if (stopping && queued <= 0) {
+      return;
+    }
+  }
+}
+
+void ThreadPool::run(const int count, const std::function<void(int)> &task) {
+  /*
+   * Spread count tasks across the worker queues and block until every one of them
+   * has completed. With an empty pool the tasks are run on the calling thread.
+   */
+  if (workers.empty()) {
+    for (int i = 0; i < count; ++i) {
+      task(i);
+    }
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    outstanding += count;
+  }
+
+  // Workers read the task after taking an index from a queue, which is guarded by the queue's lock
+  current = &task;
+
+  for (int i = 0; i < count; ++i) {
+    TaskQueue &target = *queues[i % queues.size()];
+    std::unique_lock<std::mutex> guard(target.lock);
+    target.tasks.push_back(i);
+  }
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    queued += count;
+  }
+  available.notify_all();
+
+  // Help out until the queues are drained, then wait for the remaining tasks.
+  int stolen;
+  while (takeTask(-1, stolen)) {
+    task(stolen);
+    complete();
+  }
+
+  std::unique_lock<std::mutex> guard(lock);
+  finished.wait(guard, [this] { return outstanding == 0; });
+}
@@ -0,0 +1,62 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+/*
+ * A fixed size pool of worker threads used to run independent pieces of work
+ * (e.g. slices of a mini-batch or the members of a population) in parallel.
+ * Every worker owns a task queue; a worker which runs out of tasks steals from
+ * the back of another worker's queue so uneven work is balanced automatically.
+ * Queues hold task indices in reusable buffers, so running tasks does not allocate
+ * once the queues have grown to the largest batch of tasks.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+private:
+  struct TaskQueue {
+    std::mutex lock;
+    std::vector<int> tasks; // Queued task indices; the owner takes from head onwards
+    int head;
+
+    TaskQueue(): head(0) {}
+  };
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<TaskQueue> > queues;
+  std::mutex lock;
+  std::condition_variable available; // Signalled when tasks are queued or the pool stops
+  std::condition_variable finished; // Signalled when the last outstanding task completes
+  const std::function<void(int)> *current; // The task of the run in progress
+  std::atomic<int> queued;
+  int outstanding;
+  bool stopping;
+
+  bool takeTask(const int worker, int &task);
+  void complete();
+  void workerLoop(const int worker);
+
+public:
+  explicit ThreadPool(const int threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Run task(i) for every i in [0, count) on the pool and wait until all have completed.
+  // The calling thread helps by stealing tasks while it waits. Only one thread may
+  // call run at a time.
+  void run(const int count, const std::function<void(int)> &task);
+
+  int size() const {
+    return workers.size();
+  }
+};
+
+#endif